@@ -0,0 +1,93 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file BufferedFileSystem.hpp
+	Defines a buffered, preallocating file writer.
+*/
+#ifndef BUFFEREDFILESYSTEM_HPP
+#define BUFFEREDFILESYSTEM_HPP
+#pragma once
+
+#include <LibLyketo/IFileSystem.hpp>
+
+#include <string>
+#include <vector>
+
+/*!
+	An IFileSystem made for writing large pack content files.
+
+	Writes are collected in a large buffer and handed to the operating system in big sequential
+	batches, so writing many small files costs a few system calls instead of one for each file.
+	The file can be preallocated from its expected size to avoid fragmentation and metadata updates while it grows.
+
+	Reading or seeking flushes the buffer first, so the file can also be read back while it is being written.
+	The buffer is flushed when the file is closed; call @ref Sync to make sure the data reached the disk.
+*/
+class BufferedFileSystem : public IFileSystem
+{
+public:
+	BufferedFileSystem();
+	virtual ~BufferedFileSystem();
+
+	/*!
+		Creates a file, replacing an existing one.
+
+		@param szFilename The file to create.
+		@param qwExpectedSize Size the file is expected to reach, used to preallocate the file (0 to disable).
+		@param bDirect Bypasses the operating system cache (O_DIRECT on Linux, write through on Windows), useful for huge builds.
+		@param nBufferSize Size of the write buffer (0 for the default size).
+		@return true if the file was created, otherwise false.
+	*/
+	bool Open(std::string szFilename, uint64_t qwExpectedSize = 0, bool bDirect = false, size_t nBufferSize = 0);
+
+	/*!
+		Flushes and closes the file.
+
+		@return true if the buffered data was written, otherwise false.
+	*/
+	bool Close();
+
+	bool Seek(uint64_t nLength, SeekOffset eOffset) override;
+	bool Read(uint8_t* pbOut, size_t nLength) override;
+	bool Write(const uint8_t* pbData, size_t nLength) override;
+	int64_t Tell() override;
+	bool ReadV(const FileSystemBuffer* pBuffers, size_t nCount) override;
+	bool WriteV(const FileSystemConstBuffer* pBuffers, size_t nCount) override;
+	int64_t Size() override;
+	bool Flush() override;
+	bool Sync() override;
+
+	bool IsOpen() const;
+
+private:
+	BufferedFileSystem(const BufferedFileSystem&);
+	BufferedFileSystem& operator=(const BufferedFileSystem&);
+
+	bool FlushBuffer(bool bAll);
+	bool WriteAt(const uint8_t* pbData, size_t nLength, uint64_t qwPosition);
+	bool ReadAt(uint8_t* pbOut, size_t nLength, uint64_t qwPosition);
+	bool WriteVAt(const FileSystemConstBuffer* pBuffers, size_t nCount, uint64_t qwPosition);
+	bool ReadVAt(const FileSystemBuffer* pBuffers, size_t nCount, uint64_t qwPosition);
+	bool SetDirect(bool bEnable);
+
+#ifdef _WIN32
+	void* m_hFile;
+#else
+	int m_nFile;
+#endif
+
+	std::vector<uint8_t> m_vBuffer;
+	uint8_t* m_pbBuffer; //!< Start of the buffer, aligned for direct I/O.
+	size_t m_nCapacity;
+	size_t m_nBuffered;
+
+	uint64_t m_qwPosition; //!< File position of the first buffered byte.
+	uint64_t m_qwSize;
+
+	bool m_bDirect;
+	bool m_bDirectActive;
+	bool m_bFailed;
+};
+
+#endif // BUFFEREDFILESYSTEM_HPP
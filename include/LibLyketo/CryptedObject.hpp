@@ -51,7 +51,8 @@ enum class CryptedObjectErrors
 	CryptFail,
 	InvalidCryptAlgorithm,
 	CompressFail,
-	InvalidFourCC
+	InvalidFourCC,
+	NeedMoreInput,
 };
 
 enum class EncryptType
@@ -68,6 +69,43 @@ public:
 	virtual ~CryptedObject();
 
 	CryptedObjectErrors Decrypt(const uint8_t* pbInput, size_t nLength);
+
+	/*!
+		Decrypts an object into a buffer owned by the caller.
+
+		The output buffer is only resized, so a buffer that is reused for many objects will stop allocating after the first ones.
+
+		@param pbInput The crypted object.
+		@param nLength The length of the crypted object.
+		@param pOutput The buffer that will contain the decrypted data.
+		@return The result of the decryptation.
+	*/
+	CryptedObjectErrors Decrypt(const uint8_t* pbInput, size_t nLength, std::vector<uint8_t>& pOutput);
+	/*!
+		Checks that the header of a crypted object is consistent with its length, without decoding it.
+
+		@param pbInput The crypted object.
+		@param nLength The length of the crypted object.
+		@param dwFourCC The expected FourCC.
+		@return Ok if the header is valid, otherwise the error of the header.
+	*/
+	static CryptedObjectErrors CheckHeader(const uint8_t* pbInput, size_t nLength, uint32_t dwFourCC);
+
+	/*!
+		Decrypts only the beginning of an object, from the beginning of its data.
+
+		Algorithms that cannot decompress a truncated input need the whole object, in that case NeedMoreInput is
+		returned until nLength equals nTotalLength.
+
+		@param pbInput The beginning of the crypted object.
+		@param nLength The number of available bytes of the crypted object.
+		@param nTotalLength The length of the whole crypted object.
+		@param nWanted The number of decrypted bytes needed.
+		@param pOutput The buffer that will contain at least nWanted decrypted bytes.
+		@return Ok, NeedMoreInput if a longer part of the object is needed, otherwise the error of the decryptation.
+	*/
+	CryptedObjectErrors DecryptPrefix(const uint8_t* pbInput, size_t nLength, size_t nTotalLength, size_t nWanted, std::vector<uint8_t>& pOutput);
+
 	CryptedObjectErrors Encrypt(const uint8_t* pbInput, size_t nLength, EncryptType sType = EncryptType::CompressAndEncrypt);
 	
 	const uint8_t* GetBuffer() const { return m_pBuffer.data(); }
@@ -88,6 +126,7 @@ private:
 	std::shared_ptr<CryptedObjectAlgorithm> m_pAlgorithm;
 
 	std::vector<uint8_t> m_pBuffer;
+	std::vector<uint8_t> m_pCryptBuffer;
 };
 
 #endif // CRYPTEDOBJECT_HPP
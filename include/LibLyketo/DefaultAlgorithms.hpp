@@ -58,6 +58,7 @@ public:
 	
 
 	bool HaveCryptation() override;
+	bool CanDecompressPrefix() override;
 
 	uint32_t Decrypt(const uint8_t* input, uint8_t* output, size_t size, const uint32_t* key) override;
 	void Encrypt(const uint8_t* input, uint8_t* output, size_t size, const uint32_t* key) override;
@@ -11,12 +11,15 @@
 #define ETERPACK_HPP
 #pragma once
 
-#include <LibLyketo/IFIleSystem.hpp>
+#include <LibLyketo/IFileSystem.hpp>
+#include <LibLyketo/CryptedObject.hpp>
 
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
 #include <memory>
+#include <thread>
 
 #ifdef DecryptFile
 #undef DecryptFile
@@ -25,7 +28,13 @@
 #undef EncryptFile
 #endif
 
-struct EterPackFile
+//! Index version with 64 bit sizes and positions, see @ref EterPackFile.
+#define ETERPACK_VERSION_64 3
+
+/*!
+	Index entry of the older index versions, limited to 4 GiB content files.
+*/
+struct EterPackFileV2
 {
 	uint32_t dwId;
 	char szFilename[161];
@@ -38,7 +47,35 @@ struct EterPackFile
 	uint8_t bType;
 	uint8_t bPadding2[3];
 
+	EterPackFileV2();
+};
+
+/*!
+	Index entry, stored as is by the indexes of version @ref ETERPACK_VERSION_64.
+*/
+struct EterPackFile
+{
+	uint32_t dwId;
+	char szFilename[161];
+	uint8_t bPadding1[3];
+	uint32_t dwFilenameCRC32;
+	uint32_t dwCRC32;
+	uint64_t qwRealSize;
+	uint64_t qwSize;
+	uint64_t qwPosition;
+	uint8_t bType;
+	uint8_t bPadding2[7];
+
 	EterPackFile();
+	explicit EterPackFile(const struct EterPackFileV2& sLegacy);
+
+	/*!
+		Converts the entry to the older index format.
+
+		@param sLegacy The converted entry.
+		@return true if the sizes and the position fit in 32 bits, otherwise false.
+	*/
+	bool ToLegacy(struct EterPackFileV2& sLegacy) const;
 };
 
 struct EterPackHeader
@@ -56,6 +93,60 @@ enum EterPackTypes : uint8_t
 	CryptedObject_Lzo1x = 1,
 	CryptedObject_Lzo1x_Xtea = 2,
 	CryptedObject_Snappy = 6,
+	Blocks = 7, //!< Content split in independently encoded blocks, see @ref EterPackBlockHeader.
+};
+
+/*!
+	Header of a block encoded file, followed by the block table (one @ref EterPackBlock for each block) and by the blocks.
+
+	Every block holds dwBlockSize bytes of the content (the last one might be shorter) and is encoded as a standalone
+	file of type bType, so any part of the content can be read by decoding only the blocks that cover it.
+*/
+struct EterPackBlockHeader
+{
+	uint32_t dwFourCC;
+	uint32_t dwBlockSize;
+	uint32_t dwBlocks;
+	uint8_t bType;
+	uint8_t bPadding[3];
+
+	EterPackBlockHeader();
+};
+
+struct EterPackBlock
+{
+	uint32_t dwPosition; //!< Offset of the block from the start of the file.
+	uint32_t dwSize; //!< Encoded size of the block.
+};
+
+/*!
+	Receives the content of a file read with @ref EterPack::GetStream, a chunk at a time.
+
+	@return true to continue reading, false to stop.
+*/
+typedef std::function<bool(const uint8_t* pbData, size_t nLength)> EterPackSink;
+
+/*!
+	Options of @ref EterPack::Save when writing to an IFileSystem.
+*/
+struct EterPackSaveOptions
+{
+	EterPackTypes eType; //!< Uncompressed for a plain index, otherwise the CryptedObject that wraps the index.
+	const uint32_t* adwKeys; //!< Keys of the CryptedObject (optional).
+	uint32_t dwFourcc; //!< Custom CryptedObject FourCC (0 for the default one).
+	uint64_t qwPaddingSeed; //!< Seed of the entries padding, the same seed always gives the same output (0 for a random one).
+
+	EterPackSaveOptions() : eType(Uncompressed), adwKeys(nullptr), dwFourcc(0), qwPaddingSeed(0) {}
+};
+
+/*!
+	How the filename CRC32 of the index entries is validated during @ref EterPack::Load.
+*/
+enum class EterPackValidation
+{
+	Full, //!< Every entry is validated before it's inserted, invalid entries are discarded.
+	Skip, //!< Entries are trusted and inserted without validation.
+	Deferred, //!< Entries are inserted and validated by a background thread, see @ref EterPack::WaitValidation.
 };
 
 class EterPack
@@ -64,35 +155,268 @@ public:
 	EterPack();
 	virtual ~EterPack();
 
+	/*!
+		Copies or moves a pack, after waiting for the deferred validation of the source.
+	*/
+	EterPack(const EterPack& cOther);
+	EterPack(EterPack&& cOther);
+
+	EterPack& operator=(const EterPack& cOther);
+	EterPack& operator=(EterPack&& cOther);
+
+	/*!
+		Loads an index file.
+
+		Indexes of version @ref ETERPACK_VERSION_64 are always accepted, the other ones must match the version
+		set with @ref SetVersion and use the older entry format. The version of the loaded index is kept,
+		so a following @ref Save writes the same format.
+
+		@param pbInput The index file content.
+		@param nLength The length of the index file.
+		@param pcFS The content file.
+		@return true if the index was loaded, otherwise false.
+	*/
 	bool Load(const uint8_t* pbInput, size_t nLength, std::shared_ptr<IFileSystem> pcFS);
+
+	/*!
+		Changes how the next loaded indexes are validated.
+
+		@param eMode The validation mode.
+		@param nThreads Number of workers used to validate the entries, 0 to use every hardware thread.
+	*/
+	void SetValidation(EterPackValidation eMode, size_t nThreads = 0) { m_eValidation = eMode; m_nValidationThreads = nThreads; }
+	EterPackValidation GetValidation() const { return m_eValidation; }
+
+	/*!
+		Waits for the background validation started by a deferred load and removes the invalid entries.
+
+		The index must not be accessed by other threads while this function runs.
+
+		@return true if every entry was valid, otherwise false.
+	*/
+	bool WaitValidation();
+
+	/*!
+		Gets the filename CRC32 of the invalid entries found by the deferred validation.
+		Waits for the background validation, but unlike @ref WaitValidation it does not remove the entries.
+	*/
+	const std::vector<uint32_t>& GetInvalidFiles() const;
+
+	/*!
+		Loads an index file that might be wrapped in a CryptedObject (MCOZ or MCSP).
+
+		The wrapper is detected from the FourCC of the input, the index is decoded in the pack buffer
+		(reused between calls) and then parsed straight from it.
+
+		@param pbInput The index file content.
+		@param nLength The length of the index file.
+		@param pcFS The content file.
+		@param adwKeys Keys of the CryptedObject (optional).
+		@param dwLzo1xFourcc Custom FourCC of a Lzo1x CryptedObject (0 for the default one).
+		@param dwSnappyFourcc Custom FourCC of a Snappy CryptedObject (0 for the default one).
+		@return true if the index was loaded, otherwise false.
+	*/
+	bool LoadIndex(const uint8_t* pbInput, size_t nLength, std::shared_ptr<IFileSystem> pcFS, const uint32_t* adwKeys = nullptr, uint32_t dwLzo1xFourcc = 0, uint32_t dwSnappyFourcc = 0);
 	const EterPackFile* GetInfo(uint32_t dwCRC32);
 	const EterPackFile* GetInfo(std::string szFileName);
 
 	bool Get(EterPackFile sInfo, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
 
+	/*!
+		Reads a part of a file in the pack buffer.
+
+		Only the data needed by the range is read: uncompressed files read the range itself, block encoded files the
+		blocks that cover it and Lzo1x CryptedObjects the beginning of the object, up to the end of the range.
+		Snappy CryptedObjects cannot be decompressed partially and are decoded whole.
+		The CRC32 of the file is not verified, as it covers the whole file.
+
+		@param sInfo The file to read.
+		@param nOffset Offset of the range in the decoded file.
+		@param nLength Length of the range.
+		@param adwKeys Keys of the CryptedObject (optional).
+		@param dwFourcc Custom CryptedObject FourCC (0 for the default one).
+		@return true if the range was read, otherwise false.
+	*/
+	bool GetRange(EterPackFile sInfo, size_t nOffset, size_t nLength, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+
+	/*!
+		Reads a part of a file in a buffer owned by the caller, see @ref GetRange.
+	*/
+	bool GetRange(EterPackFile sInfo, size_t nOffset, size_t nLength, std::vector<uint8_t>& pOutput, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+
+	/*!
+		Reads a file and passes its content to a sink in chunks.
+
+		Uncompressed files use a single chunk buffer and block encoded files decode a few blocks for each worker at once,
+		so the memory used does not depend on the size of the file.
+		CryptedObjects cannot be decoded partially, they are decoded whole only up to the block threshold
+		(see @ref SetBlockThreshold) and the read fails for larger ones, use @ref Get for them.
+		With @ref SetVerifyOnRead the CRC32 is checked while reading, so a corrupted file is only detected at the end.
+
+		@param sInfo The file to read.
+		@param fnSink The function that receives the content.
+		@param nChunkSize The maximum length of a chunk, 0 for the default one (64 KiB).
+		@param adwKeys Keys of the CryptedObject (optional).
+		@param dwFourcc Custom CryptedObject FourCC (0 for the default one).
+		@return true if the whole file was read and accepted by the sink, otherwise false.
+	*/
+	bool GetStream(EterPackFile sInfo, const EterPackSink& fnSink, size_t nChunkSize = 0, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+
+	/*!
+		Changes the number of workers used to decode and encode the blocks of a file.
+
+		@param nThreads Number of workers, 0 to use every hardware thread.
+	*/
+	void SetBlockThreads(size_t nThreads) { m_nBlockThreads = nThreads; }
+
+	/*!
+		Verifies the CRC32 of every file read with @ref Get before decoding it.
+
+		Disabled by default, the hot path can leave it off and use an EterPackScrubber instead.
+	*/
+	void SetVerifyOnRead(bool bVerify) { m_bVerifyOnRead = bVerify; }
+	bool GetVerifyOnRead() const { return m_bVerifyOnRead; }
+
 	bool Create(std::shared_ptr<IFileSystem> pcFSm);
+	/*!
+		Puts a file.
+
+		CryptedObjects larger than the block threshold are stored as block encoded files (see @ref PutBlocks)
+		with blocks of the requested type, so they can be read with bounded memory.
+
+		@param szFile The name of the file.
+		@param pbContent The content of the file.
+		@param dwContentLen The length of the content.
+		@param eType The type of the file.
+		@param adwKeys Keys of the CryptedObject (optional).
+		@param dwFourcc Custom CryptedObject FourCC (0 for the default one).
+		@return true if the file was written, otherwise false.
+	*/
 	bool Put(std::string szFile, const uint8_t* pbContent, uint32_t dwContentLen, EterPackTypes eType, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+
+	/*!
+		Changes the size above which @ref Put stores CryptedObjects as block encoded files, and @ref GetStream
+		refuses to decode a CryptedObject whole.
+
+		Clients that do not support block encoded files need 0, which disables both limits.
+
+		@param nThreshold Decoded size in bytes, the default is 16 MiB.
+	*/
+	void SetBlockThreshold(size_t nThreshold) { m_nBlockThreshold = nThreshold; }
+	size_t GetBlockThreshold() const { return m_nBlockThreshold; }
+
+	/*!
+		Puts a block encoded file.
+
+		@param szFile The name of the file.
+		@param pbContent The content of the file.
+		@param dwContentLen The length of the content.
+		@param eBlockType The type of every block (it cannot be Blocks).
+		@param dwBlockSize The decoded size of a block, 0 for the default one (64 KiB).
+		@param adwKeys Keys of the CryptedObject (optional).
+		@param dwFourcc Custom CryptedObject FourCC (0 for the default one).
+		@return true if the file was written, otherwise false.
+	*/
+	bool PutBlocks(std::string szFile, const uint8_t* pbContent, uint32_t dwContentLen, EterPackTypes eBlockType, uint32_t dwBlockSize = 0, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+	/*!
+		Writes the index in the pack buffer.
+
+		The index is written with 64 bit entries when the version is @ref ETERPACK_VERSION_64, otherwise it fails
+		if a file does not fit in the older format.
+
+		@return true if the index was written, otherwise false.
+	*/
 	bool Save();
 
+	/*!
+		Writes the index straight to a file, in large batches of entries.
+
+		Like @ref Save, it fails if a file does not fit in the older format, in that case nothing is written.
+
+		@param pcFS The index file.
+		@param sOptions How the index is encoded.
+		@return true if the index was written, otherwise false.
+	*/
+	bool Save(std::shared_ptr<IFileSystem> pcFS, const EterPackSaveOptions& sOptions = EterPackSaveOptions());
+
 	const uint8_t* GetBuffer() const { return m_pBuffer.data(); }
 	size_t GetBufferSize() const { return m_pBuffer.size(); }
 
 	EterPackHeader GetHeader() const { return m_sHeader; }
 
-	void SetVersion(uint32_t dwVersion) { m_sHeader.dwVersion = dwVersion; }
+	bool IsIndexCrypted() const { return m_bIndexCrypted; }
+	CryptedObjectErrors GetIndexError() const { return m_eIndexError; }
+	CryptedObjectHeader GetIndexObjectHeader() const { return m_cIndexObject.GetHeader(); }
+
+	void SetVersion(uint32_t dwVersion) { m_sHeader.dwVersion = dwVersion; m_dwVersion = dwVersion; }
 	void SetFourCC(uint32_t dwFcc) { m_sHeader.dwFourCC = dwFcc; }
 
-	std::map<uint32_t, struct EterPackFile> GetFiles() const { return m_mFiles; }
+	const std::map<uint32_t, struct EterPackFile>& GetFiles() const { return m_mFiles; }
+
+	/*!
+		Computes the index key of a filename (CRC32 of the lowercase name).
+
+		@param szFileName The filename to hash.
+		@return The CRC32 used as key for @ref GetInfo.
+	*/
+	static uint32_t HashFilename(const std::string& szFileName);
+
+	/*!
+		Creates the CryptedObject algorithm used by a file type.
+
+		@param eType The type of the file.
+		@param dwFourcc Custom CryptedObject FourCC (0 for the default one).
+		@return The algorithm, or nullptr if the type is not a CryptedObject.
+	*/
+	static std::shared_ptr<CryptedObjectAlgorithm> CreateAlgorithm(EterPackTypes eType, uint32_t dwFourcc = 0);
+
+	/*!
+		Parses the block table of a block encoded file.
+
+		@param pbInput The encoded file.
+		@param nLength The length of the encoded file.
+		@param qwRealSize The decoded size of the file.
+		@param pHeader Receives the header of the file.
+		@return The block table (inside pbInput), or nullptr if the table is not valid.
+	*/
+	static const struct EterPackBlock* ParseBlockTable(const uint8_t* pbInput, size_t nLength, uint64_t qwRealSize, struct EterPackBlockHeader* pHeader);
 
 protected:
-	bool DecryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t* pOutput, uint32_t dwOutputLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc);
-	bool EncryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t* pOutput, uint32_t* dwOutputLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc);
+	bool DecryptFile(const uint8_t* pbInput, size_t nInputLen, uint8_t* pOutput, size_t nOutputLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc);
+	bool EncryptFile(const uint8_t* pbInput, uint32_t dwInputLen, std::vector<uint8_t>& pOutput, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc);
+
+	bool GetBlocksStream(const EterPackFile& sInfo, const EterPackSink& fnSink, size_t nChunkSize, const uint32_t* adwKeys, uint32_t dwFourcc);
+	bool ReadBlockTable(const EterPackFile& sInfo, std::vector<uint8_t>& cTable, EterPackBlockHeader* pHeader, const EterPackBlock** ppTable);
+	bool GetBlocksRange(const EterPackFile& sInfo, size_t nOffset, size_t nLength, std::vector<uint8_t>& pOutput, const uint32_t* adwKeys, uint32_t dwFourcc);
+	bool DecryptBlocks(const uint8_t* pbInput, size_t nInputBase, const EterPackBlockHeader& sHeader, const EterPackBlock* pTable, uint32_t dwFirst, uint32_t dwLast, uint8_t* pOutput, size_t nRealSize, const uint32_t* adwKeys, uint32_t dwFourcc);
+	bool WriteFile(const std::string& szFile, const FileSystemConstBuffer* pBuffers, size_t nCount, size_t nContentLen, EterPackTypes eType);
+
+	bool WriteIndex(uint64_t qwSeed, const EterPackSink& fnSink);
+
+	template <typename T>
+	void LoadEntries(const T* pEntries);
+
+	void JoinValidation() const;
 
 	std::shared_ptr<IFileSystem> m_pcFS;
 	std::map<uint32_t, struct EterPackFile> m_mFiles;
 	struct EterPackHeader m_sHeader;
+	uint32_t m_dwVersion; //!< Version of the older indexes accepted by Load.
 
 	std::vector<uint8_t> m_pBuffer;
+
+	CryptedObject m_cIndexObject;
+	CryptedObjectErrors m_eIndexError;
+	bool m_bIndexCrypted;
+
+	EterPackValidation m_eValidation;
+	size_t m_nValidationThreads;
+	mutable std::thread m_cValidationThread; //!< Reads only the index, so const copies can wait for it.
+	std::vector<uint32_t> m_vInvalidFiles;
+
+	bool m_bVerifyOnRead;
+	size_t m_nBlockThreads;
+	size_t m_nBlockThreshold;
 };
 
 #endif // ETERPACK_HPP
@@ -0,0 +1,142 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file EterPackIndexCache.hpp
+	Defines a precompiled cache of many EterPack indexes.
+*/
+#ifndef ETERPACKINDEXCACHE_HPP
+#define ETERPACKINDEXCACHE_HPP
+#pragma once
+
+#include <LibLyketo/EterPack.hpp>
+
+/*!
+	Identifies a version of an EterPack index file.
+
+	A cached index is reused only when the stamp of the file on disk is the same as the stored one.
+*/
+struct EterPackCacheStamp
+{
+	uint64_t qwSize;
+	uint64_t qwModifiedTime; //!< With the full resolution of the platform: nanoseconds, or FILETIME units on Windows.
+	uint32_t dwHash;
+	uint32_t dwReserved;
+
+	EterPackCacheStamp();
+
+	bool operator==(const EterPackCacheStamp& sOther) const;
+	bool operator!=(const EterPackCacheStamp& sOther) const { return !(*this == sOther); }
+};
+
+/*!
+	Layout of an index cache file, every offset is relative to the start of the file so the cache
+	can be used straight from a memory mapping.
+
+		- Header
+		- Pack table (dwPacks elements)
+		- Validated index entries of every pack (dwEntries elements)
+*/
+struct EterPackCacheHeader
+{
+	uint32_t dwFourCC;
+	uint32_t dwVersion;
+	uint32_t dwPacks;
+	uint32_t dwEntries;
+	uint32_t dwCRC32;
+	uint32_t dwReserved;
+
+	EterPackCacheHeader();
+};
+
+struct EterPackCachePack
+{
+	char szName[256];
+	struct EterPackCacheStamp sStamp;
+	uint32_t dwFirst;
+	uint32_t dwCount;
+
+	EterPackCachePack();
+};
+
+/*!
+	A binary cache of the decrypted and validated indexes of a set of EterPacks.
+
+	Loading an EterPack index means decrypting, decompressing and validating every entry; the cache stores the result
+	so that a warm startup only has to map the cache file and mount the cached entries (see PackMount).
+	Packs are stored separately, so when a pack changes only that pack has to be loaded again.
+*/
+class EterPackIndexCache
+{
+public:
+	EterPackIndexCache();
+	virtual ~EterPackIndexCache();
+
+	/*!
+		Attaches to a cache buffer, usually a MappedFile.
+
+		The buffer is not copied, it must stay valid as long as the cache or the entries returned by @ref Find are used.
+
+		@param pbInput The cache content.
+		@param nLength The length of the cache.
+		@param bVerify Verify the checksum of the whole cache.
+		@return true if the cache is valid, otherwise false.
+	*/
+	bool Load(const uint8_t* pbInput, size_t nLength, bool bVerify = true);
+
+	/*!
+		Finds the cached index of a pack.
+
+		@param szName Name of the pack.
+		@param sStamp Current stamp of the pack index file.
+		@param pdwCount The number of entries returned.
+		@return The cached entries, or nullptr if the pack is not cached or it has changed.
+	*/
+	const EterPackFile* Find(const std::string& szName, const EterPackCacheStamp& sStamp, uint32_t* pdwCount) const;
+
+	void Clear();
+
+	/*!
+		Adds a pack to the cache that will be written with @ref Save.
+
+		@param szName Name of the pack (up to 255 characters).
+		@param sStamp Current stamp of the pack index file.
+		@param cPack The loaded pack.
+		@return true if the pack was added, otherwise false.
+	*/
+	bool Add(const std::string& szName, const EterPackCacheStamp& sStamp, const EterPack& cPack);
+	bool Add(const std::string& szName, const EterPackCacheStamp& sStamp, const EterPackFile* pEntries, uint32_t dwCount);
+
+	bool Save();
+
+	const uint8_t* GetBuffer() const { return m_pBuffer.data(); }
+	size_t GetBufferSize() const { return m_pBuffer.size(); }
+
+	uint32_t GetPackCount() const { return m_pHeader ? m_pHeader->dwPacks : 0; }
+
+	/*!
+		Creates the stamp of an index file.
+
+		@param szFilename The index file.
+		@param sStamp The resulted stamp.
+		@param bHashContent Also hash the file content, slower but it does not rely on the modification time.
+		@return true if the file exists, otherwise false.
+	*/
+	static bool MakeStamp(const std::string& szFilename, EterPackCacheStamp& sStamp, bool bHashContent = false);
+
+private:
+	struct PendingPack
+	{
+		struct EterPackCachePack sPack;
+		std::vector<struct EterPackFile> vEntries;
+	};
+
+	const struct EterPackCacheHeader* m_pHeader;
+	const struct EterPackCachePack* m_pPacks;
+	const struct EterPackFile* m_pEntries;
+
+	std::vector<PendingPack> m_vPending;
+	std::vector<uint8_t> m_pBuffer;
+};
+
+#endif // ETERPACKINDEXCACHE_HPP
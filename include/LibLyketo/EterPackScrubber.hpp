@@ -0,0 +1,97 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file EterPackScrubber.hpp
+	Defines a background integrity checker of EterPack content files.
+*/
+#ifndef ETERPACKSCRUBBER_HPP
+#define ETERPACKSCRUBBER_HPP
+#pragma once
+
+#include <LibLyketo/EterPack.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+enum class EterPackScrubErrors
+{
+	ReadFail,
+	InvalidCRC32,
+	InvalidSize,
+	InvalidHeader,
+};
+
+/*!
+	Called by the scrubber thread for every corrupted file.
+*/
+typedef std::function<void(const EterPackFile& sInfo, EterPackScrubErrors eError)> EterPackScrubCallback;
+
+/*!
+	Walks a whole EterPack in a low priority thread, checking the CRC32 and the CryptedObject header of every file
+	(of every block for block encoded files).
+
+	The scrubber reads the content file sequentially through its own IFileSystem, so it never interferes with
+	the file position used by @ref EterPack::Get. Adjacent files are read together with @ref IFileSystem::ReadV.
+*/
+class EterPackScrubber
+{
+public:
+	EterPackScrubber();
+	virtual ~EterPackScrubber();
+
+	/*!
+		Starts scrubbing a pack.
+
+		@param cPack The pack to scrub, its index is copied so the pack can be used or destroyed while scrubbing.
+		@param pcFS A dedicated handle to the content file of the pack.
+		@param fnCallback The function called for every corrupted file.
+		@param dwFourcc Custom CryptedObject FourCC of the pack content (0 for the default one).
+		@param nBytesPerSecond Maximum read throughput, 0 for no limit.
+		@return true if the scrubber was started, otherwise false.
+	*/
+	bool Start(const EterPack& cPack, std::shared_ptr<IFileSystem> pcFS, EterPackScrubCallback fnCallback, uint32_t dwFourcc = 0, size_t nBytesPerSecond = 0);
+
+	/*!
+		Stops the scrubber, without waiting for the pack to be completed.
+	*/
+	void Stop();
+
+	/*!
+		Waits for the scrubber to complete.
+
+		@return true if no corrupted file was found, otherwise false.
+	*/
+	bool Wait();
+
+	bool IsRunning() const { return m_bRunning; }
+	uint64_t GetCheckedFiles() const { return m_qwChecked; }
+	uint64_t GetCorruptedFiles() const { return m_qwCorrupted; }
+
+private:
+	void Run();
+	bool ReadBatch(size_t nFirst, size_t nCount, std::vector<std::vector<uint8_t>>& vData);
+	bool Check(const EterPackFile& sInfo, std::vector<uint8_t>& cData, EterPackScrubErrors* peError);
+	bool CheckBlocks(const EterPackFile& sInfo, std::vector<uint8_t>& cData, EterPackScrubErrors* peError);
+	void Report(const EterPackFile& sInfo, EterPackScrubErrors eError);
+	bool Throttle(size_t nBytes);
+
+	std::vector<struct EterPackFile> m_vFiles;
+	std::shared_ptr<IFileSystem> m_pcFS;
+	EterPackScrubCallback m_fnCallback;
+	uint32_t m_dwFourCC;
+	size_t m_nBytesPerSecond;
+
+	std::thread m_cThread;
+	std::mutex m_mStop;
+	std::condition_variable m_cvStop;
+	bool m_bStop;
+
+	std::atomic<bool> m_bRunning;
+	std::atomic<uint64_t> m_qwChecked;
+	std::atomic<uint64_t> m_qwCorrupted;
+};
+
+#endif // ETERPACKSCRUBBER_HPP
@@ -0,0 +1,111 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file FormatSniffer.hpp
+	Defines a detector of the format, algorithm and key of a file from its first bytes.
+*/
+#ifndef FORMATSNIFFER_HPP
+#define FORMATSNIFFER_HPP
+#pragma once
+
+#include <LibLyketo/CryptedObject.hpp>
+
+#include <vector>
+#include <memory>
+
+enum class SniffedFormat
+{
+	Unknown,
+	ItemProto,
+	ItemProto_Old,
+	MobProto,
+	EterPackIndex, //!< A plain EterPack index, or a CryptedObject whose key is tagged as an index key.
+	CryptedObject,
+};
+
+/*!
+	What was found in the first bytes of a file.
+*/
+struct FormatSnifferResult
+{
+	SniffedFormat eFormat;
+
+	uint32_t dwFourCC; //!< The first FourCC of the file.
+	uint32_t dwVersion; //!< Proto version, only for the MIPX FourCC.
+	uint32_t dwStride; //!< Proto record size, only for the MIPX FourCC.
+	uint32_t dwElements; //!< Proto records.
+
+	bool bHaveObject; //!< The file contains a CryptedObject.
+	size_t nObjectOffset; //!< Offset of the CryptedObject in the file.
+	struct CryptedObjectHeader sObjectHeader;
+	uint32_t dwAlgorithmFourCC; //!< FourCC of the algorithm of the CryptedObject.
+
+	bool bEncrypted;
+	int nKey; //!< Index of the candidate key that decrypts the first block, -1 when no key matched or the object is not encrypted.
+
+	FormatSnifferResult();
+};
+
+/*!
+	Identifies protos, EterPack indexes and CryptedObjects by looking only at their first bytes.
+
+	The FourCCs are compared with the configured ones. When the CryptedObject is encrypted,
+	only its first XTEA block is decrypted with every candidate key: the right key is the one that
+	reveals the FourCC of the algorithm, which prefixes the compressed data.
+	A wrong guess costs a single block, so many unknown files can be sniffed before decoding any of them.
+*/
+class FormatSniffer
+{
+public:
+	FormatSniffer();
+	virtual ~FormatSniffer();
+
+	/*!
+		Changes the FourCCs to look for, 0 keeps the default one.
+	*/
+	void SetFourCCs(uint32_t dwItem, uint32_t dwItemOld, uint32_t dwMob, uint32_t dwEterPack, uint32_t dwLzo1x, uint32_t dwSnappy);
+
+	/*!
+		Adds a candidate key, keys are tried in the order they were added.
+
+		@param adwKeys The 16 byte key.
+		@param eFormat The format a bare CryptedObject has when this key decrypts it, CryptedObject when the key is not tied to a format.
+		@return The index of the key, reported by @ref Sniff.
+	*/
+	int AddKey(const uint32_t* adwKeys, SniffedFormat eFormat = SniffedFormat::CryptedObject);
+	void ClearKeys();
+
+	/*!
+		Identifies a file.
+
+		@param pbInput The beginning of the file, @ref GetWantedLength bytes are always enough.
+		@param nLength The number of available bytes.
+		@param sResult Receives what was found.
+		@return true if the format was identified, otherwise false.
+	*/
+	bool Sniff(const uint8_t* pbInput, size_t nLength, FormatSnifferResult& sResult) const;
+
+	/*!
+		Gets the number of bytes that have to be read from the beginning of a file to sniff it.
+	*/
+	static size_t GetWantedLength();
+
+private:
+	bool SniffObject(const uint8_t* pbInput, size_t nLength, FormatSnifferResult& sResult) const;
+
+	struct FormatSnifferKey
+	{
+		uint32_t adwKeys[4];
+		SniffedFormat eFormat;
+	};
+
+	std::vector<struct FormatSnifferKey> m_vKeys;
+
+	uint32_t m_dwFccItemProto, m_dwFccItemProtoOld, m_dwFccMobProto, m_dwFccEterPack;
+
+	std::shared_ptr<CryptedObjectAlgorithm> m_pLzo1x;
+	std::shared_ptr<CryptedObjectAlgorithm> m_pSnappy;
+};
+
+#endif // FORMATSNIFFER_HPP
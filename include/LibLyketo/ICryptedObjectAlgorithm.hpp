@@ -61,6 +61,13 @@ public:
 
 	virtual bool HaveCryptation() = 0 { return false; }
 
+	/*!
+		Checks if @ref Decompress can decode the beginning of a truncated input and stop once the output is full.
+
+		When true, Decompress must store the number of produced bytes in pdwOutputLength even when it fails.
+	*/
+	virtual bool CanDecompressPrefix() { return false; }
+
 	void ChangeFourCC(uint32_t dwFourCC) { m_dwFourCC = dwFourCC; }
 	uint32_t GetFourCC() { return m_dwFourCC; }
 
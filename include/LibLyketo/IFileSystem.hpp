@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 enum class SeekOffset
 {
@@ -14,16 +15,104 @@ enum class SeekOffset
 	Current,
 };
 
+/*!
+	A buffer filled by @ref IFileSystem::ReadV.
+*/
+struct FileSystemBuffer
+{
+	uint8_t* pbData;
+	size_t nLength;
+};
+
+/*!
+	A buffer written by @ref IFileSystem::WriteV.
+*/
+struct FileSystemConstBuffer
+{
+	const uint8_t* pbData;
+	size_t nLength;
+};
+
 class IFileSystem
 {
 public:
 	IFileSystem() {}
 	virtual ~IFileSystem() {}
 
-	virtual bool Seek(size_t nLength, SeekOffset eOffset) { return false; }
+	virtual bool Seek(uint64_t nLength, SeekOffset eOffset) { return false; }
 	virtual bool Read(uint8_t* pbOut, size_t nLength) { return false; }
 	virtual bool Write(const uint8_t* pbData, size_t nLength) { return false; }
-	virtual long Tell() { return 0; }
+	virtual int64_t Tell() { return 0; }
+
+	/*!
+		Reads many consecutive ranges of the file, starting from the current position.
+		The default implementation calls Read for every buffer, filesystems that support scatter reads should override it.
+
+		@param pBuffers The buffers to fill, in file order.
+		@param nCount Number of buffers.
+		@return true if every buffer was filled, otherwise false.
+	*/
+	virtual bool ReadV(const FileSystemBuffer* pBuffers, size_t nCount)
+	{
+		for (size_t i = 0; i < nCount; i++)
+		{
+			if (pBuffers[i].nLength > 0 && !Read(pBuffers[i].pbData, pBuffers[i].nLength))
+				return false;
+		}
+
+		return true;
+	}
+
+	/*!
+		Writes many buffers one after the other, starting from the current position.
+		The default implementation calls Write for every buffer, filesystems that support gather writes should override it.
+
+		@param pBuffers The buffers to write.
+		@param nCount Number of buffers.
+		@return true if every buffer was written, otherwise false.
+	*/
+	virtual bool WriteV(const FileSystemConstBuffer* pBuffers, size_t nCount)
+	{
+		for (size_t i = 0; i < nCount; i++)
+		{
+			if (pBuffers[i].nLength > 0 && !Write(pBuffers[i].pbData, pBuffers[i].nLength))
+				return false;
+		}
+
+		return true;
+	}
+
+	/*!
+		Gets the size of the file.
+		The default implementation seeks to the end of the file and back.
+
+		@return The size of the file, or -1 if it is not known.
+	*/
+	virtual int64_t Size()
+	{
+		int64_t nPosition = Tell();
+
+		if (nPosition < 0 || !Seek(0, SeekOffset::End))
+			return -1;
+
+		int64_t nSize = Tell();
+
+		if (!Seek(static_cast<uint64_t>(nPosition), SeekOffset::Start))
+			return -1;
+
+		return nSize;
+	}
+
+	/*!
+		Hands the data buffered by the filesystem to the operating system.
+		After a flush every written byte is visible to other readers of the file.
+	*/
+	virtual bool Flush() { return true; }
+
+	/*!
+		Flushes the filesystem and waits for the data to reach the disk.
+	*/
+	virtual bool Sync() { return Flush(); }
 };
 
 #endif // IFILESYSTEM_HPP
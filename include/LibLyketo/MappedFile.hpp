@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file MappedFile.hpp
+	Defines a read-only memory mapped file.
+*/
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*!
+	A read-only view of a whole file mapped in memory.
+
+	The mapping is shared, so many processes that map the same file share the same physical pages.
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+	virtual ~MappedFile();
+
+	/*!
+		Maps a file in memory.
+
+		@param szFilename The file to map.
+		@return true if the file was mapped, otherwise false.
+	*/
+	bool Open(std::string szFilename);
+	void Close();
+
+	const uint8_t* GetBuffer() const { return m_pbData; }
+	size_t GetSize() const { return m_nSize; }
+	bool IsOpen() const { return m_pbData != nullptr; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+#ifdef _WIN32
+	void* m_hFile;
+	void* m_hMapping;
+#else
+	int m_nFile;
+#endif
+
+	const uint8_t* m_pbData;
+	size_t m_nSize;
+};
+
+#endif // MAPPEDFILE_HPP
@@ -0,0 +1,63 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file MemoryFileSystem.hpp
+	Defines an IFileSystem stored in memory.
+*/
+#ifndef MEMORYFILESYSTEM_HPP
+#define MEMORYFILESYSTEM_HPP
+#pragma once
+
+#include <LibLyketo/IFileSystem.hpp>
+
+#include <vector>
+
+/*!
+	An IFileSystem over a contiguous block of memory.
+
+	By default the file is empty and grows on write, so packs can be built, loaded and read without touching the disk.
+	@ref Open turns it into a read-only view over an external buffer (like a pack embedded in the executable),
+	the buffer is not copied and must outlive the filesystem.
+*/
+class MemoryFileSystem : public IFileSystem
+{
+public:
+	MemoryFileSystem();
+	virtual ~MemoryFileSystem();
+
+	/*!
+		Resets the filesystem to an empty, growable file.
+
+		@param nReserve Bytes to allocate up front.
+	*/
+	void Create(size_t nReserve = 0);
+
+	/*!
+		Opens a read-only view over an external buffer.
+
+		@param pbData The file content.
+		@param nLength Length of the content.
+		@return true if the view was opened, otherwise false.
+	*/
+	bool Open(const uint8_t* pbData, size_t nLength);
+
+	bool Seek(uint64_t nLength, SeekOffset eOffset) override;
+	bool Read(uint8_t* pbOut, size_t nLength) override;
+	bool Write(const uint8_t* pbData, size_t nLength) override;
+	int64_t Tell() override;
+	bool WriteV(const FileSystemConstBuffer* pBuffers, size_t nCount) override;
+	int64_t Size() override;
+
+	const uint8_t* GetBuffer() const { return m_pbView ? m_pbView : m_pBuffer.data(); }
+	size_t GetBufferSize() const { return m_pbView ? m_nViewSize : m_pBuffer.size(); }
+	bool IsReadOnly() const { return m_pbView != nullptr; }
+
+private:
+	std::vector<uint8_t> m_pBuffer;
+	const uint8_t* m_pbView;
+	size_t m_nViewSize;
+	size_t m_nPosition;
+};
+
+#endif // MEMORYFILESYSTEM_HPP
@@ -0,0 +1,133 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file PackMount.hpp
+	Defines a virtual filesystem that serves many EterPacks from a single index.
+*/
+#ifndef PACKMOUNT_HPP
+#define PACKMOUNT_HPP
+#pragma once
+
+#include <LibLyketo/EterPack.hpp>
+
+#include <unordered_map>
+
+/*!
+	A file visible through a PackMount.
+
+	The file information is copied from the pack index so a lookup never has to touch the pack itself.
+*/
+struct PackMountEntry
+{
+	struct EterPackFile sInfo;
+	uint32_t dwSource;
+	int32_t nPriority;
+
+	PackMountEntry();
+};
+
+/*!
+	A pack mounted inside a PackMount, with the keys used to decrypt its content.
+
+	When pEntries is set, the files come from an external index (like EterPackIndexCache) instead of the pack.
+	They are copied in the mount table and read again only when the table is rebuilt.
+*/
+struct PackMountSource
+{
+	std::shared_ptr<EterPack> pcPack;
+	const struct EterPackFile* pEntries;
+	uint32_t dwEntries;
+	int32_t nPriority;
+	uint32_t adwKeys[4];
+	bool bHaveKeys;
+	uint32_t dwFourCC;
+
+	PackMountSource();
+};
+
+/*!
+	A virtual filesystem over many loaded EterPacks.
+
+	Every mounted index is merged into one hash table keyed by the filename CRC32, so a lookup costs
+	a single probe regardless of how many packs are mounted.
+	When two packs contain the same file, the one with the highest priority wins; on equal priority the last mounted pack wins,
+	which allows patch packs to override base packs.
+*/
+class PackMount
+{
+public:
+	PackMount();
+	virtual ~PackMount();
+
+	/*!
+		Mounts a loaded EterPack.
+
+		@param pcPack The pack to mount, its index must be already loaded.
+		@param nPriority Overlay priority of the pack, higher values override lower ones.
+		@param adwKeys Keys used to decrypt the content of the pack (optional).
+		@param dwFourcc Custom CryptedObject FourCC of the pack content (0 for the default one).
+		@return true if the pack was mounted, otherwise false.
+	*/
+	bool Mount(std::shared_ptr<EterPack> pcPack, int32_t nPriority = 0, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+
+	/*!
+		Mounts a pack using an already validated index, like the one stored in an EterPackIndexCache.
+
+		The entries are copied in the mount table, but the table is rebuilt from them when another pack is unmounted,
+		so they must stay valid until this pack is unmounted.
+
+		@param pcPack The pack that owns the content file, its index does not need to be loaded.
+		@param pEntries The index entries of the pack.
+		@param dwCount The number of entries.
+		@param nPriority Overlay priority of the pack, higher values override lower ones.
+		@param adwKeys Keys used to decrypt the content of the pack (optional).
+		@param dwFourcc Custom CryptedObject FourCC of the pack content (0 for the default one).
+		@return true if the pack was mounted, otherwise false.
+	*/
+	bool Mount(std::shared_ptr<EterPack> pcPack, const EterPackFile* pEntries, uint32_t dwCount, int32_t nPriority = 0, const uint32_t* adwKeys = nullptr, uint32_t dwFourcc = 0);
+
+	/*!
+		Unmounts a pack, files overridden by it become visible again.
+
+		@param pcPack The pack to unmount.
+		@return true if the pack was mounted, otherwise false.
+	*/
+	bool Unmount(std::shared_ptr<EterPack> pcPack);
+
+	void Clear();
+
+	const PackMountEntry* GetEntry(uint32_t dwCRC32) const;
+	const EterPackFile* GetInfo(uint32_t dwCRC32) const;
+	const EterPackFile* GetInfo(std::string szFileName) const;
+
+	/*!
+		Reads a file from the pack that owns it.
+
+		The content is decoded in the buffer of the owning pack and is valid until the next read on that pack.
+
+		@param szFileName The file to open.
+		@return true if the file was found and decoded, otherwise false.
+	*/
+	bool Open(std::string szFileName);
+	bool Open(uint32_t dwCRC32);
+
+	const uint8_t* GetBuffer() const;
+	size_t GetBufferSize() const;
+
+	size_t GetPackCount() const { return m_vSources.size(); }
+	size_t GetFileCount() const { return m_mFiles.size(); }
+
+	const std::unordered_map<uint32_t, struct PackMountEntry>& GetFiles() const { return m_mFiles; }
+
+protected:
+	void Insert(uint32_t dwSource);
+	void Insert(uint32_t dwSource, const EterPackFile& sInfo);
+
+	std::vector<struct PackMountSource> m_vSources;
+	std::unordered_map<uint32_t, struct PackMountEntry> m_mFiles;
+
+	std::shared_ptr<EterPack> m_pcLast;
+};
+
+#endif // PACKMOUNT_HPP
@@ -12,6 +12,9 @@
 #pragma once
 
 #include "CryptedObject.hpp"
+#include "IFileSystem.hpp"
+
+#include <memory>
 
 enum class ProtoType
 {
@@ -31,34 +34,61 @@ public:
 
 	bool Unpack(const uint8_t* pbInput, size_t nLength);
 
+	/*!
+		Unpacks a proto without copying its CryptedObject.
+		GetBuffer points inside the input, which must outlive the proto (or the next Unpack).
+
+		@param pbInput The proto file (for example a memory mapped file).
+		@param nLength The length of the proto file.
+		@return true if the proto was unpacked, otherwise false.
+	*/
+	bool UnpackView(const uint8_t* pbInput, size_t nLength);
+
 	bool Create(ProtoType eType, uint32_t dwElements);
 	bool Pack(const uint8_t* pCryptBuffer, size_t nLength, ProtoType eType, EncryptType sType = EncryptType::CompressAndEncrypt);
 
+	/*!
+		Writes a proto file straight to a file, without copying the CryptedObject next to the header.
+
+		@param pCryptBuffer The CryptedObject of the proto.
+		@param nLength The length of the CryptedObject.
+		@param eType The proto type.
+		@param pcFS The output file.
+		@return true if the proto was written, otherwise false.
+	*/
+	bool Pack(const uint8_t* pCryptBuffer, size_t nLength, ProtoType eType, std::shared_ptr<IFileSystem> pcFS);
+
 	const uint8_t* GetBuffer() const;
 	size_t GetSize() const;
+	bool IsBorrowed() const { return m_pbView != nullptr; }
 	ProtoType GetType() const { return m_eType; }
 
-	uint32_t GetMobFourCC() { return m_dwFccMobProto; }
-	uint32_t GetItemFourCC() { return m_dwFccItemProto; }
-	uint32_t GetItemOldFourCC() { return m_dwFccItemProtoOld; }
-	uint32_t GetStride() { return m_dwStride; }
-	uint32_t GetVersion() { return m_dwVersion; }
-	uint32_t GetElements() { return m_dwElements; }
-	uint32_t GetCryptedObjectFourCC() { return m_dwCryptedObjectFourCC; }
-	uint32_t GetCryptedObjectSize() { return m_dwCryptedObjectSize; }
+	uint32_t GetMobFourCC() const { return m_dwFccMobProto; }
+	uint32_t GetItemFourCC() const { return m_dwFccItemProto; }
+	uint32_t GetItemOldFourCC() const { return m_dwFccItemProtoOld; }
+	uint32_t GetStride() const { return m_dwStride; }
+	uint32_t GetVersion() const { return m_dwVersion; }
+	uint32_t GetElements() const { return m_dwElements; }
+	uint32_t GetCryptedObjectFourCC() const { return m_dwCryptedObjectFourCC; }
+	uint32_t GetCryptedObjectSize() const { return m_dwCryptedObjectSize; }
 
 	void SetVersion(uint32_t dwVersion) { m_dwVersion = dwVersion; }
+	void SetStride(uint32_t dwStride) { m_dwStride = dwStride; }
 	void SetMobFourCC(uint32_t dwFcc) { m_dwFccMobProto = dwFcc; }
 	void SetItemOldFourCC(uint32_t dwFcc) { m_dwFccItemProtoOld = dwFcc; }
 	void SetItemFourCC(uint32_t dwFcc) { m_dwFccItemProto = dwFcc; }
 
 private:
+	bool ParseHeader(const uint8_t* pbInput, size_t nLength, size_t* pnHeaderSize);
+	size_t MakeHeader(ProtoType eType, uint8_t* pbHeader, size_t nLength) const;
+
 	uint32_t m_dwVersion, m_dwElements, m_dwCryptedObjectSize, m_dwCryptedObjectFourCC, m_dwStride;
 	uint32_t m_dwFccItemProto, m_dwFccMobProto, m_dwFccItemProtoOld;
 
 	ProtoType m_eType;
 
 	std::vector<uint8_t> m_pBuffer;
+	const uint8_t* m_pbView;
 };
 
 #endif // PROTO_HPP
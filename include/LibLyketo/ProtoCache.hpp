@@ -0,0 +1,129 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoCache.hpp
+	Defines a precompiled cache of a decoded and indexed proto.
+*/
+#ifndef PROTOCACHE_HPP
+#define PROTOCACHE_HPP
+#pragma once
+
+#include <LibLyketo/ProtoIndex.hpp>
+#include <LibLyketo/EterPackIndexCache.hpp>
+#include <LibLyketo/IFileSystem.hpp>
+
+#include <memory>
+
+/*!
+	Layout of a proto cache file, every offset is relative to the start of the file so the cache
+	can be used straight from a memory mapping. Sections start at a multiple of 64 bytes.
+
+		- Header
+		- Decoded records (dwElements * dwStride bytes)
+		- Hash table of the vnum index, vnums then record indexes (dwSlots elements each)
+		- Sorted vnums, their record indexes and, for the ItemR156 layout, their vnum ranges (dwElements elements each)
+*/
+struct ProtoCacheHeader
+{
+	uint32_t dwFourCC;
+	uint32_t dwVersion;
+	uint32_t dwType;
+	uint32_t dwProtoVersion;
+	uint32_t dwStride;
+	uint32_t dwElements;
+	uint32_t dwSlots;
+	uint32_t dwShift;
+	uint32_t dwCRC32; //!< CRC32 of everything after the header.
+	uint32_t dwReserved;
+	struct EterPackCacheStamp sSource; //!< Stamp of the proto file the cache was made from.
+	uint64_t qwRecordsOffset;
+	uint64_t qwSlotVnumsOffset;
+	uint64_t qwSlotsOffset;
+	uint64_t qwSortedVnumsOffset;
+	uint64_t qwSortedIndexesOffset;
+	uint64_t qwVnumRangesOffset; //!< 0 without the ItemR156 layout.
+	uint64_t qwLength;
+
+	ProtoCacheHeader();
+};
+
+/*!
+	A binary cache of a decoded proto together with its vnum index.
+
+	Decoding a proto means decrypting and decompressing the records, then indexing them; the cache stores the result
+	so that a server only has to map the cache file (see MappedFile) to use the records and the index.
+	The mapping is read only and shared, so every process on a host uses the same physical copy of the cache.
+
+	Write the cache to a temporary file and rename it over the old one, so processes that still map the old cache keep a valid copy.
+*/
+class ProtoCache
+{
+public:
+	ProtoCache();
+	ProtoCache(const ProtoCache& cOther);
+	virtual ~ProtoCache();
+
+	/*!
+		Copies a cache. A created cache is copied with its buffer, a loaded one keeps using the external buffer.
+	*/
+	ProtoCache& operator=(const ProtoCache& cOther);
+
+	/*!
+		Creates a cache that can be written with @ref Save.
+
+		@param eType The proto type.
+		@param dwVersion The proto version.
+		@param cView The decoded records, with a known layout.
+		@param cIndex The index of the records.
+		@param sSource Stamp of the proto file, used to find out if the cache is outdated (see EterPackIndexCache::MakeStamp).
+		@return true if the cache was created, otherwise false.
+	*/
+	bool Create(ProtoType eType, uint32_t dwVersion, const ProtoView& cView, const ProtoIndex& cIndex, const EterPackCacheStamp& sSource = EterPackCacheStamp());
+
+	/*!
+		Writes the created cache.
+
+		@param pcFS The output file.
+		@return true if the whole cache was written, otherwise false.
+	*/
+	bool Save(std::shared_ptr<IFileSystem> pcFS) const;
+
+	/*!
+		Attaches to a cache buffer, usually a MappedFile.
+
+		The buffer is not copied, it must stay valid as long as the cache, its view or its index are used.
+		The buffer of a created cache is released.
+
+		@param pbInput The cache content.
+		@param nLength The length of the cache.
+		@param bVerify Verify the checksum of the whole cache, this reads every page of it.
+			The index tables are always checked, so without it only the content of the records is trusted.
+		@return true if the cache is valid, otherwise false.
+	*/
+	bool Load(const uint8_t* pbInput, size_t nLength, bool bVerify = true);
+
+	void Clear();
+
+	const uint8_t* GetBuffer() const { return m_pBuffer.data(); }
+	size_t GetBufferSize() const { return m_pBuffer.size(); }
+
+	ProtoType GetType() const { return m_eType; }
+	uint32_t GetVersion() const { return m_dwVersion; }
+	const EterPackCacheStamp& GetSourceStamp() const { return m_sSource; }
+
+	const ProtoView& GetView() const { return m_cView; }
+	const ProtoIndex& GetIndex() const { return m_cIndex; }
+
+private:
+	ProtoType m_eType;
+	uint32_t m_dwVersion;
+	struct EterPackCacheStamp m_sSource;
+
+	ProtoView m_cView;
+	ProtoIndex m_cIndex;
+
+	std::vector<uint8_t> m_pBuffer;
+};
+
+#endif // PROTOCACHE_HPP
@@ -0,0 +1,109 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoColumns.hpp
+	Defines a columnar projection of the records of a decoded proto.
+*/
+#ifndef PROTOCOLUMNS_HPP
+#define PROTOCOLUMNS_HPP
+#pragma once
+
+#include <LibLyketo/ProtoView.hpp>
+
+#include <vector>
+
+enum class ProtoCompare
+{
+	Equal,
+	NotEqual,
+	Less,
+	LessEqual,
+	Greater,
+	GreaterEqual,
+	HasAllBits, //!< (field & value) == value
+	HasAnyBits, //!< (field & value) != 0
+};
+
+/*!
+	The numeric fields of a proto, stored one column after the other.
+
+	Every column holds one 32 bit value for each record (signed fields are sign extended), so full table scans
+	read contiguous memory instead of jumping from record to record.
+	Selections are byte masks with one byte for each record, 0xFF for a selected record and 0 otherwise.
+*/
+class ProtoColumns
+{
+public:
+	ProtoColumns();
+	virtual ~ProtoColumns();
+
+	/*!
+		Projects the records of a view into columns.
+
+		@param cView A view with a known layout.
+		@param nThreads Number of workers, 0 to use every hardware thread.
+		@return true if the columns were built, otherwise false.
+	*/
+	bool Build(const ProtoView& cView, size_t nThreads = 0);
+	void Clear();
+
+	size_t GetCount() const { return m_nCount; }
+	size_t GetColumnCount() const { return m_vFields.size(); }
+	const ProtoFieldInfo& GetColumnInfo(size_t nColumn) const { return m_vFields[nColumn]; }
+
+	/*!
+		Finds a column by the name of its field.
+
+		@return The index of the column, or -1 if the field is not numeric or does not exist.
+	*/
+	int FindColumn(const char* szName) const;
+
+	/*!
+		Gets the values of a column, one for each record.
+	*/
+	const uint32_t* GetColumn(size_t nColumn) const;
+
+	/*!
+		Removes from a selection the records that do not match a predicate.
+
+		@param nColumn The column to compare.
+		@param eCompare The comparison.
+		@param dwValue The value to compare with, cast it from int32_t for signed columns.
+		@param vSelection The selection, an empty selection is treated as every record selected.
+		@return true if the column exists, otherwise false.
+	*/
+	bool Filter(size_t nColumn, ProtoCompare eCompare, uint32_t dwValue, std::vector<uint8_t>& vSelection) const;
+
+	/*!
+		Counts the selected records.
+	*/
+	size_t Count(const std::vector<uint8_t>& vSelection) const;
+
+	/*!
+		Sums a column over the selected records (every record without a selection).
+	*/
+	int64_t Sum(size_t nColumn, const std::vector<uint8_t>* pvSelection = nullptr) const;
+
+	/*!
+		Gets the smallest and the largest value of a column over the selected records (every record without a selection).
+
+		@return true if at least one record is selected, otherwise false.
+	*/
+	bool MinMax(size_t nColumn, int64_t* pnMin, int64_t* pnMax, const std::vector<uint8_t>* pvSelection = nullptr) const;
+
+	/*!
+		Gets the record indexes of a selection.
+	*/
+	void GetIndexes(const std::vector<uint8_t>& vSelection, std::vector<uint32_t>& vIndexes) const;
+
+private:
+	bool IsSelected(const std::vector<uint8_t>* pvSelection, size_t nIndex) const;
+	int64_t GetValue(size_t nColumn, size_t nIndex) const;
+
+	std::vector<ProtoFieldInfo> m_vFields;
+	std::vector<uint32_t> m_vData;
+	size_t m_nCount;
+};
+
+#endif // PROTOCOLUMNS_HPP
@@ -0,0 +1,111 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoCompiler.hpp
+	Defines a compiler of tab separated tables to Item and Mob Protos.
+*/
+#ifndef PROTOCOMPILER_HPP
+#define PROTOCOMPILER_HPP
+#pragma once
+
+#include <LibLyketo/ProtoView.hpp>
+#include <LibLyketo/CryptedObject.hpp>
+
+#include <string>
+#include <vector>
+
+enum class ProtoCompileErrors
+{
+	Ok,
+	InvalidLayout,
+	EmptyHeader,
+	UnknownColumn,
+	DuplicatedColumn,
+	InvalidColumnCount,
+	InvalidValue,
+	ValueOutOfRange,
+	StringTooLong,
+	TooManyRows,
+	NoRecords,
+	CryptFail,
+	WriteFail,
+};
+
+/*!
+	Compiles a tab separated table to the fixed stride records of a proto.
+
+	The first line names the columns, with the names of ProtoView::GetFields; columns can be in any order
+	and missing columns are left to zero. Every other line is a record, in the same order of the table.
+	Numbers are decimal (integers can also be hexadecimal with 0x), an empty cell is zero.
+	Values cannot contain tabs or line breaks, lines can end with CRLF.
+
+	The lines are split in chunks parsed by many threads, each one writing straight to its records.
+*/
+class ProtoCompiler
+{
+public:
+	ProtoCompiler();
+	virtual ~ProtoCompiler();
+
+	/*!
+		Parses a table.
+
+		@param eLayout The layout of the records.
+		@param pszInput The table.
+		@param nLength The length of the table.
+		@param nThreads Number of workers, 0 to use every hardware thread.
+		@return true if every line was parsed, otherwise false (see @ref GetError).
+	*/
+	bool Parse(ProtoLayout eLayout, const char* pszInput, size_t nLength, size_t nThreads = 0);
+
+	/*!
+		Compresses and encrypts the parsed records, then writes the proto file.
+
+		@param cObject The CryptedObject, with its algorithm and keys already set.
+		@param cProto The proto, with its fourccs already set. Type, version, stride and elements are set from the layout.
+		@param pcFS The output file.
+		@return true if the proto was written, otherwise false (see @ref GetError).
+	*/
+	bool Pack(CryptedObject& cObject, Proto& cProto, std::shared_ptr<IFileSystem> pcFS);
+
+	/*!
+		Compresses and encrypts records, then writes the proto file.
+
+		@param eType The proto type.
+		@param dwStride The size of a record.
+		@param pbRecords The records.
+		@param nCount Number of records.
+		@param cObject The CryptedObject, with its algorithm and keys already set.
+		@param cProto The proto, with its fourccs already set.
+		@param pcFS The output file.
+		@return ProtoCompileErrors::Ok if the proto was written, otherwise the error.
+	*/
+	static ProtoCompileErrors PackRecords(ProtoType eType, uint32_t dwStride, const uint8_t* pbRecords, size_t nCount, CryptedObject& cObject, Proto& cProto, std::shared_ptr<IFileSystem> pcFS);
+
+	/*!
+		Gets the proto type that stores a layout.
+	*/
+	static bool GetProtoType(ProtoLayout eLayout, ProtoType* peType);
+
+	ProtoLayout GetLayout() const { return m_eLayout; }
+	const std::vector<uint8_t>& GetRecords() const { return m_vRecords; }
+	size_t GetCount() const { return m_nCount; }
+
+	ProtoCompileErrors GetError() const { return m_eError; }
+	size_t GetErrorLine() const { return m_nErrorLine; } //!< 1 based, 0 if the error is not in a line.
+	size_t GetErrorColumn() const { return m_nErrorColumn; } //!< 1 based, 0 if the error is not in a column.
+
+private:
+	void SetError(ProtoCompileErrors eError, size_t nLine, size_t nColumn);
+
+	ProtoLayout m_eLayout;
+	std::vector<uint8_t> m_vRecords;
+	size_t m_nCount;
+
+	ProtoCompileErrors m_eError;
+	size_t m_nErrorLine;
+	size_t m_nErrorColumn;
+};
+
+#endif // PROTOCOMPILER_HPP
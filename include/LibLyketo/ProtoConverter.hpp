@@ -0,0 +1,75 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoConverter.hpp
+	Defines a converter of proto records between layouts.
+*/
+#ifndef PROTOCONVERTER_HPP
+#define PROTOCONVERTER_HPP
+#pragma once
+
+#include <LibLyketo/ProtoView.hpp>
+
+#include <vector>
+
+/*!
+	A copy of bytes from a source record to a target record.
+*/
+struct ProtoFieldMove
+{
+	uint32_t dwFrom;
+	uint32_t dwTo;
+	uint32_t dwSize;
+};
+
+/*!
+	Remaps records from a layout to another (for example from ItemR152 to ItemR156).
+
+	Fields are matched by name (see ProtoView::GetFields). The table of moves is computed once, and fields
+	that are contiguous in both layouts are merged in a single move, so converting a record is a few memcpy.
+	Target fields missing from the source layout are zeroed, source fields missing from the target layout are dropped.
+*/
+class ProtoConverter
+{
+public:
+	ProtoConverter();
+	virtual ~ProtoConverter();
+
+	/*!
+		Computes the moves between two layouts.
+
+		@param eFrom The source layout.
+		@param eTo The target layout.
+		@return true if the layouts are both item or both mob layouts and every shared field has the same size, otherwise false.
+	*/
+	bool Prepare(ProtoLayout eFrom, ProtoLayout eTo);
+
+	/*!
+		Converts every record of a view.
+
+		@param cInput The records, with the source layout.
+		@param vOutput Receives the records with the target layout.
+		@param nThreads Number of workers, 0 to use every hardware thread.
+		@return true if the records were converted, otherwise false.
+	*/
+	bool Convert(const ProtoView& cInput, std::vector<uint8_t>& vOutput, size_t nThreads = 0) const;
+
+	ProtoLayout GetFrom() const { return m_eFrom; }
+	ProtoLayout GetTo() const { return m_eTo; }
+	const std::vector<ProtoFieldMove>& GetMoves() const { return m_vMoves; }
+
+	/*!
+		Gets the number of source fields without a target field, their values are lost by the conversion.
+	*/
+	size_t GetDroppedCount() const { return m_nDropped; }
+
+private:
+	ProtoLayout m_eFrom;
+	ProtoLayout m_eTo;
+	std::vector<ProtoFieldMove> m_vMoves;
+	size_t m_nDropped;
+	bool m_bIdentity; //!< A single move of the whole record.
+};
+
+#endif // PROTOCONVERTER_HPP
@@ -0,0 +1,105 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoDiff.hpp
+	Defines a record level changeset between two decoded protos.
+*/
+#ifndef PROTODIFF_HPP
+#define PROTODIFF_HPP
+#pragma once
+
+#include <LibLyketo/ProtoView.hpp>
+#include <LibLyketo/ProtoIndex.hpp>
+
+#include <vector>
+
+/*!
+	Header of a serialized changeset.
+
+	It is followed by the removed vnums (uint32_t), the added records (dwStride bytes each) and the changed records.
+	A changed record is its vnum, the number of runs (uint32_t) and the runs, each one stored as
+	its offset in the record (uint16_t), its length (uint16_t) and the new bytes.
+*/
+struct ProtoDiffHeader
+{
+	uint32_t dwFourCC;
+	uint32_t dwVersion;
+	uint32_t dwLayout;
+	uint32_t dwStride;
+	uint32_t dwAdded;
+	uint32_t dwRemoved;
+	uint32_t dwChanged;
+	uint32_t dwCRC32; //!< CRC32 of everything after the header.
+
+	ProtoDiffHeader();
+};
+
+/*!
+	The differences between two versions of a proto, keyed by vnum.
+
+	Changed records only store the fields that changed (merged in runs of adjacent fields),
+	so the size of a changeset depends on the number of changes instead of the size of the table.
+*/
+class ProtoDiff
+{
+public:
+	ProtoDiff();
+	virtual ~ProtoDiff();
+
+	/*!
+		Computes the changes from a version of a proto to another.
+
+		@param cOld The previous version.
+		@param cNew The new version, with the same layout of the previous one.
+		@return true if the changeset was computed, otherwise false.
+	*/
+	bool Compute(const ProtoView& cOld, const ProtoView& cNew);
+
+	/*!
+		Loads a serialized changeset.
+
+		@param pbInput The changeset.
+		@param nLength The length of the changeset.
+		@return true if the changeset is valid, otherwise false.
+	*/
+	bool Load(const uint8_t* pbInput, size_t nLength);
+
+	/*!
+		Applies the changeset to the records of a proto.
+
+		Changed records are patched in place, removed records are dropped (keeping the order of the others)
+		and added records are appended. Nothing is modified when the changeset does not match the records.
+
+		@param vRecords The decoded records, of the same layout of the changeset.
+		@param eLayout The layout of the records.
+		@return true if the changeset was applied, otherwise false.
+	*/
+	bool Apply(std::vector<uint8_t>& vRecords, ProtoLayout eLayout) const;
+
+	/*!
+		Applies the changeset to the records of a proto, using an index that was already built.
+
+		Saves building an index over the whole table when the caller keeps one.
+
+		@param vRecords The decoded records, of the same layout of the changeset.
+		@param eLayout The layout of the records.
+		@param cIndex An index of vRecords as they are before the changeset is applied.
+		@return true if the changeset was applied, otherwise false.
+	*/
+	bool Apply(std::vector<uint8_t>& vRecords, ProtoLayout eLayout, const ProtoIndex& cIndex) const;
+
+	const uint8_t* GetBuffer() const { return m_pBuffer.data(); }
+	size_t GetBufferSize() const { return m_pBuffer.size(); }
+
+	uint32_t GetAdded() const { return m_sHeader.dwAdded; }
+	uint32_t GetRemoved() const { return m_sHeader.dwRemoved; }
+	uint32_t GetChanged() const { return m_sHeader.dwChanged; }
+	bool IsEmpty() const { return m_sHeader.dwAdded == 0 && m_sHeader.dwRemoved == 0 && m_sHeader.dwChanged == 0; }
+
+private:
+	struct ProtoDiffHeader m_sHeader;
+	std::vector<uint8_t> m_pBuffer;
+};
+
+#endif // PROTODIFF_HPP
@@ -0,0 +1,53 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoExporter.hpp
+	Defines an exporter of proto records to text tables.
+*/
+#ifndef PROTOEXPORTER_HPP
+#define PROTOEXPORTER_HPP
+#pragma once
+
+#include <LibLyketo/ProtoView.hpp>
+
+#include <memory>
+
+enum class ProtoExportFormat
+{
+	Tsv, //!< Tab separated values with a header line, the input of ProtoCompiler.
+	JsonLines, //!< A JSON object per record.
+};
+
+/*!
+	Exports every record of a proto, with the fields of ProtoView::GetFields.
+
+	Records are formatted by many threads in blocks, and each round of blocks is written with a single call.
+	Text fields end at the first null character. In tab separated values tabs and line breaks inside them
+	are written as spaces; in JSON every byte over 0x7F is written as the code point of the same value,
+	since proto texts are usually not UTF-8.
+*/
+class ProtoExporter
+{
+public:
+	ProtoExporter();
+	virtual ~ProtoExporter();
+
+	/*!
+		Exports the records of a view.
+
+		@param cView A view with a known layout.
+		@param eFormat The output format.
+		@param pcFS The output file.
+		@param nThreads Number of workers, 0 to use every hardware thread.
+		@return true if every record was written, otherwise false.
+	*/
+	bool Export(const ProtoView& cView, ProtoExportFormat eFormat, std::shared_ptr<IFileSystem> pcFS, size_t nThreads = 0);
+
+	uint64_t GetWritten() const { return m_qwWritten; }
+
+private:
+	uint64_t m_qwWritten;
+};
+
+#endif // PROTOEXPORTER_HPP
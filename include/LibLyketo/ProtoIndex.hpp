@@ -0,0 +1,125 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoIndex.hpp
+	Defines a vnum index over the records of a decoded proto.
+*/
+#ifndef PROTOINDEX_HPP
+#define PROTOINDEX_HPP
+#pragma once
+
+#include <LibLyketo/ProtoView.hpp>
+
+#include <vector>
+
+/*!
+	The lookup tables of a ProtoIndex.
+	They are plain arrays, so they can be stored in a file and used straight from a memory mapping (see ProtoCache).
+*/
+struct ProtoIndexTables
+{
+	const uint32_t* pSlotVnums;
+	const uint32_t* pSlots; //!< Record index + 1, 0 for an empty slot.
+	size_t nSlots; //!< A power of two.
+	uint32_t dwShift;
+
+	const uint32_t* pSortedVnums;
+	const uint32_t* pSortedIndexes;
+	const uint32_t* pVnumRanges; //!< Vnum range of every sorted record, nullptr without the ItemR156 layout.
+	size_t nCount;
+
+	ProtoIndexTables();
+};
+
+/*!
+	Maps vnums to record indexes of a ProtoView.
+
+	Exact lookups go through an open addressing hash table (linear probing), range lookups
+	through the vnums sorted in ascending order. Both are built with a single pass over the records.
+	When many records share a vnum, exact lookups return the first one.
+*/
+class ProtoIndex
+{
+public:
+	ProtoIndex();
+	ProtoIndex(const ProtoIndex& cOther);
+	virtual ~ProtoIndex();
+
+	ProtoIndex& operator=(const ProtoIndex& cOther);
+
+	/*!
+		Indexes the records of a view.
+
+		@param cView A view with a known layout.
+		@return true if the index was built, otherwise false.
+	*/
+	bool Build(const ProtoView& cView);
+
+	/*!
+		Uses tables built by another index.
+
+		The tables are not copied, they must stay valid as long as the index is used.
+		Every slot and sorted entry is checked, so tables read from a file cannot make lookups
+		return an index outside the records.
+
+		@param sTables The tables.
+		@return true if the tables are consistent, otherwise false.
+	*/
+	bool Attach(const ProtoIndexTables& sTables);
+	void Clear();
+
+	/*!
+		Reads the vnum ranges again, after records were changed without changing their vnums or their order.
+
+		@param cView The view the index was built for, or a copy of its records.
+		@return true if the index was built by @ref Build for as many records, otherwise false.
+	*/
+	bool UpdateRanges(const ProtoView& cView);
+
+	/*!
+		Finds the record with a vnum.
+
+		@param dwVnum The vnum to find.
+		@param pdwIndex Receives the index of the record in the view.
+		@return true if the vnum was found, otherwise false.
+	*/
+	bool Find(uint32_t dwVnum, uint32_t* pdwIndex) const;
+
+	/*!
+		Finds the record with a vnum, or the item record whose vnum range covers it
+		(vnums from dwVnum up to, but excluding, dwVnum + dwVnumRange, only for the ItemR156 layout).
+
+		@param dwVnum The vnum to find.
+		@param pdwIndex Receives the index of the record in the view.
+		@return true if a record was found, otherwise false.
+	*/
+	bool FindCovering(uint32_t dwVnum, uint32_t* pdwIndex) const;
+
+	/*!
+		Finds every record with a vnum between dwFirst and dwLast (both included).
+
+		@param dwFirst The first vnum.
+		@param dwLast The last vnum.
+		@param ppIndexes Receives the record indexes, sorted by vnum. They stay valid until the index is rebuilt.
+		@return Number of records found.
+	*/
+	size_t FindRange(uint32_t dwFirst, uint32_t dwLast, const uint32_t** ppIndexes) const;
+
+	size_t GetCount() const { return m_sTables.nCount; }
+	const ProtoIndexTables& GetTables() const { return m_sTables; }
+
+private:
+	void Bind();
+
+	struct ProtoIndexTables m_sTables;
+	bool m_bAttached;
+
+	std::vector<uint32_t> m_vSlotVnums;
+	std::vector<uint32_t> m_vSlots;
+	std::vector<uint32_t> m_vSortedVnums;
+	std::vector<uint32_t> m_vSortedIndexes;
+	std::vector<uint32_t> m_vVnumRanges;
+};
+
+#endif // PROTOINDEX_HPP
@@ -0,0 +1,175 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoReloader.hpp
+	Defines a background reloader of Item and Mob Protos.
+*/
+#ifndef PROTORELOADER_HPP
+#define PROTORELOADER_HPP
+#pragma once
+
+#include <LibLyketo/ProtoIndex.hpp>
+#include <LibLyketo/ProtoDiff.hpp>
+#include <LibLyketo/EterPackIndexCache.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*!
+	A decoded version of a proto file, never modified after it is published.
+*/
+struct ProtoTable
+{
+	ProtoType eType;
+	uint32_t dwVersion;
+	uint32_t dwStride;
+	uint32_t dwElements;
+	uint64_t qwGeneration; //!< 1 for the first version, increased on every reload.
+
+	std::vector<uint8_t> vRecords;
+	ProtoView cView; //!< Points inside vRecords.
+	ProtoIndex cIndex; //!< Empty when the layout is unknown.
+
+	ProtoTable();
+
+private:
+	ProtoTable(const ProtoTable&);
+	ProtoTable& operator=(const ProtoTable&);
+};
+
+/*!
+	How a proto file is decoded.
+*/
+struct ProtoReloadOptions
+{
+	uint32_t adwKeys[4];
+	bool bHaveKeys;
+	uint32_t dwLzo1xFourcc; //!< 0 for the default one.
+	uint32_t dwSnappyFourcc; //!< 0 for the default one.
+	uint32_t dwItemFourcc; //!< 0 for the default one.
+	uint32_t dwItemOldFourcc; //!< 0 for the default one.
+	uint32_t dwMobFourcc; //!< 0 for the default one.
+
+	ProtoReloadOptions();
+};
+
+/*!
+	Called after every reload attempt: by the reloader thread for the detected changes,
+	by the calling thread for @ref ProtoReloader::Reload and @ref ProtoReloader::Patch.
+*/
+typedef std::function<void(const std::string& szFilename, bool bSuccess)> ProtoReloadCallback;
+
+/*!
+	Keeps the decoded and indexed version of many proto files, reloading them in the background when they change.
+
+	Readers take a reference to the current version with @ref Get and keep using it for as long as they want.
+	A new version is decoded and indexed by the reloader thread, then published with an atomic pointer swap,
+	so readers never wait for the decoding. The swap and @ref Get go through std::atomic_load and std::atomic_store
+	on a shared_ptr, which the common standard libraries implement with a short lock: a reader may wait for
+	the copy of a pointer, never for a reload. Readers should keep the returned reference instead of calling
+	@ref Get for every lookup. An old version is freed when its last reader releases it.
+
+	Changes are detected with inotify on Linux (on the directory, so files replaced with a rename are seen too)
+	and by polling the size and modification time of the files on the other platforms.
+*/
+class ProtoReloader
+{
+public:
+	ProtoReloader();
+	virtual ~ProtoReloader();
+
+	/*!
+		Loads a proto file and adds it to the watched files. Files can only be added before @ref Start.
+
+		@param szFilename The proto file.
+		@param sOptions How the file is decoded.
+		@return The id of the file, or -1 if the file cannot be loaded.
+	*/
+	int Watch(const std::string& szFilename, const ProtoReloadOptions& sOptions = ProtoReloadOptions());
+
+	/*!
+		Starts watching the files.
+
+		@param fnCallback The function called after every reload (optional).
+		@param nSettleMs Time without new changes to wait before reloading a file, so a file is not read while it is being written.
+		@return true if the reloader was started, otherwise false (on Linux also when a directory cannot be watched).
+	*/
+	bool Start(ProtoReloadCallback fnCallback = nullptr, size_t nSettleMs = 200);
+	void Stop();
+	bool IsRunning() const { return m_cThread.joinable(); }
+
+	/*!
+		Gets the current version of a file.
+
+		Takes a short lock, shared with the publication of a new version (see the class description).
+
+		@param nId The id returned by @ref Watch.
+		@return The current version, or nullptr if the id is invalid.
+	*/
+	std::shared_ptr<const ProtoTable> Get(int nId) const;
+
+	/*!
+		Reloads a file now, on the calling thread.
+
+		@param nId The id returned by @ref Watch.
+		@return true if the new version was published, otherwise false (the current version is kept).
+	*/
+	bool Reload(int nId);
+
+	/*!
+		Publishes a new version of a file by applying a changeset to the current one.
+
+		The file on disk is not modified, a later reload replaces the patched version.
+
+		@param nId The id returned by @ref Watch.
+		@param cDiff The changes to apply.
+		@return true if the new version was published, otherwise false (the current version is kept).
+	*/
+	bool Patch(int nId, const ProtoDiff& cDiff);
+
+	/*!
+		Decodes and indexes a proto file.
+
+		@param szFilename The proto file.
+		@param sOptions How the file is decoded.
+		@return The decoded file, or nullptr on failure.
+	*/
+	static std::shared_ptr<ProtoTable> Decode(const std::string& szFilename, const ProtoReloadOptions& sOptions);
+
+private:
+	struct WatchedFile
+	{
+		std::string szFilename;
+		ProtoReloadOptions sOptions;
+		EterPackCacheStamp sStamp;
+		std::shared_ptr<const ProtoTable> pTable;
+		std::mutex mReload;
+	};
+
+	void Run();
+	bool ReloadFile(WatchedFile& sFile);
+
+	std::vector<std::unique_ptr<WatchedFile>> m_vFiles;
+	ProtoReloadCallback m_fnCallback;
+	size_t m_nSettleMs;
+
+	std::thread m_cThread;
+	std::atomic<bool> m_bStop;
+
+#ifdef __linux__
+	int m_anStopPipe[2];
+	int m_nNotify;
+	std::vector<int> m_vWatches;
+#else
+	std::mutex m_mStop;
+	std::condition_variable m_cvStop;
+#endif
+};
+
+#endif // PROTORELOADER_HPP
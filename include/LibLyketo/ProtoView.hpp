@@ -0,0 +1,292 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoView.hpp
+	Defines typed views over the records of a decoded Item or Mob Proto.
+*/
+#ifndef PROTOVIEW_HPP
+#define PROTOVIEW_HPP
+#pragma once
+
+#include <LibLyketo/Proto.hpp>
+
+#define PROTO_NAME_LENGTH 25
+#define PROTO_FOLDER_LENGTH 65
+
+// The only version of the new item format with a known layout
+#define PROTO_ITEM_VERSION 1
+
+/*!
+	Known record layouts of a decoded proto.
+*/
+enum class ProtoLayout
+{
+	Unknown, //!< Records can only be reached as raw bytes.
+	ItemR152, //!< Item records without the vnum range (old format, or new format with stride 152).
+	ItemR156, //!< Item records with the vnum range (new format version 1, stride 156).
+	Mob, //!< Mob records (stride 255).
+};
+
+/*!
+	How a field of a record is stored.
+*/
+enum class ProtoFieldType
+{
+	Unsigned,
+	Signed,
+	Float,
+	String, //!< Fixed length text, not terminated when it fills the whole field.
+};
+
+/*!
+	A field of a record layout, arrays are split in one field for each element.
+*/
+struct ProtoFieldInfo
+{
+	const char* szName;
+	uint32_t dwOffset;
+	uint32_t dwSize;
+	ProtoFieldType eType;
+};
+
+#pragma pack(push, 1)
+
+struct ProtoItemLimit
+{
+	uint8_t bType;
+	int32_t lValue;
+};
+
+struct ProtoItemApply
+{
+	uint8_t bType;
+	int32_t lValue;
+};
+
+struct ProtoItemTableR152
+{
+	static const ProtoLayout eLayout = ProtoLayout::ItemR152;
+
+	uint32_t dwVnum;
+	char szName[PROTO_NAME_LENGTH];
+	char szLocaleName[PROTO_NAME_LENGTH];
+	uint8_t bType;
+	uint8_t bSubType;
+	uint8_t bWeight;
+	uint8_t bSize;
+	uint32_t dwAntiFlags;
+	uint32_t dwFlags;
+	uint32_t dwWearFlags;
+	uint32_t dwImmuneFlag;
+	uint32_t dwBuyPrice;
+	uint32_t dwSellPrice;
+	struct ProtoItemLimit aLimits[2];
+	struct ProtoItemApply aApplies[3];
+	int32_t alValues[6];
+	int32_t alSockets[3];
+	uint32_t dwRefinedVnum;
+	uint16_t wRefineSet;
+	uint8_t bAlterToMagicItemPercent;
+	uint8_t bSpecular;
+	uint8_t bGainSocketPercent;
+};
+
+struct ProtoItemTableR156
+{
+	static const ProtoLayout eLayout = ProtoLayout::ItemR156;
+
+	uint32_t dwVnum;
+	uint32_t dwVnumRange;
+	char szName[PROTO_NAME_LENGTH];
+	char szLocaleName[PROTO_NAME_LENGTH];
+	uint8_t bType;
+	uint8_t bSubType;
+	uint8_t bWeight;
+	uint8_t bSize;
+	uint32_t dwAntiFlags;
+	uint32_t dwFlags;
+	uint32_t dwWearFlags;
+	uint32_t dwImmuneFlag;
+	uint32_t dwBuyPrice;
+	uint32_t dwSellPrice;
+	struct ProtoItemLimit aLimits[2];
+	struct ProtoItemApply aApplies[3];
+	int32_t alValues[6];
+	int32_t alSockets[3];
+	uint32_t dwRefinedVnum;
+	uint16_t wRefineSet;
+	uint8_t bAlterToMagicItemPercent;
+	uint8_t bSpecular;
+	uint8_t bGainSocketPercent;
+};
+
+struct ProtoMobSkill
+{
+	uint32_t dwVnum;
+	uint8_t bLevel;
+};
+
+struct ProtoMobTable
+{
+	static const ProtoLayout eLayout = ProtoLayout::Mob;
+
+	uint32_t dwVnum;
+	char szName[PROTO_NAME_LENGTH];
+	char szLocaleName[PROTO_NAME_LENGTH];
+	uint8_t bType;
+	uint8_t bRank;
+	uint8_t bBattleType;
+	uint8_t bLevel;
+	uint8_t bSize;
+	uint32_t dwGoldMin;
+	uint32_t dwGoldMax;
+	uint32_t dwExp;
+	uint32_t dwMaxHP;
+	uint8_t bRegenCycle;
+	uint8_t bRegenPercent;
+	uint16_t wDef;
+	uint32_t dwAIFlag;
+	uint32_t dwRaceFlag;
+	uint32_t dwImmuneFlag;
+	uint8_t bStr;
+	uint8_t bDex;
+	uint8_t bCon;
+	uint8_t bInt;
+	uint32_t adwDamageRange[2];
+	int16_t sAttackSpeed;
+	int16_t sMovingSpeed;
+	uint8_t bAggressiveHPPct;
+	uint16_t wAggressiveSight;
+	uint16_t wAttackRange;
+	int8_t acEnchants[6];
+	int8_t acResists[11];
+	uint32_t dwResurrectionVnum;
+	uint32_t dwDropItemVnum;
+	uint8_t bMountCapacity;
+	uint8_t bOnClickType;
+	uint8_t bEmpire;
+	char szFolder[PROTO_FOLDER_LENGTH];
+	float fDamMultiply;
+	uint32_t dwSummonVnum;
+	uint32_t dwDrainSP;
+	uint32_t dwMonsterColor;
+	uint32_t dwPolymorphItemVnum;
+	struct ProtoMobSkill aSkills[5];
+	uint8_t bBerserkPoint;
+	uint8_t bStoneSkinPoint;
+	uint8_t bGodSpeedPoint;
+	uint8_t bDeathBlowPoint;
+	uint8_t bRevivePoint;
+};
+
+#pragma pack(pop)
+
+/*!
+	A view over the records of a decoded proto (the output of CryptedObject::Decrypt).
+
+	Records are never copied, every accessor reads straight from the decoded buffer, which must outlive the view.
+	The layout is selected from the proto type, version and stride; unknown layouts can still be walked as raw records.
+*/
+class ProtoView
+{
+public:
+	ProtoView();
+	virtual ~ProtoView();
+
+	/*!
+		Opens a view over decoded records.
+
+		@param eType The proto type.
+		@param dwVersion The proto version (only used by the new item format).
+		@param dwStride The record size, 0 to compute it from the length (old item and mob formats have no stride).
+		@param dwElements Number of records.
+		@param pbData The decoded records.
+		@param nLength Length of the decoded records.
+		@return true if the records fit in the buffer, otherwise false.
+	*/
+	bool Open(ProtoType eType, uint32_t dwVersion, uint32_t dwStride, uint32_t dwElements, const uint8_t* pbData, size_t nLength);
+
+	/*!
+		Opens a view over the decoded records of an unpacked proto.
+
+		@param cProto The unpacked proto.
+		@param pbData The decoded records.
+		@param nLength Length of the decoded records.
+		@return true if the records fit in the buffer, otherwise false.
+	*/
+	bool Open(const Proto& cProto, const uint8_t* pbData, size_t nLength);
+
+	/*!
+		Gets the record layout of a proto.
+	*/
+	static ProtoLayout DetectLayout(ProtoType eType, uint32_t dwVersion, uint32_t dwStride);
+
+	/*!
+		Gets the record size of a layout.
+
+		@return The record size, or 0 for an unknown layout.
+	*/
+	static uint32_t GetLayoutStride(ProtoLayout eLayout);
+
+	/*!
+		Gets the fields of a layout, in record order.
+
+		@param eLayout The layout.
+		@param pnCount Receives the number of fields.
+		@return The fields, or nullptr for an unknown layout.
+	*/
+	static const ProtoFieldInfo* GetFields(ProtoLayout eLayout, size_t* pnCount);
+
+	ProtoLayout GetLayout() const { return m_eLayout; }
+	size_t GetCount() const { return m_nCount; }
+	uint32_t GetStride() const { return m_dwStride; }
+
+	/*!
+		Gets a raw record.
+
+		@param nIndex The index of the record.
+		@return The first byte of the record, or nullptr if the index is out of range.
+	*/
+	const uint8_t* GetRecord(size_t nIndex) const;
+
+	/*!
+		Gets a typed record.
+		T is one of ProtoItemTableR152, ProtoItemTableR156 and ProtoMobTable.
+
+		@param nIndex The index of the record.
+		@return The record, or nullptr if the index is out of range or T does not match the layout of the view.
+	*/
+	template <typename T>
+	const T* Get(size_t nIndex) const
+	{
+		if (T::eLayout != m_eLayout)
+			return nullptr;
+
+		return reinterpret_cast<const T*>(GetRecord(nIndex));
+	}
+
+	/*!
+		Gets the vnum of a record, for every known layout.
+
+		@return The vnum, or 0 if the layout is unknown or the index is out of range.
+	*/
+	uint32_t GetVnum(size_t nIndex) const;
+
+	/*!
+		Gets the name of a record, for every known layout.
+		The name is at most PROTO_NAME_LENGTH characters and it is not terminated when it fills the whole field.
+
+		@return The name, or nullptr if the layout is unknown or the index is out of range.
+	*/
+	const char* GetName(size_t nIndex) const;
+	const char* GetLocaleName(size_t nIndex) const;
+
+private:
+	const uint8_t* m_pbData;
+	size_t m_nCount;
+	uint32_t m_dwStride;
+	ProtoLayout m_eLayout;
+};
+
+#endif // PROTOVIEW_HPP
@@ -0,0 +1,558 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file BufferedFileSystem.cpp
+	Implements a buffered, preallocating file writer.
+*/
+#include <LibLyketo/BufferedFileSystem.hpp>
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+// Default size of the write buffer
+#define BUFFEREDFS_BUFFER_SIZE (8 * 1024 * 1024)
+
+// Alignment of the buffer, file positions and lengths required by direct I/O
+#define BUFFEREDFS_ALIGNMENT 4096
+
+// Largest length passed to a single read or write call
+#define BUFFEREDFS_MAX_IO (1024 * 1024 * 1024)
+
+#ifdef _WIN32
+BufferedFileSystem::BufferedFileSystem() : m_hFile(INVALID_HANDLE_VALUE), m_pbBuffer(nullptr), m_nCapacity(0), m_nBuffered(0), m_qwPosition(0), m_qwSize(0), m_bDirect(false), m_bDirectActive(false), m_bFailed(false)
+#else
+BufferedFileSystem::BufferedFileSystem() : m_nFile(-1), m_pbBuffer(nullptr), m_nCapacity(0), m_nBuffered(0), m_qwPosition(0), m_qwSize(0), m_bDirect(false), m_bDirectActive(false), m_bFailed(false)
+#endif
+{
+}
+
+BufferedFileSystem::~BufferedFileSystem()
+{
+	Close();
+}
+
+bool BufferedFileSystem::IsOpen() const
+{
+#ifdef _WIN32
+	return m_hFile != INVALID_HANDLE_VALUE;
+#else
+	return m_nFile >= 0;
+#endif
+}
+
+bool BufferedFileSystem::Open(std::string szFilename, uint64_t qwExpectedSize, bool bDirect, size_t nBufferSize)
+{
+	Close();
+
+	if (nBufferSize < 1)
+		nBufferSize = BUFFEREDFS_BUFFER_SIZE;
+
+	// Direct I/O writes whole aligned blocks
+	nBufferSize = (nBufferSize + BUFFEREDFS_ALIGNMENT - 1) & ~static_cast<size_t>(BUFFEREDFS_ALIGNMENT - 1);
+
+#ifdef _WIN32
+	// FILE_FLAG_NO_BUFFERING cannot be dropped for the unaligned tail of the file, write through is the closest safe mode
+	m_hFile = CreateFileA(szFilename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | (bDirect ? FILE_FLAG_WRITE_THROUGH : 0), nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (qwExpectedSize > 0)
+	{
+		// Only reserves the space, the end of the file does not move
+		FILE_ALLOCATION_INFO sAllocation;
+		sAllocation.AllocationSize.QuadPart = static_cast<LONGLONG>(qwExpectedSize);
+		SetFileInformationByHandle(m_hFile, FileAllocationInfo, &sAllocation, sizeof(sAllocation));
+	}
+
+	bDirect = false;
+#else
+	m_nFile = open(szFilename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (m_nFile < 0)
+		return false;
+
+#ifdef __linux__
+	// Preallocation is only a hint, filesystems without fallocate support just grow the file as usual
+	if (qwExpectedSize > 0)
+		fallocate(m_nFile, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(qwExpectedSize));
+#endif
+#endif
+
+	m_vBuffer.resize(nBufferSize + BUFFEREDFS_ALIGNMENT);
+	m_pbBuffer = m_vBuffer.data() + ((BUFFEREDFS_ALIGNMENT - (reinterpret_cast<uintptr_t>(m_vBuffer.data()) % BUFFEREDFS_ALIGNMENT)) % BUFFEREDFS_ALIGNMENT);
+	m_nCapacity = nBufferSize;
+	m_nBuffered = 0;
+	m_qwPosition = 0;
+	m_qwSize = 0;
+	m_bFailed = false;
+	m_bDirectActive = false;
+
+	// Filesystems without direct I/O support fall back to the buffered mode
+	m_bDirect = bDirect && SetDirect(true);
+	return true;
+}
+
+bool BufferedFileSystem::Close()
+{
+	if (!IsOpen())
+		return true;
+
+	bool bResult = FlushBuffer(true);
+
+#ifdef _WIN32
+	CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	close(m_nFile);
+	m_nFile = -1;
+#endif
+
+	m_vBuffer.clear();
+	m_vBuffer.shrink_to_fit();
+	m_pbBuffer = nullptr;
+	m_nCapacity = 0;
+	m_nBuffered = 0;
+
+	return bResult;
+}
+
+bool BufferedFileSystem::Seek(uint64_t nLength, SeekOffset eOffset)
+{
+	if (!IsOpen())
+		return false;
+
+	uint64_t qwPosition = nLength;
+
+	if (eOffset == SeekOffset::Current)
+		qwPosition += m_qwPosition + m_nBuffered;
+	else if (eOffset == SeekOffset::End)
+	{
+		// Pending bytes may extend the file past the size on disk
+		uint64_t qwEnd = m_qwPosition + m_nBuffered;
+		qwPosition += qwEnd > m_qwSize ? qwEnd : m_qwSize;
+	}
+
+	if (qwPosition == m_qwPosition + m_nBuffered)
+		return !m_bFailed;
+
+	if (!FlushBuffer(true))
+		return false;
+
+	m_qwPosition = qwPosition;
+	return true;
+}
+
+bool BufferedFileSystem::Read(uint8_t* pbOut, size_t nLength)
+{
+	if (!IsOpen() || !FlushBuffer(true))
+		return false;
+
+	if (m_qwPosition + nLength > m_qwSize)
+		return false;
+
+	if (!ReadAt(pbOut, nLength, m_qwPosition))
+		return false;
+
+	m_qwPosition += nLength;
+	return true;
+}
+
+bool BufferedFileSystem::Write(const uint8_t* pbData, size_t nLength)
+{
+	if (!IsOpen() || m_bFailed)
+		return false;
+
+	while (nLength > 0)
+	{
+		// Data larger than the buffer skips the copy when nothing is pending
+		if (m_nBuffered == 0 && nLength >= m_nCapacity && !m_bDirect)
+		{
+			if (!WriteAt(pbData, nLength, m_qwPosition))
+				return false;
+
+			m_qwPosition += nLength;
+			return true;
+		}
+
+		size_t nCopy = m_nCapacity - m_nBuffered;
+
+		if (nCopy > nLength)
+			nCopy = nLength;
+
+		memcpy_s(m_pbBuffer + m_nBuffered, m_nCapacity - m_nBuffered, pbData, nCopy);
+		m_nBuffered += nCopy;
+		pbData += nCopy;
+		nLength -= nCopy;
+
+		if (m_nBuffered == m_nCapacity && !FlushBuffer(false))
+			return false;
+	}
+
+	return true;
+}
+
+int64_t BufferedFileSystem::Tell()
+{
+	return static_cast<int64_t>(m_qwPosition + m_nBuffered);
+}
+
+bool BufferedFileSystem::ReadV(const FileSystemBuffer* pBuffers, size_t nCount)
+{
+	if (!IsOpen() || !FlushBuffer(true))
+		return false;
+
+	uint64_t qwLength = 0;
+
+	for (size_t i = 0; i < nCount; i++)
+		qwLength += pBuffers[i].nLength;
+
+	if (m_qwPosition + qwLength > m_qwSize)
+		return false;
+
+	if (!ReadVAt(pBuffers, nCount, m_qwPosition))
+		return false;
+
+	m_qwPosition += qwLength;
+	return true;
+}
+
+bool BufferedFileSystem::WriteV(const FileSystemConstBuffer* pBuffers, size_t nCount)
+{
+	if (!IsOpen() || m_bFailed)
+		return false;
+
+	uint64_t qwLength = 0;
+
+	for (size_t i = 0; i < nCount; i++)
+		qwLength += pBuffers[i].nLength;
+
+	// Small groups are merged in the buffer, large ones are written with a single gather write
+	if (m_bDirect || m_nBuffered + qwLength <= m_nCapacity)
+		return IFileSystem::WriteV(pBuffers, nCount);
+
+	if (!FlushBuffer(true) || !WriteVAt(pBuffers, nCount, m_qwPosition))
+		return false;
+
+	m_qwPosition += qwLength;
+	return true;
+}
+
+int64_t BufferedFileSystem::Size()
+{
+	if (!IsOpen())
+		return -1;
+
+	uint64_t qwEnd = m_qwPosition + m_nBuffered;
+	return static_cast<int64_t>(qwEnd > m_qwSize ? qwEnd : m_qwSize);
+}
+
+bool BufferedFileSystem::Flush()
+{
+	return IsOpen() && FlushBuffer(true);
+}
+
+bool BufferedFileSystem::Sync()
+{
+	if (!Flush())
+		return false;
+
+#ifdef _WIN32
+	return FlushFileBuffers(m_hFile) != FALSE;
+#elif defined(__linux__)
+	return fdatasync(m_nFile) == 0;
+#else
+	return fsync(m_nFile) == 0;
+#endif
+}
+
+bool BufferedFileSystem::FlushBuffer(bool bAll)
+{
+	if (m_bFailed)
+		return false;
+
+	if (m_bDirect && m_nBuffered > 0 && (m_qwPosition % BUFFEREDFS_ALIGNMENT) != 0)
+	{
+		// Brings the file position back on a block boundary through the cache
+		size_t nHead = BUFFEREDFS_ALIGNMENT - static_cast<size_t>(m_qwPosition % BUFFEREDFS_ALIGNMENT);
+
+		if (nHead > m_nBuffered)
+			nHead = m_nBuffered;
+
+		if (!SetDirect(false) || !WriteAt(m_pbBuffer, nHead, m_qwPosition))
+			return false;
+
+		memmove(m_pbBuffer, m_pbBuffer + nHead, m_nBuffered - nHead);
+		m_qwPosition += nHead;
+		m_nBuffered -= nHead;
+	}
+
+	size_t nWritten = 0;
+
+	if (m_bDirect && (m_qwPosition % BUFFEREDFS_ALIGNMENT) == 0)
+	{
+		// Only whole blocks go through direct I/O
+		nWritten = m_nBuffered & ~static_cast<size_t>(BUFFEREDFS_ALIGNMENT - 1);
+
+		if (nWritten > 0 && (!SetDirect(true) || !WriteAt(m_pbBuffer, nWritten, m_qwPosition)))
+			return false;
+	}
+
+	if (nWritten < m_nBuffered && (bAll || !m_bDirect))
+	{
+		// The tail of the file is not aligned, it is written through the cache
+		if (!SetDirect(false) || !WriteAt(m_pbBuffer + nWritten, m_nBuffered - nWritten, m_qwPosition + nWritten))
+			return false;
+
+		nWritten = m_nBuffered;
+	}
+
+	if (nWritten < m_nBuffered)
+		memmove(m_pbBuffer, m_pbBuffer + nWritten, m_nBuffered - nWritten);
+
+	m_qwPosition += nWritten;
+	m_nBuffered -= nWritten;
+	return true;
+}
+
+bool BufferedFileSystem::WriteAt(const uint8_t* pbData, size_t nLength, uint64_t qwPosition)
+{
+	uint64_t qwEnd = qwPosition + nLength;
+
+	while (nLength > 0)
+	{
+		size_t nChunk = nLength > BUFFEREDFS_MAX_IO ? BUFFEREDFS_MAX_IO : nLength;
+
+#ifdef _WIN32
+		OVERLAPPED sOverlapped = {};
+		sOverlapped.Offset = static_cast<DWORD>(qwPosition);
+		sOverlapped.OffsetHigh = static_cast<DWORD>(qwPosition >> 32);
+
+		DWORD dwWritten = 0;
+		if (!WriteFile(m_hFile, pbData, static_cast<DWORD>(nChunk), &dwWritten, &sOverlapped) || dwWritten < 1)
+		{
+			m_bFailed = true;
+			return false;
+		}
+
+		size_t nWritten = dwWritten;
+#else
+		ssize_t nResult = pwrite(m_nFile, pbData, nChunk, static_cast<off_t>(qwPosition));
+		if (nResult < 0 && errno == EINTR)
+			continue;
+
+		if (nResult < 1)
+		{
+			m_bFailed = true;
+			return false;
+		}
+
+		size_t nWritten = static_cast<size_t>(nResult);
+#endif
+
+		pbData += nWritten;
+		nLength -= nWritten;
+		qwPosition += nWritten;
+	}
+
+	if (qwEnd > m_qwSize)
+		m_qwSize = qwEnd;
+
+	return true;
+}
+
+bool BufferedFileSystem::ReadAt(uint8_t* pbOut, size_t nLength, uint64_t qwPosition)
+{
+	// Reads are rare and never aligned, they always go through the cache
+	if (!SetDirect(false))
+		return false;
+
+	while (nLength > 0)
+	{
+		size_t nChunk = nLength > BUFFEREDFS_MAX_IO ? BUFFEREDFS_MAX_IO : nLength;
+
+#ifdef _WIN32
+		OVERLAPPED sOverlapped = {};
+		sOverlapped.Offset = static_cast<DWORD>(qwPosition);
+		sOverlapped.OffsetHigh = static_cast<DWORD>(qwPosition >> 32);
+
+		DWORD dwRead = 0;
+		if (!ReadFile(m_hFile, pbOut, static_cast<DWORD>(nChunk), &dwRead, &sOverlapped) || dwRead < 1)
+			return false;
+
+		size_t nRead = dwRead;
+#else
+		ssize_t nResult = pread(m_nFile, pbOut, nChunk, static_cast<off_t>(qwPosition));
+		if (nResult < 0 && errno == EINTR)
+			continue;
+
+		if (nResult < 1)
+			return false;
+
+		size_t nRead = static_cast<size_t>(nResult);
+#endif
+
+		pbOut += nRead;
+		nLength -= nRead;
+		qwPosition += nRead;
+	}
+
+	return true;
+}
+
+bool BufferedFileSystem::WriteVAt(const FileSystemConstBuffer* pBuffers, size_t nCount, uint64_t qwPosition)
+{
+#ifdef __linux__
+	std::vector<struct iovec> vVectors;
+	vVectors.reserve(nCount);
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		if (pBuffers[i].nLength > 0)
+			vVectors.push_back({ const_cast<uint8_t*>(pBuffers[i].pbData), pBuffers[i].nLength });
+	}
+
+	size_t nIndex = 0;
+
+	while (nIndex < vVectors.size())
+	{
+		int nVectors = static_cast<int>(vVectors.size() - nIndex > IOV_MAX ? IOV_MAX : vVectors.size() - nIndex);
+
+		ssize_t nResult = pwritev(m_nFile, vVectors.data() + nIndex, nVectors, static_cast<off_t>(qwPosition));
+		if (nResult < 0 && errno == EINTR)
+			continue;
+
+		if (nResult < 1)
+		{
+			m_bFailed = true;
+			return false;
+		}
+
+		qwPosition += static_cast<uint64_t>(nResult);
+
+		// Skips what was written, a short write can stop in the middle of a buffer
+		size_t nWritten = static_cast<size_t>(nResult);
+
+		while (nWritten > 0)
+		{
+			struct iovec& sVector = vVectors[nIndex];
+
+			if (nWritten < sVector.iov_len)
+			{
+				sVector.iov_base = reinterpret_cast<uint8_t*>(sVector.iov_base) + nWritten;
+				sVector.iov_len -= nWritten;
+				break;
+			}
+
+			nWritten -= sVector.iov_len;
+			nIndex++;
+		}
+	}
+
+	if (qwPosition > m_qwSize)
+		m_qwSize = qwPosition;
+
+	return true;
+#else
+	for (size_t i = 0; i < nCount; i++)
+	{
+		if (pBuffers[i].nLength > 0 && !WriteAt(pBuffers[i].pbData, pBuffers[i].nLength, qwPosition))
+			return false;
+
+		qwPosition += pBuffers[i].nLength;
+	}
+
+	return true;
+#endif
+}
+
+bool BufferedFileSystem::ReadVAt(const FileSystemBuffer* pBuffers, size_t nCount, uint64_t qwPosition)
+{
+#ifdef __linux__
+	if (!SetDirect(false))
+		return false;
+
+	std::vector<struct iovec> vVectors;
+	vVectors.reserve(nCount);
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		if (pBuffers[i].nLength > 0)
+			vVectors.push_back({ pBuffers[i].pbData, pBuffers[i].nLength });
+	}
+
+	size_t nIndex = 0;
+
+	while (nIndex < vVectors.size())
+	{
+		int nVectors = static_cast<int>(vVectors.size() - nIndex > IOV_MAX ? IOV_MAX : vVectors.size() - nIndex);
+
+		ssize_t nResult = preadv(m_nFile, vVectors.data() + nIndex, nVectors, static_cast<off_t>(qwPosition));
+		if (nResult < 0 && errno == EINTR)
+			continue;
+
+		if (nResult < 1)
+			return false;
+
+		qwPosition += static_cast<uint64_t>(nResult);
+
+		size_t nRead = static_cast<size_t>(nResult);
+
+		while (nRead > 0)
+		{
+			struct iovec& sVector = vVectors[nIndex];
+
+			if (nRead < sVector.iov_len)
+			{
+				sVector.iov_base = reinterpret_cast<uint8_t*>(sVector.iov_base) + nRead;
+				sVector.iov_len -= nRead;
+				break;
+			}
+
+			nRead -= sVector.iov_len;
+			nIndex++;
+		}
+	}
+
+	return true;
+#else
+	for (size_t i = 0; i < nCount; i++)
+	{
+		if (pBuffers[i].nLength > 0 && !ReadAt(pBuffers[i].pbData, pBuffers[i].nLength, qwPosition))
+			return false;
+
+		qwPosition += pBuffers[i].nLength;
+	}
+
+	return true;
+#endif
+}
+
+bool BufferedFileSystem::SetDirect(bool bEnable)
+{
+	if (m_bDirectActive == bEnable)
+		return true;
+
+#if !defined(_WIN32) && defined(O_DIRECT)
+	int nFlags = fcntl(m_nFile, F_GETFL);
+	if (nFlags < 0 || fcntl(m_nFile, F_SETFL, bEnable ? (nFlags | O_DIRECT) : (nFlags & ~O_DIRECT)) != 0)
+		return false;
+
+	m_bDirectActive = bEnable;
+	return true;
+#else
+	return !bEnable;
+#endif
+}
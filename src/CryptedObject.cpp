@@ -10,6 +10,10 @@
 #include <LibLyketo/CryptedObject.hpp>
 
 #include <string.h>
+#include <algorithm>
+
+// Extra output given to a prefix decompression, so a sequence that crosses the wanted length does not fail
+#define CRYPTEDOBJECT_PREFIX_SLACK 65536
 
 CryptedObjectHeader::CryptedObjectHeader() : dwFourCC(0), dwAfterCryptLength(0), dwAfterCompressLength(0), dwRealLength(0) {}
 
@@ -34,6 +38,11 @@ void CryptedObject::SetKeys(const uint32_t* adwKeys)
 }
 
 CryptedObjectErrors CryptedObject::Decrypt(const uint8_t* pbInput, size_t nLength)
+{
+	return Decrypt(pbInput, nLength, m_pBuffer);
+}
+
+CryptedObjectErrors CryptedObject::Decrypt(const uint8_t* pbInput, size_t nLength, std::vector<uint8_t>& pOutput)
 {
 	if (!pbInput || nLength < (sizeof(struct CryptedObjectHeader) + sizeof(uint32_t)))
 		return CryptedObjectErrors::InvalidInput;
@@ -41,17 +50,18 @@ CryptedObjectErrors CryptedObject::Decrypt(const uint8_t* pbInput, size_t nLengt
 	if (!m_pAlgorithm)
 		return CryptedObjectErrors::InvalidAlgorithm;
 
-	m_pBuffer.clear();
+	pOutput.clear();
 
 	m_sHeader = *(struct CryptedObjectHeader*)(pbInput);
 
-	std::vector<uint8_t> pData;
-
 	if (m_sHeader.dwRealLength < 1 || m_sHeader.dwFourCC != m_pAlgorithm->GetFourCC())
 	{
 		return CryptedObjectErrors::InvalidHeader;
 	}
 
+	// Compressed data, prefixed by the FourCC
+	const uint8_t* pbData = pbInput + sizeof(struct CryptedObjectHeader);
+
 	// 1. Decrypt the data
 	if (m_sHeader.dwAfterCryptLength > 0)
 	{
@@ -59,16 +69,20 @@ CryptedObjectErrors CryptedObject::Decrypt(const uint8_t* pbInput, size_t nLengt
 		{
 			return CryptedObjectErrors::InvalidCryptLength;
 		}
-		
-		pData.resize(m_sHeader.dwAfterCompressLength + 20);
-		pData.reserve(m_sHeader.dwAfterCompressLength + 20);
-		
-		m_pAlgorithm->Decrypt(pbInput + sizeof(struct CryptedObjectHeader), pData.data(), m_sHeader.dwAfterCryptLength, m_adwKeys);
 
-		if (*reinterpret_cast<uint32_t*>(pData.data()) != m_sHeader.dwFourCC) // Verify decryptation
+		// The scratch buffer is kept between calls, so decrypting many objects does not allocate every time
+		size_t nDataLength = std::max<size_t>(m_sHeader.dwAfterCompressLength + 20, m_sHeader.dwAfterCryptLength);
+		if (m_pCryptBuffer.size() < nDataLength)
+			m_pCryptBuffer.resize(nDataLength);
+
+		m_pAlgorithm->Decrypt(pbData, m_pCryptBuffer.data(), m_sHeader.dwAfterCryptLength, m_adwKeys);
+
+		if (*reinterpret_cast<uint32_t*>(m_pCryptBuffer.data()) != m_sHeader.dwFourCC) // Verify decryptation
 		{
 			return CryptedObjectErrors::CryptFail;
 		}
+
+		pbData = m_pCryptBuffer.data();
 	}
 
 	// 2. Decompress the data
@@ -79,32 +93,22 @@ CryptedObjectErrors CryptedObject::Decrypt(const uint8_t* pbInput, size_t nLengt
 			return CryptedObjectErrors::InvalidCryptAlgorithm;
 		}
 
-		const uint8_t* inputData = nullptr;
-
-		if (m_sHeader.dwAfterCryptLength < 1) // Data is not encrypted
+		if (m_sHeader.dwAfterCryptLength < 1) // Data is not encrypted, decompress straight from the input
 		{
-			if ((nLength - sizeof(struct CryptedObjectHeader)) != m_sHeader.dwAfterCompressLength)
+			if ((nLength - sizeof(struct CryptedObjectHeader) - sizeof(uint32_t)) != m_sHeader.dwAfterCompressLength) // Header + fourcc
 				return CryptedObjectErrors::InvalidCompressLength;
 
-			pData.clear();
-			pData.reserve(m_sHeader.dwAfterCompressLength + sizeof(uint32_t));
-			pData.resize(m_sHeader.dwAfterCompressLength + sizeof(uint32_t));
-
-			memcpy_s(pData.data(), m_sHeader.dwAfterCompressLength, pbInput + sizeof(struct CryptedObjectHeader), m_sHeader.dwAfterCompressLength);
-
-			if (*reinterpret_cast<uint32_t*>(pData.data()) != m_sHeader.dwFourCC) // Verify decryptation
+			if (*reinterpret_cast<const uint32_t*>(pbData) != m_sHeader.dwFourCC) // Verify decryptation
 			{
 				return CryptedObjectErrors::InvalidFourCC;
 			}
 		}
 
-		inputData = pData.data() + sizeof(uint32_t);
-
-		m_pBuffer.reserve(m_sHeader.dwRealLength);
-		m_pBuffer.resize(m_sHeader.dwRealLength);
+		pOutput.reserve(m_sHeader.dwRealLength);
+		pOutput.resize(m_sHeader.dwRealLength);
 
 		size_t nRealLength = m_sHeader.dwRealLength;
-		if (!m_pAlgorithm->Decompress(inputData, m_pBuffer.data(), m_sHeader.dwAfterCompressLength, &nRealLength))
+		if (!m_pAlgorithm->Decompress(pbData + sizeof(uint32_t), pOutput.data(), m_sHeader.dwAfterCompressLength, &nRealLength))
 		{
 			return CryptedObjectErrors::CompressFail;
 		}
@@ -130,49 +134,184 @@ CryptedObjectErrors CryptedObject::Decrypt(const uint8_t* pbInput, size_t nLengt
 			return CryptedObjectErrors::InvalidRealLength;
 		}
 
-		m_pBuffer.reserve(nRealDataLenCalculated);
-		m_pBuffer.resize(nRealDataLenCalculated);
+		pOutput.reserve(nRealDataLenCalculated);
+		pOutput.resize(nRealDataLenCalculated);
 
-		memcpy_s(m_pBuffer.data(), m_pBuffer.size(), pbInput + sizeof(struct CryptedObjectHeader), m_pBuffer.size());
+		memcpy_s(pOutput.data(), pOutput.size(), pbInput + sizeof(struct CryptedObjectHeader), pOutput.size());
 	}
 
 	return CryptedObjectErrors::Ok;
 }
 
+CryptedObjectErrors CryptedObject::CheckHeader(const uint8_t* pbInput, size_t nLength, uint32_t dwFourCC)
+{
+	if (!pbInput || nLength < (sizeof(struct CryptedObjectHeader) + sizeof(uint32_t)))
+		return CryptedObjectErrors::InvalidInput;
+
+	const struct CryptedObjectHeader* pHeader = reinterpret_cast<const struct CryptedObjectHeader*>(pbInput);
+
+	if (pHeader->dwRealLength < 1 || pHeader->dwFourCC != dwFourCC)
+		return CryptedObjectErrors::InvalidHeader;
+
+	if (pHeader->dwAfterCryptLength > 0)
+	{
+		if ((nLength - sizeof(struct CryptedObjectHeader) - sizeof(uint32_t)) != pHeader->dwAfterCryptLength) // Header + fourcc
+			return CryptedObjectErrors::InvalidCryptLength;
+	}
+	else if (pHeader->dwAfterCompressLength > 0)
+	{
+		if ((nLength - sizeof(struct CryptedObjectHeader) - sizeof(uint32_t)) != pHeader->dwAfterCompressLength) // Header + fourcc
+			return CryptedObjectErrors::InvalidCompressLength;
+	}
+	else if ((nLength - sizeof(struct CryptedObjectHeader)) != pHeader->dwRealLength)
+	{
+		return CryptedObjectErrors::InvalidRealLength;
+	}
+
+	return CryptedObjectErrors::Ok;
+}
+
+CryptedObjectErrors CryptedObject::DecryptPrefix(const uint8_t* pbInput, size_t nLength, size_t nTotalLength, size_t nWanted, std::vector<uint8_t>& pOutput)
+{
+	if (!pbInput || nLength > nTotalLength || nTotalLength < (sizeof(struct CryptedObjectHeader) + sizeof(uint32_t)))
+		return CryptedObjectErrors::InvalidInput;
+
+	if (!m_pAlgorithm)
+		return CryptedObjectErrors::InvalidAlgorithm;
+
+	if (nLength < (sizeof(struct CryptedObjectHeader) + sizeof(uint32_t)))
+		return CryptedObjectErrors::NeedMoreInput;
+
+	CryptedObjectErrors eError = CheckHeader(pbInput, nTotalLength, m_pAlgorithm->GetFourCC());
+	if (eError != CryptedObjectErrors::Ok)
+		return eError;
+
+	m_sHeader = *reinterpret_cast<const struct CryptedObjectHeader*>(pbInput);
+	pOutput.clear();
+
+	if (nWanted > m_sHeader.dwRealLength)
+		nWanted = m_sHeader.dwRealLength;
+
+	// Data is not compressed at all
+	if (m_sHeader.dwAfterCompressLength < 1)
+	{
+		if (nLength - sizeof(struct CryptedObjectHeader) < nWanted)
+			return CryptedObjectErrors::NeedMoreInput;
+
+		pOutput.assign(pbInput + sizeof(struct CryptedObjectHeader), pbInput + sizeof(struct CryptedObjectHeader) + nWanted);
+		return CryptedObjectErrors::Ok;
+	}
+
+	if (!m_pAlgorithm->CanDecompressPrefix())
+	{
+		if (nLength < nTotalLength)
+			return CryptedObjectErrors::NeedMoreInput;
+
+		return Decrypt(pbInput, nLength, pOutput);
+	}
+
+	if (!m_pAlgorithm->HaveCryptation())
+		return CryptedObjectErrors::InvalidCryptAlgorithm;
+
+	// Compressed data, prefixed by the FourCC
+	const uint8_t* pbData = pbInput + sizeof(struct CryptedObjectHeader);
+	size_t nDataLength = nLength - sizeof(struct CryptedObjectHeader);
+
+	if (m_sHeader.dwAfterCryptLength > 0)
+	{
+		// Only whole XTEA blocks can be decrypted
+		nDataLength = std::min<size_t>(nDataLength, m_sHeader.dwAfterCryptLength) & ~static_cast<size_t>(7);
+
+		if (nDataLength < sizeof(uint32_t))
+			return CryptedObjectErrors::NeedMoreInput;
+
+		if (m_pCryptBuffer.size() < nDataLength)
+			m_pCryptBuffer.resize(nDataLength);
+
+		m_pAlgorithm->Decrypt(pbData, m_pCryptBuffer.data(), nDataLength, m_adwKeys);
+		pbData = m_pCryptBuffer.data();
+	}
+
+	if (*reinterpret_cast<const uint32_t*>(pbData) != m_sHeader.dwFourCC) // Verify decryptation
+		return m_sHeader.dwAfterCryptLength > 0 ? CryptedObjectErrors::CryptFail : CryptedObjectErrors::InvalidFourCC;
+
+	size_t nCompressed = std::min<size_t>(nDataLength - sizeof(uint32_t), m_sHeader.dwAfterCompressLength);
+	bool bComplete = nCompressed == m_sHeader.dwAfterCompressLength;
+
+	if (nCompressed < 1)
+		return CryptedObjectErrors::NeedMoreInput;
+
+	size_t nCapacity = std::min<size_t>(m_sHeader.dwRealLength, nWanted + CRYPTEDOBJECT_PREFIX_SLACK);
+
+	while (true)
+	{
+		pOutput.resize(nCapacity);
+
+		size_t nRealLength = nCapacity;
+		bool bDecompressed = m_pAlgorithm->Decompress(pbData + sizeof(uint32_t), pOutput.data(), nCompressed, &nRealLength);
+
+		// Stopping because the output is full is fine, as long as the wanted part was produced
+		if (nRealLength >= nWanted)
+		{
+			if (bDecompressed && bComplete && nRealLength != m_sHeader.dwRealLength)
+				return CryptedObjectErrors::InvalidRealLength;
+
+			pOutput.resize(nRealLength);
+			return CryptedObjectErrors::Ok;
+		}
+
+		// The input is truncated, it's cheaper to read more of it than to guess a bigger output
+		if (!bComplete)
+			return CryptedObjectErrors::NeedMoreInput;
+
+		if (nCapacity >= m_sHeader.dwRealLength)
+			return CryptedObjectErrors::CompressFail;
+
+		nCapacity = std::min<size_t>(m_sHeader.dwRealLength, nCapacity * 2);
+	}
+}
+
 CryptedObjectErrors CryptedObject::Encrypt(const uint8_t* pbInput, size_t nLength, EncryptType sType)
 {
 	if (!pbInput || nLength < 1)
 		return CryptedObjectErrors::InvalidInput;
 
+	if (!m_pAlgorithm)
+		return CryptedObjectErrors::InvalidAlgorithm;
+
 	m_pBuffer.clear();
 
 	m_sHeader.dwFourCC = m_pAlgorithm->GetFourCC();
 	m_sHeader.dwRealLength = static_cast<uint32_t>(nLength);
-
+	m_sHeader.dwAfterCompressLength = 0;
+	m_sHeader.dwAfterCryptLength = 0;
 
 	// 1. Compress the data
 	if (sType != EncryptType::None) {
 		size_t nCompressedSize = m_pAlgorithm->GetWrostSize(nLength);
-		std::vector<uint8_t> pData(nCompressedSize + sizeof(uint32_t));
 
-		if (!m_pAlgorithm->Compress(pbInput, pData.data(), nLength, &nCompressedSize))
+		// FourCC + compressed data, with room for the cryptation padding
+		std::vector<uint8_t> pData(sizeof(uint32_t) + nCompressedSize + 19 + 8);
+
+		if (!m_pAlgorithm->Compress(pbInput, pData.data() + sizeof(uint32_t), nLength, &nCompressedSize))
 		{
 			return CryptedObjectErrors::CompressFail;
 		}
 
 		m_sHeader.dwAfterCompressLength = static_cast<uint32_t>(nCompressedSize);
 
-		memcpy_s(pData.data() + sizeof(uint32_t), nCompressedSize, pData.data(), nCompressedSize);
 		uint32_t* pnFourCC = reinterpret_cast<uint32_t*>(pData.data());
 		*pnFourCC = m_sHeader.dwFourCC;
 
-
 		// 3. Encrypt data
 		if (sType == EncryptType::CompressAndEncrypt && m_pAlgorithm->HaveCryptation())
 		{
-			m_sHeader.dwAfterCryptLength = m_sHeader.dwAfterCompressLength + 20;
+			// Same length as the client: compressed data + 19, aligned to the XTEA block
+			m_sHeader.dwAfterCryptLength = (m_sHeader.dwAfterCompressLength + 19 + 7) & ~static_cast<uint32_t>(7);
 
-			uint32_t nBufferLen = m_sHeader.dwAfterCryptLength + sizeof(struct CryptedObjectHeader);
+			memset(pData.data() + sizeof(uint32_t) + nCompressedSize, 0, m_sHeader.dwAfterCryptLength - sizeof(uint32_t) - nCompressedSize);
+
+			size_t nBufferLen = sizeof(struct CryptedObjectHeader) + sizeof(uint32_t) + m_sHeader.dwAfterCryptLength;
 
 			m_pBuffer.reserve(nBufferLen);
 			m_pBuffer.resize(nBufferLen);
@@ -181,8 +320,7 @@ CryptedObjectErrors CryptedObject::Encrypt(const uint8_t* pbInput, size_t nLengt
 		}
 		else
 		{
-			m_sHeader.dwAfterCryptLength = 0;
-			uint32_t nBufferLen = m_sHeader.dwAfterCompressLength + sizeof(struct CryptedObjectHeader);
+			size_t nBufferLen = sizeof(struct CryptedObjectHeader) + sizeof(uint32_t) + nCompressedSize;
 
 			m_pBuffer.reserve(nBufferLen);
 			m_pBuffer.resize(nBufferLen);
@@ -192,8 +330,10 @@ CryptedObjectErrors CryptedObject::Encrypt(const uint8_t* pbInput, size_t nLengt
 	}
 	else
 	{
-		m_sHeader.dwAfterCompressLength = 0;
-		m_sHeader.dwAfterCryptLength = 0;
+		m_pBuffer.reserve(sizeof(struct CryptedObjectHeader) + nLength);
+		m_pBuffer.resize(sizeof(struct CryptedObjectHeader) + nLength);
+
+		memcpy_s(m_pBuffer.data() + sizeof(struct CryptedObjectHeader), m_pBuffer.size() - sizeof(struct CryptedObjectHeader), pbInput, nLength);
 	}
 
 
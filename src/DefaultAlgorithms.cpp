@@ -53,6 +53,12 @@ bool DefaultAlgorithmLzo1x::HaveCryptation()
 	return true;
 }
 
+bool DefaultAlgorithmLzo1x::CanDecompressPrefix()
+{
+	// lzokay reports the decoded length on input and output overruns
+	return true;
+}
+
 uint32_t DefaultAlgorithmLzo1x::Decrypt(const uint8_t* input, uint8_t* output, size_t size, const uint32_t* key)
 {
 	return XTEA::Decrypt(input, output, size, key, 32);
@@ -11,29 +11,247 @@
 #include <LibLyketo/EterPack.hpp>
 #include <LibLyketo/CryptedObject.hpp>
 
-#include <crc32/Crc32.h>
+#include "FastCrc32.hpp"
+#include "Parallel.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <utility>
 #include <time.h>
 #include <string.h>
-#include <algorithm>
 
 #define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
 
-EterPackFile::EterPackFile() : dwId(0), dwFilenameCRC32(0), dwRealSize(0), dwSize(0), dwCRC32(0), dwPosition(0), bType(0)
+// Minimum number of index entries validated by a single worker
+#define ETERPACK_VALIDATION_CHUNK 4096
+
+// Default decoded size of a block
+#define ETERPACK_BLOCK_SIZE 65536
+
+// Minimum number of blocks decoded by a single worker
+#define ETERPACK_BLOCK_CHUNK 4
+
+// First read of a range inside a CryptedObject, grown until the range can be decoded
+#define ETERPACK_RANGE_READ 4096
+
+// Default length of the chunks passed to a stream sink
+#define ETERPACK_STREAM_CHUNK 65536
+
+// Default decoded size above which CryptedObjects are stored as block encoded files
+#define ETERPACK_BLOCK_THRESHOLD (16 * 1024 * 1024)
+
+// Size of the batches of index entries written by Save
+#define ETERPACK_SAVE_BUFFER (1024 * 1024)
+
+namespace
+{
+	/*
+		SplitMix64, used to fill the padding of the index entries.
+		Unlike rand() its output only depends on the seed, so the same index is always saved in the same way.
+	*/
+	class PaddingGenerator
+	{
+	public:
+		explicit PaddingGenerator(uint64_t qwSeed) : m_qwState(qwSeed), m_qwValue(0), m_nLeft(0) {}
+
+		uint8_t Next()
+		{
+			if (m_nLeft < 1)
+			{
+				uint64_t z = (m_qwState += 0x9E3779B97F4A7C15ULL);
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+				m_qwValue = z ^ (z >> 31);
+				m_nLeft = sizeof(m_qwValue);
+			}
+
+			uint8_t bValue = static_cast<uint8_t>(m_qwValue);
+			m_qwValue >>= 8;
+			m_nLeft--;
+			return bValue;
+		}
+
+	private:
+		uint64_t m_qwState;
+		uint64_t m_qwValue;
+		size_t m_nLeft;
+	};
+}
+
+template <typename T>
+static bool IsValidFile(const T& epf)
+{
+	return FastCrc32::Compute(epf.szFilename, strnlen(epf.szFilename, sizeof(epf.szFilename))) == epf.dwFilenameCRC32;
+}
+
+EterPackFileV2::EterPackFileV2() : dwId(0), dwFilenameCRC32(0), dwRealSize(0), dwSize(0), dwCRC32(0), dwPosition(0), bType(0)
+{
+	memset(szFilename, 0, sizeof(szFilename));
+	memset(bPadding1, 0, sizeof(bPadding1));
+	memset(bPadding2, 0, sizeof(bPadding2));
+}
+
+EterPackFile::EterPackFile() : dwId(0), dwFilenameCRC32(0), dwCRC32(0), qwRealSize(0), qwSize(0), qwPosition(0), bType(0)
 {
 	memset(szFilename, 0, sizeof(szFilename));
 	memset(bPadding1, 0, sizeof(bPadding1));
 	memset(bPadding2, 0, sizeof(bPadding2));
 }
 
+EterPackFile::EterPackFile(const struct EterPackFileV2& sLegacy) : dwId(sLegacy.dwId), dwFilenameCRC32(sLegacy.dwFilenameCRC32), dwCRC32(sLegacy.dwCRC32), qwRealSize(sLegacy.dwRealSize), qwSize(sLegacy.dwSize), qwPosition(sLegacy.dwPosition), bType(sLegacy.bType)
+{
+	memcpy_s(szFilename, sizeof(szFilename), sLegacy.szFilename, sizeof(sLegacy.szFilename));
+	memcpy_s(bPadding1, sizeof(bPadding1), sLegacy.bPadding1, sizeof(sLegacy.bPadding1));
+	memset(bPadding2, 0, sizeof(bPadding2));
+	memcpy_s(bPadding2, sizeof(bPadding2), sLegacy.bPadding2, sizeof(sLegacy.bPadding2));
+}
+
+bool EterPackFile::ToLegacy(struct EterPackFileV2& sLegacy) const
+{
+	if (qwRealSize > UINT32_MAX || qwSize > UINT32_MAX || qwPosition > UINT32_MAX)
+		return false;
+
+	sLegacy.dwId = dwId;
+	memcpy_s(sLegacy.szFilename, sizeof(sLegacy.szFilename), szFilename, sizeof(szFilename));
+	memcpy_s(sLegacy.bPadding1, sizeof(sLegacy.bPadding1), bPadding1, sizeof(bPadding1));
+	sLegacy.dwFilenameCRC32 = dwFilenameCRC32;
+	sLegacy.dwRealSize = static_cast<uint32_t>(qwRealSize);
+	sLegacy.dwSize = static_cast<uint32_t>(qwSize);
+	sLegacy.dwCRC32 = dwCRC32;
+	sLegacy.dwPosition = static_cast<uint32_t>(qwPosition);
+	sLegacy.bType = bType;
+	memcpy_s(sLegacy.bPadding2, sizeof(sLegacy.bPadding2), bPadding2, sizeof(sLegacy.bPadding2));
+
+	return true;
+}
+
 EterPackHeader::EterPackHeader() : dwFourCC(MAKEFOURCC('E', 'P', 'K', 'D')), dwVersion(2), dwElements(0) {}
 
-EterPack::EterPack() : m_pcFS(nullptr), m_sHeader()
+EterPackBlockHeader::EterPackBlockHeader() : dwFourCC(MAKEFOURCC('E', 'P', 'K', 'B')), dwBlockSize(0), dwBlocks(0), bType(0)
+{
+	memset(bPadding, 0, sizeof(bPadding));
+}
+
+/*
+	Validates the header and the block table of a block encoded file.
+	nLength is the full encoded size of the file, only the header and the table must be readable from pbInput.
+*/
+static const struct EterPackBlock* GetBlockTable(const uint8_t* pbInput, size_t nAvailable, size_t nLength, uint64_t qwRealSize, struct EterPackBlockHeader* pHeader)
+{
+	if (nAvailable < sizeof(struct EterPackBlockHeader))
+		return nullptr;
+
+	memcpy_s(pHeader, sizeof(struct EterPackBlockHeader), pbInput, sizeof(struct EterPackBlockHeader));
+
+	if (pHeader->dwFourCC != EterPackBlockHeader().dwFourCC || pHeader->dwBlockSize < 1 || pHeader->bType == Blocks)
+		return nullptr;
+
+	if (pHeader->dwBlocks != (qwRealSize + pHeader->dwBlockSize - 1) / pHeader->dwBlockSize)
+		return nullptr;
+
+	size_t nTableEnd = sizeof(struct EterPackBlockHeader) + (static_cast<size_t>(pHeader->dwBlocks) * sizeof(struct EterPackBlock));
+
+	if (nTableEnd > nAvailable || nTableEnd > nLength)
+		return nullptr;
+
+	const struct EterPackBlock* pTable = reinterpret_cast<const struct EterPackBlock*>(pbInput + sizeof(struct EterPackBlockHeader));
+
+	for (uint32_t i = 0; i < pHeader->dwBlocks; i++)
+	{
+		if (pTable[i].dwPosition < nTableEnd || pTable[i].dwSize < 1 || static_cast<uint64_t>(pTable[i].dwPosition) + pTable[i].dwSize > nLength)
+			return nullptr;
+	}
+
+	return pTable;
+}
+
+/*
+	Gets the part of a block encoded file that contains the blocks [dwFirst, dwLast).
+*/
+static void GetBlocksSpan(const struct EterPackBlock* pTable, uint32_t dwFirst, uint32_t dwLast, size_t* pnStart, size_t* pnEnd)
+{
+	*pnStart = pTable[dwFirst].dwPosition;
+	*pnEnd = 0;
+
+	for (uint32_t i = dwFirst; i < dwLast; i++)
+	{
+		if (pTable[i].dwPosition < *pnStart)
+			*pnStart = pTable[i].dwPosition;
+
+		if (static_cast<size_t>(pTable[i].dwPosition) + pTable[i].dwSize > *pnEnd)
+			*pnEnd = static_cast<size_t>(pTable[i].dwPosition) + pTable[i].dwSize;
+	}
+}
+
+EterPack::EterPack() : m_pcFS(nullptr), m_sHeader(), m_dwVersion(m_sHeader.dwVersion), m_eIndexError(CryptedObjectErrors::Ok), m_bIndexCrypted(false), m_eValidation(EterPackValidation::Full), m_nValidationThreads(0), m_bVerifyOnRead(false), m_nBlockThreads(0), m_nBlockThreshold(ETERPACK_BLOCK_THRESHOLD)
 {
 }
 
 EterPack::~EterPack()
 {
+	JoinValidation();
+}
+
+EterPack::EterPack(const EterPack& cOther) : EterPack()
+{
+	*this = cOther;
+}
+
+EterPack::EterPack(EterPack&& cOther) : EterPack()
+{
+	*this = std::move(cOther);
+}
+
+EterPack& EterPack::operator=(const EterPack& cOther)
+{
+	if (this == &cOther)
+		return *this;
+
+	// The validation thread works on its own pack, the copy gets its result
+	JoinValidation();
+	cOther.JoinValidation();
+
+	m_pcFS = cOther.m_pcFS;
+	m_mFiles = cOther.m_mFiles;
+	m_sHeader = cOther.m_sHeader;
+	m_dwVersion = cOther.m_dwVersion;
+	m_pBuffer = cOther.m_pBuffer;
+	m_cIndexObject = cOther.m_cIndexObject;
+	m_eIndexError = cOther.m_eIndexError;
+	m_bIndexCrypted = cOther.m_bIndexCrypted;
+	m_eValidation = cOther.m_eValidation;
+	m_nValidationThreads = cOther.m_nValidationThreads;
+	m_vInvalidFiles = cOther.m_vInvalidFiles;
+	m_bVerifyOnRead = cOther.m_bVerifyOnRead;
+	m_nBlockThreads = cOther.m_nBlockThreads;
+	m_nBlockThreshold = cOther.m_nBlockThreshold;
+	return *this;
+}
+
+EterPack& EterPack::operator=(EterPack&& cOther)
+{
+	if (this == &cOther)
+		return *this;
+
+	// The validation thread points to the source, so it cannot be moved
+	JoinValidation();
+	cOther.JoinValidation();
+
+	m_pcFS = std::move(cOther.m_pcFS);
+	m_mFiles = std::move(cOther.m_mFiles);
+	m_sHeader = cOther.m_sHeader;
+	m_dwVersion = cOther.m_dwVersion;
+	m_pBuffer = std::move(cOther.m_pBuffer);
+	m_cIndexObject = std::move(cOther.m_cIndexObject);
+	m_eIndexError = cOther.m_eIndexError;
+	m_bIndexCrypted = cOther.m_bIndexCrypted;
+	m_eValidation = cOther.m_eValidation;
+	m_nValidationThreads = cOther.m_nValidationThreads;
+	m_vInvalidFiles = std::move(cOther.m_vInvalidFiles);
+	m_bVerifyOnRead = cOther.m_bVerifyOnRead;
+	m_nBlockThreads = cOther.m_nBlockThreads;
+	m_nBlockThreshold = cOther.m_nBlockThreshold;
+	return *this;
 }
 
 bool EterPack::Load(const uint8_t* pbInput, size_t nLength, std::shared_ptr<IFileSystem> pcFS)
@@ -46,40 +264,163 @@ bool EterPack::Load(const uint8_t* pbInput, size_t nLength, std::shared_ptr<IFil
 	if (pHeader->dwFourCC != m_sHeader.dwFourCC)
 		return false;
 
-	if (pHeader->dwVersion != m_sHeader.dwVersion)
-		return false;
+	// The 64 bit index is detected from its version, the other ones use the older entries
+	bool bWide = pHeader->dwVersion == ETERPACK_VERSION_64;
 
-	if (pHeader->dwElements < 1)
-		return true;
+	if (!bWide && pHeader->dwVersion != m_dwVersion)
+		return false;
 
-	m_sHeader.dwElements = pHeader->dwElements;
+	size_t nEntrySize = bWide ? sizeof(struct EterPackFile) : sizeof(struct EterPackFileV2);
 
-	if ((m_sHeader.dwElements * sizeof(struct EterPackFile)) != (nLength - sizeof(struct EterPackHeader)))
+	if ((static_cast<uint64_t>(pHeader->dwElements) * nEntrySize) != (nLength - sizeof(struct EterPackHeader)))
 		return false;
 
+	// The previous index goes away even when the new one is empty
+	JoinValidation();
+	m_vInvalidFiles.clear();
 	m_mFiles.clear();
 
-	size_t nOffset = sizeof(struct EterPackHeader);
-	for (uint32_t i = 0; i < m_sHeader.dwElements; i++, nOffset += sizeof(struct EterPackFile))
+	// Saving a loaded pack keeps its entry format
+	m_sHeader.dwVersion = pHeader->dwVersion;
+	m_sHeader.dwElements = pHeader->dwElements;
+	m_pcFS = pcFS;
+
+	if (m_sHeader.dwElements < 1)
+		return true;
+
+	if (bWide)
+		LoadEntries(reinterpret_cast<const struct EterPackFile*>(pbInput + sizeof(struct EterPackHeader)));
+	else
+		LoadEntries(reinterpret_cast<const struct EterPackFileV2*>(pbInput + sizeof(struct EterPackHeader)));
+
+	if (m_eValidation == EterPackValidation::Deferred)
 	{
-		EterPackFile epf = *reinterpret_cast<const struct EterPackFile*>(pbInput + nOffset);
+		m_cValidationThread = std::thread([this]()
+		{
+			// Only reads the index, writers join this thread before touching it
+			for (const auto& file : m_mFiles)
+			{
+				if (!IsValidFile(file.second))
+					m_vInvalidFiles.push_back(file.first);
+			}
+		});
+	}
+
+	return true;
+}
 
-		uint32_t dwCalcCrc = crc32_fast(epf.szFilename, strlen(epf.szFilename));
+template <typename T>
+void EterPack::LoadEntries(const T* pEntries)
+{
+	// Entries are validated in place and copied only once, straight into the map
+	std::vector<uint8_t> vValid;
+
+	if (m_eValidation == EterPackValidation::Full)
+	{
+		// Validating an entry does not depend on the others, split it between the workers and merge the result later
+		vValid.resize(m_sHeader.dwElements);
 
-		if (dwCalcCrc != epf.dwFilenameCRC32)
+		Parallel::For(m_sHeader.dwElements, m_nValidationThreads, ETERPACK_VALIDATION_CHUNK, [&vValid, pEntries](size_t nBegin, size_t nEnd)
+		{
+			for (size_t i = nBegin; i < nEnd; i++)
+				vValid[i] = IsValidFile(pEntries[i]) ? 1 : 0;
+		});
+	}
+
+	for (uint32_t i = 0; i < m_sHeader.dwElements; i++)
+	{
+		const T& epf = pEntries[i];
+
+		if (!vValid.empty() && !vValid[i])
 			continue;
 
 		// Map by Filename CRC32
-		m_mFiles[epf.dwFilenameCRC32] = epf;
+		auto res = m_mFiles.emplace(epf.dwFilenameCRC32, EterPackFile(epf));
+		if (res.second)
+			continue;
+
+		// The deferred validation drops invalid entries by key, an invalid duplicate must not hide a valid entry
+		if (m_eValidation == EterPackValidation::Deferred && !IsValidFile(epf) && IsValidFile(res.first->second))
+			continue;
+
+		res.first->second = EterPackFile(epf);
 	}
+}
 
-	m_pcFS = pcFS;
+void EterPack::JoinValidation() const
+{
+	if (m_cValidationThread.joinable())
+		m_cValidationThread.join();
+}
 
-	return true;
+const std::vector<uint32_t>& EterPack::GetInvalidFiles() const
+{
+	JoinValidation();
+	return m_vInvalidFiles;
+}
+
+bool EterPack::WaitValidation()
+{
+	JoinValidation();
+
+	for (uint32_t dwCRC32 : m_vInvalidFiles)
+		m_mFiles.erase(dwCRC32);
+
+	return m_vInvalidFiles.empty();
+}
+
+bool EterPack::LoadIndex(const uint8_t* pbInput, size_t nLength, std::shared_ptr<IFileSystem> pcFS, const uint32_t* adwKeys, uint32_t dwLzo1xFourcc, uint32_t dwSnappyFourcc)
+{
+	m_bIndexCrypted = false;
+	m_eIndexError = CryptedObjectErrors::Ok;
+
+	if (!pbInput || nLength < sizeof(uint32_t))
+		return false;
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = nullptr;
+
+	if (dwLzo1xFourcc == 0)
+		dwLzo1xFourcc = MAKEFOURCC('M', 'C', 'O', 'Z');
+
+	if (dwSnappyFourcc == 0)
+		dwSnappyFourcc = MAKEFOURCC('M', 'C', 'S', 'P');
+
+	uint32_t dwFourCC = DefaultAlgorithms::GetFourCC(pbInput);
+
+	if (dwFourCC == dwLzo1xFourcc)
+	{
+		pAlgorithm = std::make_shared<DefaultAlgorithmLzo1x>();
+	}
+	else if (dwFourCC == dwSnappyFourcc)
+	{
+		pAlgorithm = std::make_shared<DefaultAlgorithmSnappy>();
+	}
+	else
+	{
+		// Plain index
+		return Load(pbInput, nLength, pcFS);
+	}
+
+	pAlgorithm->ChangeFourCC(dwFourCC);
+	m_cIndexObject.SetAlgorithm(pAlgorithm);
+
+	if (adwKeys)
+		m_cIndexObject.SetKeys(adwKeys);
+
+	m_bIndexCrypted = true;
+
+	m_eIndexError = m_cIndexObject.Decrypt(pbInput, nLength, m_pBuffer);
+	if (m_eIndexError != CryptedObjectErrors::Ok)
+		return false;
+
+	return Load(m_pBuffer.data(), m_pBuffer.size(), pcFS);
 }
 
 bool EterPack::Create(std::shared_ptr<IFileSystem> pcFS)
 {
+	JoinValidation();
+	m_vInvalidFiles.clear();
+
 	m_mFiles.clear();
 	m_pcFS = pcFS;
 	return true;
@@ -96,25 +437,327 @@ const EterPackFile* EterPack::GetInfo(uint32_t dwCRC32)
 
 bool EterPack::Get(EterPackFile sInfo, const uint32_t* adwKeys, uint32_t dwFourcc)
 {
-	if (!m_pcFS->Seek(sInfo.dwPosition, SeekOffset::Start))
+	if (sInfo.qwSize > SIZE_MAX || sInfo.qwRealSize > SIZE_MAX)
+		return false;
+
+	if (!m_pcFS->Seek(sInfo.qwPosition, SeekOffset::Start))
 		return false;
 
 	m_pBuffer.clear();
 
 	std::vector<uint8_t> cData;
 
-	cData.resize(sInfo.dwSize);
-	cData.reserve(sInfo.dwSize);
+	cData.resize(static_cast<size_t>(sInfo.qwSize));
+	cData.reserve(static_cast<size_t>(sInfo.qwSize));
+
+	m_pBuffer.resize(static_cast<size_t>(sInfo.qwRealSize));
+	m_pBuffer.reserve(static_cast<size_t>(sInfo.qwRealSize));
+
+	if (!m_pcFS->Read(cData.data(), cData.size()))
+	{
+		return false;
+	}
+
+	if (m_bVerifyOnRead && FastCrc32::Compute(cData.data(), cData.size()) != sInfo.dwCRC32)
+	{
+		return false;
+	}
+
+	return DecryptFile(cData.data(), cData.size(), m_pBuffer.data(), m_pBuffer.size(), static_cast<EterPackTypes>(sInfo.bType), adwKeys, dwFourcc);
+}
+
+bool EterPack::GetRange(EterPackFile sInfo, size_t nOffset, size_t nLength, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	return GetRange(sInfo, nOffset, nLength, m_pBuffer, adwKeys, dwFourcc);
+}
+
+bool EterPack::GetRange(EterPackFile sInfo, size_t nOffset, size_t nLength, std::vector<uint8_t>& pOutput, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	if (sInfo.qwSize > SIZE_MAX || nOffset > sInfo.qwRealSize || nLength > sInfo.qwRealSize - nOffset)
+		return false;
+
+	pOutput.clear();
+
+	if (nLength < 1)
+		return true;
+
+	if (sInfo.bType == Uncompressed)
+	{
+		if (sInfo.qwSize != sInfo.qwRealSize || !m_pcFS->Seek(sInfo.qwPosition + nOffset, SeekOffset::Start))
+			return false;
+
+		pOutput.resize(nLength);
+		return m_pcFS->Read(pOutput.data(), nLength);
+	}
+	else if (sInfo.bType == Blocks)
+	{
+		return GetBlocksRange(sInfo, nOffset, nLength, pOutput, adwKeys, dwFourcc);
+	}
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = CreateAlgorithm(static_cast<EterPackTypes>(sInfo.bType), dwFourcc);
+	if (!pAlgorithm)
+		return false;
+
+	CryptedObject obj;
+	obj.SetAlgorithm(pAlgorithm);
+
+	if (adwKeys)
+		obj.SetKeys(adwKeys);
+
+	if (!m_pcFS->Seek(sInfo.qwPosition, SeekOffset::Start))
+		return false;
+
+	// Read the object a piece at a time, until it's long enough to decode the range
+	std::vector<uint8_t> cData;
+	size_t nRead = 0;
+	size_t nNext = std::min<size_t>(sInfo.qwSize, std::max<size_t>(ETERPACK_RANGE_READ, ((nOffset + nLength) / 2) + sizeof(struct CryptedObjectHeader) + sizeof(uint32_t)));
+
+	while (true)
+	{
+		cData.resize(nNext);
+
+		if (!m_pcFS->Read(cData.data() + nRead, nNext - nRead))
+			return false;
+
+		nRead = nNext;
+
+		CryptedObjectErrors eError = obj.DecryptPrefix(cData.data(), nRead, sInfo.qwSize, nOffset + nLength, pOutput);
+
+		if (eError == CryptedObjectErrors::Ok)
+			break;
+
+		if (eError != CryptedObjectErrors::NeedMoreInput || nRead >= sInfo.qwSize)
+			return false;
+
+		nNext = std::min<size_t>(sInfo.qwSize, nRead * 2);
+	}
+
+	if (obj.GetHeader().dwRealLength != sInfo.qwRealSize || pOutput.size() < nOffset + nLength)
+		return false;
+
+	if (nOffset > 0)
+		memmove(pOutput.data(), pOutput.data() + nOffset, nLength);
+
+	pOutput.resize(nLength);
+	return true;
+}
+
+bool EterPack::GetStream(EterPackFile sInfo, const EterPackSink& fnSink, size_t nChunkSize, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	if (!fnSink || sInfo.qwSize > SIZE_MAX || sInfo.qwRealSize > SIZE_MAX)
+		return false;
+
+	if (nChunkSize < 1)
+		nChunkSize = ETERPACK_STREAM_CHUNK;
+
+	if (sInfo.bType == Blocks)
+		return GetBlocksStream(sInfo, fnSink, nChunkSize, adwKeys, dwFourcc);
+
+	if (!m_pcFS->Seek(sInfo.qwPosition, SeekOffset::Start))
+		return false;
+
+	if (sInfo.bType == Uncompressed)
+	{
+		if (sInfo.qwSize != sInfo.qwRealSize)
+			return false;
+
+		std::vector<uint8_t> cChunk(std::min<size_t>(nChunkSize, sInfo.qwSize));
+		uint32_t dwCRC32 = 0;
+
+		for (size_t nDone = 0; nDone < sInfo.qwSize;)
+		{
+			size_t nLength = std::min<size_t>(cChunk.size(), sInfo.qwSize - nDone);
+
+			if (!m_pcFS->Read(cChunk.data(), nLength))
+				return false;
+
+			if (m_bVerifyOnRead)
+				dwCRC32 = FastCrc32::Compute(cChunk.data(), nLength, dwCRC32);
+
+			if (!fnSink(cChunk.data(), nLength))
+				return false;
+
+			nDone += nLength;
+		}
+
+		return !m_bVerifyOnRead || dwCRC32 == sInfo.dwCRC32;
+	}
+
+	// CryptedObjects can only be decoded whole, large ones must be stored as blocks to be streamed
+	if (m_nBlockThreshold > 0 && (sInfo.qwRealSize > m_nBlockThreshold || sInfo.qwSize > m_nBlockThreshold))
+		return false;
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = CreateAlgorithm(static_cast<EterPackTypes>(sInfo.bType), dwFourcc);
+
+	if (!pAlgorithm)
+		return false;
 
-	m_pBuffer.resize(sInfo.dwRealSize);
-	m_pBuffer.reserve(sInfo.dwRealSize);
+	std::vector<uint8_t> cData(static_cast<size_t>(sInfo.qwSize)), cOutput;
 
 	if (!m_pcFS->Read(cData.data(), cData.size()))
+		return false;
+
+	if (m_bVerifyOnRead && FastCrc32::Compute(cData.data(), cData.size()) != sInfo.dwCRC32)
+		return false;
+
+	CryptedObject obj;
+	obj.SetAlgorithm(pAlgorithm);
+
+	if (adwKeys)
+		obj.SetKeys(adwKeys);
+
+	if (obj.Decrypt(cData.data(), cData.size(), cOutput) != CryptedObjectErrors::Ok || cOutput.size() != sInfo.qwRealSize)
+		return false;
+
+	// The input is released before the output is passed to the sink
+	std::vector<uint8_t>().swap(cData);
+
+	for (size_t nDone = 0; nDone < cOutput.size(); nDone += nChunkSize)
 	{
+		if (!fnSink(cOutput.data() + nDone, std::min<size_t>(nChunkSize, cOutput.size() - nDone)))
+			return false;
+	}
+
+	return true;
+}
+
+bool EterPack::GetBlocksStream(const EterPackFile& sInfo, const EterPackSink& fnSink, size_t nChunkSize, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	struct EterPackBlockHeader sHeader;
+	std::vector<uint8_t> cTable;
+	const struct EterPackBlock* pTable = nullptr;
+
+	if (!ReadBlockTable(sInfo, cTable, &sHeader, &pTable))
 		return false;
+
+	uint32_t dwCRC32 = m_bVerifyOnRead ? FastCrc32::Compute(cTable.data(), cTable.size()) : 0;
+	size_t nVerified = cTable.size();
+
+	// Only a few blocks for each worker are decoded at once, so the memory used does not depend on the size of the file
+	uint32_t dwBatch = static_cast<uint32_t>(Parallel::GetThreadCount(m_nBlockThreads) * ETERPACK_BLOCK_CHUNK);
+	std::vector<uint8_t> cData, cOutput;
+
+	for (uint32_t dwFirst = 0; dwFirst < sHeader.dwBlocks; dwFirst += dwBatch)
+	{
+		uint32_t dwLast = std::min<uint32_t>(sHeader.dwBlocks, dwFirst + dwBatch);
+
+		size_t nStart = 0, nEnd = 0;
+		GetBlocksSpan(pTable, dwFirst, dwLast, &nStart, &nEnd);
+
+		// The CRC32 covers the file in order, blocks that are not stored contiguously cannot be verified while streaming
+		if (m_bVerifyOnRead && nStart != nVerified)
+			return false;
+
+		cData.resize(nEnd - nStart);
+
+		if (!m_pcFS->Seek(sInfo.qwPosition + nStart, SeekOffset::Start) || !m_pcFS->Read(cData.data(), cData.size()))
+			return false;
+
+		if (m_bVerifyOnRead)
+		{
+			dwCRC32 = FastCrc32::Compute(cData.data(), cData.size(), dwCRC32);
+			nVerified = nEnd;
+		}
+
+		size_t nBlocksStart = static_cast<size_t>(dwFirst) * sHeader.dwBlockSize;
+		size_t nBlocksEnd = std::min<size_t>(static_cast<size_t>(dwLast) * sHeader.dwBlockSize, sInfo.qwRealSize);
+
+		cOutput.resize(nBlocksEnd - nBlocksStart);
+
+		if (!DecryptBlocks(cData.data(), nStart, sHeader, pTable, dwFirst, dwLast, cOutput.data(), static_cast<size_t>(sInfo.qwRealSize), adwKeys, dwFourcc))
+			return false;
+
+		for (size_t nDone = 0; nDone < cOutput.size(); nDone += nChunkSize)
+		{
+			if (!fnSink(cOutput.data() + nDone, std::min<size_t>(nChunkSize, cOutput.size() - nDone)))
+				return false;
+		}
 	}
 
-	return DecryptFile(cData.data(), sInfo.dwSize, m_pBuffer.data(), sInfo.dwRealSize, static_cast<EterPackTypes>(sInfo.bType), adwKeys, dwFourcc);
+	return !m_bVerifyOnRead || (nVerified == sInfo.qwSize && dwCRC32 == sInfo.dwCRC32);
+}
+
+bool EterPack::ReadBlockTable(const EterPackFile& sInfo, std::vector<uint8_t>& cTable, EterPackBlockHeader* pHeader, const EterPackBlock** ppTable)
+{
+	cTable.resize(sizeof(struct EterPackBlockHeader));
+
+	if (sInfo.qwSize < cTable.size() || !m_pcFS->Seek(sInfo.qwPosition, SeekOffset::Start) || !m_pcFS->Read(cTable.data(), cTable.size()))
+		return false;
+
+	const struct EterPackBlockHeader* pRawHeader = reinterpret_cast<const struct EterPackBlockHeader*>(cTable.data());
+	uint64_t qwTableEnd = sizeof(struct EterPackBlockHeader) + (static_cast<uint64_t>(pRawHeader->dwBlocks) * sizeof(struct EterPackBlock));
+
+	if (qwTableEnd > sInfo.qwSize)
+		return false;
+
+	cTable.resize(static_cast<size_t>(qwTableEnd));
+
+	if (!m_pcFS->Read(cTable.data() + sizeof(struct EterPackBlockHeader), cTable.size() - sizeof(struct EterPackBlockHeader)))
+		return false;
+
+	*ppTable = GetBlockTable(cTable.data(), cTable.size(), sInfo.qwSize, sInfo.qwRealSize, pHeader);
+	return *ppTable != nullptr;
+}
+
+bool EterPack::GetBlocksRange(const EterPackFile& sInfo, size_t nOffset, size_t nLength, std::vector<uint8_t>& pOutput, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	struct EterPackBlockHeader sHeader;
+	std::vector<uint8_t> cTable;
+	const struct EterPackBlock* pTable = nullptr;
+
+	if (!ReadBlockTable(sInfo, cTable, &sHeader, &pTable))
+		return false;
+
+	// Read only the blocks that cover the range
+	uint32_t dwFirst = static_cast<uint32_t>(nOffset / sHeader.dwBlockSize);
+	uint32_t dwLast = static_cast<uint32_t>((nOffset + nLength - 1) / sHeader.dwBlockSize) + 1;
+
+	size_t nStart = 0, nEnd = 0;
+	GetBlocksSpan(pTable, dwFirst, dwLast, &nStart, &nEnd);
+
+	std::vector<uint8_t> cData(nEnd - nStart);
+
+	if (!m_pcFS->Seek(sInfo.qwPosition + nStart, SeekOffset::Start) || !m_pcFS->Read(cData.data(), cData.size()))
+		return false;
+
+	size_t nBlocksStart = static_cast<size_t>(dwFirst) * sHeader.dwBlockSize;
+	size_t nBlocksEnd = static_cast<size_t>(dwLast) * sHeader.dwBlockSize;
+
+	if (nBlocksEnd > sInfo.qwRealSize)
+		nBlocksEnd = sInfo.qwRealSize;
+
+	pOutput.resize(nBlocksEnd - nBlocksStart);
+
+	if (!DecryptBlocks(cData.data(), nStart, sHeader, pTable, dwFirst, dwLast, pOutput.data(), static_cast<size_t>(sInfo.qwRealSize), adwKeys, dwFourcc))
+		return false;
+
+	if (nOffset > nBlocksStart)
+		memmove(pOutput.data(), pOutput.data() + (nOffset - nBlocksStart), nLength);
+
+	pOutput.resize(nLength);
+	return true;
+}
+
+bool EterPack::DecryptBlocks(const uint8_t* pbInput, size_t nInputBase, const EterPackBlockHeader& sHeader, const EterPackBlock* pTable, uint32_t dwFirst, uint32_t dwLast, uint8_t* pOutput, size_t nRealSize, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	std::atomic<bool> bSuccess(true);
+
+	// Blocks do not depend on each other, every worker decodes its own blocks straight in the output
+	Parallel::For(dwLast - dwFirst, m_nBlockThreads, ETERPACK_BLOCK_CHUNK, [&](size_t nBegin, size_t nEnd)
+	{
+		for (size_t i = nBegin; i < nEnd && bSuccess; i++)
+		{
+			const struct EterPackBlock& sBlock = pTable[dwFirst + i];
+
+			size_t nBlockStart = (dwFirst + i) * static_cast<size_t>(sHeader.dwBlockSize);
+			size_t nBlockLen = nRealSize - nBlockStart < sHeader.dwBlockSize ? nRealSize - nBlockStart : sHeader.dwBlockSize;
+
+			if (!DecryptFile(pbInput + (sBlock.dwPosition - nInputBase), sBlock.dwSize, pOutput + (i * sHeader.dwBlockSize), static_cast<uint32_t>(nBlockLen), static_cast<EterPackTypes>(sHeader.bType), adwKeys, dwFourcc))
+				bSuccess = false;
+		}
+	});
+
+	return bSuccess;
 }
 
 const EterPackFile* EterPack::GetInfo(std::string szFileName)
@@ -122,59 +765,86 @@ const EterPackFile* EterPack::GetInfo(std::string szFileName)
 	if (szFileName.length() < 1)
 		return nullptr;
 
-	std::transform(szFileName.begin(), szFileName.end(), szFileName.begin(), ::tolower);
+	return GetInfo(HashFilename(szFileName));
+}
+
+uint32_t EterPack::HashFilename(const std::string& szFileName)
+{
+	return FastCrc32::ComputeLowercase(szFileName.data(), szFileName.size());
+}
+
+std::shared_ptr<CryptedObjectAlgorithm> EterPack::CreateAlgorithm(EterPackTypes eType, uint32_t dwFourcc)
+{
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = nullptr;
+
+	switch (eType)
+	{
+	case CryptedObject_Snappy:
+		pAlgorithm = std::make_shared<DefaultAlgorithmSnappy>();
+		break;
+	case CryptedObject_Lzo1x:
+	case CryptedObject_Lzo1x_Xtea:
+		pAlgorithm = std::make_shared<DefaultAlgorithmLzo1x>();
+		break;
+	default:
+		return nullptr;
+	}
+
+	if (dwFourcc != 0)
+		pAlgorithm->ChangeFourCC(dwFourcc);
 
-	uint32_t dwCRC = crc32_fast(szFileName.data(), szFileName.size());
+	return pAlgorithm;
+}
 
-	return GetInfo(dwCRC);
+const struct EterPackBlock* EterPack::ParseBlockTable(const uint8_t* pbInput, size_t nLength, uint64_t qwRealSize, struct EterPackBlockHeader* pHeader)
+{
+	if (!pbInput || !pHeader)
+		return nullptr;
+
+	return GetBlockTable(pbInput, nLength, nLength, qwRealSize, pHeader);
 }
 
-bool EterPack::DecryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t* pOutput, uint32_t dwOutputLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc)
+bool EterPack::DecryptFile(const uint8_t* pbInput, size_t nInputLen, uint8_t* pOutput, size_t nOutputLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc)
 {
-	if (!pbInput || !pOutput || dwInputLen < 1 || dwOutputLen < 1)
+	if (!pbInput || !pOutput || nInputLen < 1 || nOutputLen < 1)
 		return false;
 
 	if (bType == Uncompressed) // Raw
 	{
-		if (dwInputLen != dwOutputLen)
+		if (nInputLen != nOutputLen)
 			return false;
 
-		memcpy_s(pOutput, dwOutputLen, pbInput, dwInputLen);
+		memcpy_s(pOutput, nOutputLen, pbInput, nInputLen);
 		return true;
 	}
 	else if (bType == CryptedObject_Lzo1x || bType == CryptedObject_Snappy || bType == CryptedObject_Lzo1x_Xtea) // Crypted object
 	{
 		CryptedObject obj;
-		CryptedObjectAlgorithm* pAlgorithm = nullptr;
+		std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = CreateAlgorithm(bType, dwFourcc);
 
-		if (bType == CryptedObject_Snappy)
-		{
-			pAlgorithm = new DefaultAlgorithmSnappy();
-		}
-		else
-		{
-			pAlgorithm = new DefaultAlgorithmLzo1x();
-		}
+		obj.SetAlgorithm(pAlgorithm);
 
 		if (adwKeys)
 			obj.SetKeys(adwKeys);
 
-		if (dwFourcc != 0)
-			pAlgorithm->ChangeFourCC(dwFourcc);
+		if (obj.Decrypt(pbInput, nInputLen) != CryptedObjectErrors::Ok)
+			return false;
 
-		if (obj.Decrypt(pbInput, dwInputLen) != CryptedObjectErrors::Ok)
-		{
-			delete pAlgorithm;
+		if (obj.GetSize() != nOutputLen)
 			return false;
-		}
 
-		delete pAlgorithm;
+		memcpy_s(pOutput, nOutputLen, obj.GetBuffer(), obj.GetSize());
+		return true;
+	}
+	else if (bType == Blocks)
+	{
+		struct EterPackBlockHeader sHeader;
+		const struct EterPackBlock* pTable = GetBlockTable(pbInput, nInputLen, nInputLen, nOutputLen, &sHeader);
 
-		if (obj.GetSize() != dwOutputLen)
+		if (!pTable)
 			return false;
 
-		memcpy_s(pOutput, dwOutputLen, obj.GetBuffer(), obj.GetSize());
-		return true;
+		return DecryptBlocks(pbInput, 0, sHeader, pTable, 0, sHeader.dwBlocks, pOutput, nOutputLen, adwKeys, dwFourcc);
 	}
 
 	// §TODO
@@ -182,39 +852,24 @@ bool EterPack::DecryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t*
 	return false;
 }
 
-bool EterPack::EncryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t* pOutput, uint32_t* dwOutputLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc)
+bool EterPack::EncryptFile(const uint8_t* pbInput, uint32_t dwInputLen, std::vector<uint8_t>& pOutput, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc)
 {
+	if (!pbInput || dwInputLen < 1)
+		return false;
+
 	if (bType == Uncompressed) // Raw
 	{
-		*dwOutputLen = dwInputLen;
-		pOutput = new uint8_t[dwInputLen];
-
-		if (!pOutput)
-			return false;
-
-		memcpy_s(pOutput, dwInputLen, pbInput, dwInputLen);
+		pOutput.assign(pbInput, pbInput + dwInputLen);
 		return true;
 	}
 	else if (bType == CryptedObject_Lzo1x || bType == CryptedObject_Snappy || bType == CryptedObject_Lzo1x_Xtea) // Crypted object
 	{
 		CryptedObject obj;
-		std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = nullptr;
-
-		if (bType == CryptedObject_Snappy)
-		{
-			pAlgorithm = std::make_shared<DefaultAlgorithmSnappy>();
-		}
-		else
-		{
-			pAlgorithm = std::make_shared<DefaultAlgorithmLzo1x>();
-		}
+		std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = CreateAlgorithm(bType, dwFourcc);
 
 		if (adwKeys)
 			obj.SetKeys(adwKeys);
 
-		if (dwFourcc != 0)
-			pAlgorithm->ChangeFourCC(dwFourcc);
-
 		obj.SetAlgorithm(pAlgorithm);
 
 		EncryptType type = EncryptType::CompressAndEncrypt;
@@ -225,13 +880,7 @@ bool EterPack::EncryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t*
 		if (obj.Encrypt(pbInput, dwInputLen, type) != CryptedObjectErrors::Ok)
 			return false;
 
-		*dwOutputLen = static_cast<uint32_t>(obj.GetSize());
-
-		pOutput = new uint8_t[obj.GetSize()];
-		if (!pOutput)
-			return false;
-
-		memcpy_s(pOutput, obj.GetSize(), obj.GetBuffer(), obj.GetSize());
+		pOutput.assign(obj.GetBuffer(), obj.GetBuffer() + obj.GetSize());
 		return true;	
 	}
 
@@ -242,64 +891,242 @@ bool EterPack::EncryptFile(const uint8_t* pbInput, uint32_t dwInputLen, uint8_t*
 
 bool EterPack::Save()
 {
-	srand(static_cast<unsigned int>(time(0)));
+	m_pBuffer.clear();
+
+	std::vector<uint8_t> cIndex;
+
+	if (!WriteIndex(static_cast<uint64_t>(time(0)), [&cIndex](const uint8_t* pbData, size_t nLength)
+	{
+		cIndex.insert(cIndex.end(), pbData, pbData + nLength);
+		return true;
+	}))
+	{
+		return false;
+	}
+
+	m_pBuffer.swap(cIndex);
+	return true;
+}
+
+bool EterPack::Save(std::shared_ptr<IFileSystem> pcFS, const EterPackSaveOptions& sOptions)
+{
+	if (!pcFS)
+		return false;
+
+	uint64_t qwSeed = sOptions.qwPaddingSeed != 0 ? sOptions.qwPaddingSeed : static_cast<uint64_t>(time(0));
 
+	if (sOptions.eType == Uncompressed)
+	{
+		return WriteIndex(qwSeed, [&pcFS](const uint8_t* pbData, size_t nLength)
+		{
+			return pcFS->Write(pbData, nLength);
+		});
+	}
+
+	// A CryptedObject is encoded whole, the index is built in the pack buffer and written at once
 	m_pBuffer.clear();
+	m_pBuffer.reserve(sizeof(struct EterPackHeader) + (m_mFiles.size() * sizeof(struct EterPackFile)));
+
+	if (!WriteIndex(qwSeed, [this](const uint8_t* pbData, size_t nLength)
+	{
+		m_pBuffer.insert(m_pBuffer.end(), pbData, pbData + nLength);
+		return true;
+	}))
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> cData;
+
+	if (!EncryptFile(m_pBuffer.data(), m_pBuffer.size(), cData, sOptions.eType, sOptions.adwKeys, sOptions.dwFourcc))
+		return false;
 
+	return pcFS->Write(cData.data(), cData.size());
+}
+
+bool EterPack::WriteIndex(uint64_t qwSeed, const EterPackSink& fnSink)
+{
 	m_sHeader.dwElements = static_cast<uint32_t>(m_mFiles.size());
 
-	size_t nBufferSize = (sizeof(struct EterPackFile) * m_sHeader.dwElements) + sizeof(struct EterPackHeader);
-	m_pBuffer.reserve(nBufferSize);
-	m_pBuffer.resize(nBufferSize);
+	bool bWide = m_sHeader.dwVersion == ETERPACK_VERSION_64;
+	size_t nEntrySize = bWide ? sizeof(struct EterPackFile) : sizeof(struct EterPackFileV2);
 
-	auto it = m_mFiles.begin(), end = m_mFiles.end();
-	for (size_t i = 0; i < m_sHeader.dwElements; i++, it++)
+	// Files past 4 GiB need the 64 bit index, fail before the sink receives a partial index
+	if (!bWide)
 	{
-		if (it == end)
-			break;
+		EterPackFileV2 legacy;
 
-		auto info = it->second;
+		for (const auto& file : m_mFiles)
+		{
+			if (!file.second.ToLegacy(legacy))
+				return false;
+		}
+	}
+
+	// Entries are written in large batches instead of one by one
+	std::vector<uint8_t> cBuffer;
+	cBuffer.reserve(std::min<size_t>(ETERPACK_SAVE_BUFFER, sizeof(struct EterPackHeader) + (nEntrySize * m_mFiles.size())));
+
+	const uint8_t* pbHeader = reinterpret_cast<const uint8_t*>(&m_sHeader);
+	cBuffer.insert(cBuffer.end(), pbHeader, pbHeader + sizeof(m_sHeader));
+
+	PaddingGenerator cPadding(qwSeed);
+
+	for (const auto& file : m_mFiles)
+	{
+		auto info = file.second;
 
 		// Padding
-		info.bPadding1[0] = rand() & 0xFF;
-		info.bPadding1[1] = rand() & 0xFF;
-		info.bPadding1[2] = rand() & 0xFF;
-		info.bPadding2[0] = rand() & 0xFF;
-		info.bPadding2[1] = rand() & 0xFF;
-		info.bPadding2[2] = rand() & 0xFF;
-
-		memcpy_s(m_pBuffer.data() + sizeof(struct EterPackHeader) + (i * sizeof(struct EterPackFile)), sizeof(struct EterPackFile), &info, sizeof(info));
+		for (size_t k = 0; k < sizeof(info.bPadding1); k++)
+			info.bPadding1[k] = cPadding.Next();
+
+		for (size_t k = 0; k < sizeof(info.bPadding2); k++)
+			info.bPadding2[k] = cPadding.Next();
+
+		if (cBuffer.size() + nEntrySize > cBuffer.capacity())
+		{
+			if (!fnSink(cBuffer.data(), cBuffer.size()))
+				return false;
+
+			cBuffer.clear();
+		}
+
+		if (bWide)
+		{
+			const uint8_t* pbEntry = reinterpret_cast<const uint8_t*>(&info);
+			cBuffer.insert(cBuffer.end(), pbEntry, pbEntry + sizeof(info));
+			continue;
+		}
+
+		EterPackFileV2 legacy;
+		info.ToLegacy(legacy);
+
+		const uint8_t* pbEntry = reinterpret_cast<const uint8_t*>(&legacy);
+		cBuffer.insert(cBuffer.end(), pbEntry, pbEntry + sizeof(legacy));
 	}
 
-	memcpy_s(m_pBuffer.data(), m_pBuffer.size(), &m_sHeader, sizeof(m_sHeader));
-	return true;
+	return cBuffer.empty() || fnSink(cBuffer.data(), cBuffer.size());
 }
 
 bool EterPack::Put(std::string szFile, const uint8_t* pbContent, uint32_t dwContentLen, EterPackTypes bType, const uint32_t* adwKeys, uint32_t dwFourcc)
 {
-	uint32_t dwLength = 0;
-	uint8_t* pData = nullptr;
+	if (bType == Blocks)
+		return PutBlocks(szFile, pbContent, dwContentLen, CryptedObject_Lzo1x_Xtea, 0, adwKeys, dwFourcc);
+
+	// Large objects are split, so they can be streamed
+	if ((bType == CryptedObject_Lzo1x || bType == CryptedObject_Lzo1x_Xtea || bType == CryptedObject_Snappy) && m_nBlockThreshold > 0 && dwContentLen > m_nBlockThreshold)
+		return PutBlocks(szFile, pbContent, dwContentLen, bType, 0, adwKeys, dwFourcc);
+
+	// Raw content is written straight from the input
+	if (bType == Uncompressed)
+	{
+		if (!pbContent || dwContentLen < 1)
+			return false;
+
+		FileSystemConstBuffer sBuffer = { pbContent, dwContentLen };
+		return WriteFile(szFile, &sBuffer, 1, dwContentLen, bType);
+	}
+
+	std::vector<uint8_t> cData;
+
+	if (!EncryptFile(pbContent, dwContentLen, cData, bType, adwKeys, dwFourcc))
+		return false;
+
+	FileSystemConstBuffer sBuffer = { cData.data(), cData.size() };
+	return WriteFile(szFile, &sBuffer, 1, dwContentLen, bType);
+}
+
+bool EterPack::PutBlocks(std::string szFile, const uint8_t* pbContent, uint32_t dwContentLen, EterPackTypes eBlockType, uint32_t dwBlockSize, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	if (!pbContent || dwContentLen < 1 || eBlockType == Blocks)
+		return false;
+
+	struct EterPackBlockHeader sHeader;
+	sHeader.dwBlockSize = dwBlockSize > 0 ? dwBlockSize : ETERPACK_BLOCK_SIZE;
+	sHeader.dwBlocks = static_cast<uint32_t>((static_cast<uint64_t>(dwContentLen) + sHeader.dwBlockSize - 1) / sHeader.dwBlockSize);
+	sHeader.bType = eBlockType;
 
-	if (!EncryptFile(pbContent, dwContentLen, pData, &dwLength, bType, adwKeys, dwFourcc))
+	std::vector<std::vector<uint8_t>> vBlocks(sHeader.dwBlocks);
+	std::atomic<bool> bSuccess(true);
+
+	Parallel::For(vBlocks.size(), m_nBlockThreads, ETERPACK_BLOCK_CHUNK, [&](size_t nBegin, size_t nEnd)
+	{
+		for (size_t i = nBegin; i < nEnd && bSuccess; i++)
+		{
+			size_t nBlockStart = i * sHeader.dwBlockSize;
+			size_t nBlockLen = dwContentLen - nBlockStart < sHeader.dwBlockSize ? dwContentLen - nBlockStart : sHeader.dwBlockSize;
+
+			if (!EncryptFile(pbContent + nBlockStart, static_cast<uint32_t>(nBlockLen), vBlocks[i], eBlockType, adwKeys, dwFourcc))
+				bSuccess = false;
+		}
+	});
+
+	if (!bSuccess)
 		return false;
 
-	if (!m_pcFS->Write(pData, dwLength))
+	// Header and block table, the blocks are written from their own buffers
+	std::vector<uint8_t> cTable(sizeof(struct EterPackBlockHeader) + (vBlocks.size() * sizeof(struct EterPackBlock)));
+	memcpy_s(cTable.data(), cTable.size(), &sHeader, sizeof(sHeader));
+
+	std::vector<FileSystemConstBuffer> vBuffers;
+	vBuffers.reserve(vBlocks.size() + 1);
+	vBuffers.push_back({ cTable.data(), cTable.size() });
+
+	size_t nPosition = cTable.size();
+	for (size_t i = 0; i < vBlocks.size(); i++)
 	{
-		delete[] pData;
+		if (nPosition + vBlocks[i].size() > UINT32_MAX)
+			return false;
+
+		struct EterPackBlock sBlock;
+		sBlock.dwPosition = static_cast<uint32_t>(nPosition);
+		sBlock.dwSize = static_cast<uint32_t>(vBlocks[i].size());
+
+		memcpy_s(cTable.data() + sizeof(struct EterPackBlockHeader) + (i * sizeof(struct EterPackBlock)), sizeof(struct EterPackBlock), &sBlock, sizeof(sBlock));
+		vBuffers.push_back({ vBlocks[i].data(), vBlocks[i].size() });
+
+		nPosition += vBlocks[i].size();
+	}
+
+	return WriteFile(szFile, vBuffers.data(), vBuffers.size(), dwContentLen, Blocks);
+}
+
+bool EterPack::WriteFile(const std::string& szFile, const FileSystemConstBuffer* pBuffers, size_t nCount, size_t nContentLen, EterPackTypes eType)
+{
+	JoinValidation();
+
+	// A single call for every buffer of the file
+	if (!m_pcFS->WriteV(pBuffers, nCount))
 		return false;
+
+	uint64_t qwSize = 0;
+	uint32_t dwCRC32 = 0;
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		dwCRC32 = FastCrc32::Compute(pBuffers[i].pbData, pBuffers[i].nLength, dwCRC32);
+		qwSize += pBuffers[i].nLength;
 	}
 
 	EterPackFile epf;
-	epf.dwFilenameCRC32 = crc32_fast(szFile.c_str(), szFile.size());
-	epf.bType = bType;
-	epf.dwRealSize = dwContentLen;
-	epf.dwId = static_cast<uint32_t>(m_mFiles.size());
-	epf.dwSize = dwLength;
 	strncpy_s(epf.szFilename, _countof(epf.szFilename), szFile.c_str(), 160);
-	epf.dwCRC32 = crc32_fast(pData, dwLength);
-	epf.dwPosition = static_cast<uint32_t>(m_pcFS->Tell() - dwLength);
 
-	m_mFiles[epf.dwCRC32] = epf;
+	// Names are stored in lowercase, so the filename CRC32 is valid for both Load and GetInfo
+	for (size_t i = 0; epf.szFilename[i]; i++)
+	{
+		if (epf.szFilename[i] >= 'A' && epf.szFilename[i] <= 'Z')
+			epf.szFilename[i] += 'a' - 'A';
+	}
+
+	epf.dwFilenameCRC32 = HashFilename(epf.szFilename);
+	epf.bType = eType;
+	epf.qwRealSize = nContentLen;
+	epf.dwId = static_cast<uint32_t>(m_mFiles.size());
+	epf.qwSize = qwSize;
+	epf.dwCRC32 = dwCRC32;
+	epf.qwPosition = static_cast<uint64_t>(m_pcFS->Tell()) - qwSize;
+
+	m_mFiles[epf.dwFilenameCRC32] = epf;
 
 	return true;
 }
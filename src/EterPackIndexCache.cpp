@@ -0,0 +1,231 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file EterPackIndexCache.cpp
+	Implements a precompiled cache of many EterPack indexes.
+*/
+#include <LibLyketo/EterPackIndexCache.hpp>
+#include <LibLyketo/MappedFile.hpp>
+
+#include "FastCrc32.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+
+// Version 3 stores the modification time with its full resolution
+#define ETERPACK_CACHE_VERSION 3
+
+EterPackCacheStamp::EterPackCacheStamp() : qwSize(0), qwModifiedTime(0), dwHash(0), dwReserved(0) {}
+
+bool EterPackCacheStamp::operator==(const EterPackCacheStamp& sOther) const
+{
+	return qwSize == sOther.qwSize && qwModifiedTime == sOther.qwModifiedTime && dwHash == sOther.dwHash;
+}
+
+EterPackCacheHeader::EterPackCacheHeader() : dwFourCC(MAKEFOURCC('E', 'P', 'I', 'C')), dwVersion(ETERPACK_CACHE_VERSION), dwPacks(0), dwEntries(0), dwCRC32(0), dwReserved(0) {}
+
+EterPackCachePack::EterPackCachePack() : sStamp(), dwFirst(0), dwCount(0)
+{
+	memset(szName, 0, sizeof(szName));
+}
+
+EterPackIndexCache::EterPackIndexCache() : m_pHeader(nullptr), m_pPacks(nullptr), m_pEntries(nullptr)
+{
+}
+
+EterPackIndexCache::~EterPackIndexCache()
+{
+}
+
+bool EterPackIndexCache::Load(const uint8_t* pbInput, size_t nLength, bool bVerify)
+{
+	m_pHeader = nullptr;
+	m_pPacks = nullptr;
+	m_pEntries = nullptr;
+
+	if (!pbInput || nLength < sizeof(struct EterPackCacheHeader))
+		return false;
+
+	const struct EterPackCacheHeader* pHeader = reinterpret_cast<const struct EterPackCacheHeader*>(pbInput);
+	EterPackCacheHeader sExpected;
+
+	if (pHeader->dwFourCC != sExpected.dwFourCC || pHeader->dwVersion != sExpected.dwVersion)
+		return false;
+
+	size_t nExpectedLength = sizeof(struct EterPackCacheHeader) + (static_cast<size_t>(pHeader->dwPacks) * sizeof(struct EterPackCachePack)) + (static_cast<size_t>(pHeader->dwEntries) * sizeof(struct EterPackFile));
+
+	if (nExpectedLength != nLength)
+		return false;
+
+	if (bVerify && FastCrc32::Compute(pbInput + sizeof(struct EterPackCacheHeader), nLength - sizeof(struct EterPackCacheHeader)) != pHeader->dwCRC32)
+		return false;
+
+	const struct EterPackCachePack* pPacks = reinterpret_cast<const struct EterPackCachePack*>(pbInput + sizeof(struct EterPackCacheHeader));
+
+	for (uint32_t i = 0; i < pHeader->dwPacks; i++)
+	{
+		if (static_cast<uint64_t>(pPacks[i].dwFirst) + pPacks[i].dwCount > pHeader->dwEntries)
+			return false;
+	}
+
+	m_pHeader = pHeader;
+	m_pPacks = pPacks;
+	m_pEntries = reinterpret_cast<const struct EterPackFile*>(pbInput + sizeof(struct EterPackCacheHeader) + (pHeader->dwPacks * sizeof(struct EterPackCachePack)));
+
+	return true;
+}
+
+const EterPackFile* EterPackIndexCache::Find(const std::string& szName, const EterPackCacheStamp& sStamp, uint32_t* pdwCount) const
+{
+	if (!m_pHeader || !pdwCount)
+		return nullptr;
+
+	for (uint32_t i = 0; i < m_pHeader->dwPacks; i++)
+	{
+		const struct EterPackCachePack& sPack = m_pPacks[i];
+
+		if (strncmp(sPack.szName, szName.c_str(), sizeof(sPack.szName)) != 0)
+			continue;
+
+		if (sPack.sStamp != sStamp)
+			return nullptr;
+
+		*pdwCount = sPack.dwCount;
+		return m_pEntries + sPack.dwFirst;
+	}
+
+	return nullptr;
+}
+
+void EterPackIndexCache::Clear()
+{
+	// The loaded tables might point to the buffer
+	m_pHeader = nullptr;
+	m_pPacks = nullptr;
+	m_pEntries = nullptr;
+
+	m_vPending.clear();
+	m_pBuffer.clear();
+}
+
+bool EterPackIndexCache::Add(const std::string& szName, const EterPackCacheStamp& sStamp, const EterPack& cPack)
+{
+	if (szName.length() < 1 || szName.length() >= sizeof(EterPackCachePack::szName))
+		return false;
+
+	PendingPack pending;
+	strncpy_s(pending.sPack.szName, _countof(pending.sPack.szName), szName.c_str(), szName.length());
+	pending.sPack.sStamp = sStamp;
+
+	const auto& files = cPack.GetFiles();
+	pending.vEntries.reserve(files.size());
+
+	for (const auto& file : files)
+		pending.vEntries.push_back(file.second);
+
+	m_vPending.push_back(std::move(pending));
+	return true;
+}
+
+bool EterPackIndexCache::Add(const std::string& szName, const EterPackCacheStamp& sStamp, const EterPackFile* pEntries, uint32_t dwCount)
+{
+	if (szName.length() < 1 || szName.length() >= sizeof(EterPackCachePack::szName) || (!pEntries && dwCount > 0))
+		return false;
+
+	PendingPack pending;
+	strncpy_s(pending.sPack.szName, _countof(pending.sPack.szName), szName.c_str(), szName.length());
+	pending.sPack.sStamp = sStamp;
+	pending.vEntries.assign(pEntries, pEntries + dwCount);
+
+	m_vPending.push_back(std::move(pending));
+	return true;
+}
+
+bool EterPackIndexCache::Save()
+{
+	// The loaded tables might point to the buffer
+	m_pHeader = nullptr;
+	m_pPacks = nullptr;
+	m_pEntries = nullptr;
+
+	m_pBuffer.clear();
+
+	EterPackCacheHeader sHeader;
+	sHeader.dwPacks = static_cast<uint32_t>(m_vPending.size());
+
+	for (const auto& pending : m_vPending)
+		sHeader.dwEntries += static_cast<uint32_t>(pending.vEntries.size());
+
+	size_t nPacksOffset = sizeof(struct EterPackCacheHeader);
+	size_t nEntriesOffset = nPacksOffset + (sHeader.dwPacks * sizeof(struct EterPackCachePack));
+	size_t nBufferSize = nEntriesOffset + (static_cast<size_t>(sHeader.dwEntries) * sizeof(struct EterPackFile));
+
+	m_pBuffer.reserve(nBufferSize);
+	m_pBuffer.resize(nBufferSize);
+
+	uint32_t dwFirst = 0;
+	for (size_t i = 0; i < m_vPending.size(); i++)
+	{
+		EterPackCachePack sPack = m_vPending[i].sPack;
+		sPack.dwFirst = dwFirst;
+		sPack.dwCount = static_cast<uint32_t>(m_vPending[i].vEntries.size());
+
+		memcpy_s(m_pBuffer.data() + nPacksOffset + (i * sizeof(struct EterPackCachePack)), sizeof(struct EterPackCachePack), &sPack, sizeof(sPack));
+
+		if (sPack.dwCount > 0)
+			memcpy_s(m_pBuffer.data() + nEntriesOffset + (static_cast<size_t>(dwFirst) * sizeof(struct EterPackFile)), m_pBuffer.size() - nEntriesOffset - (static_cast<size_t>(dwFirst) * sizeof(struct EterPackFile)), m_vPending[i].vEntries.data(), sPack.dwCount * sizeof(struct EterPackFile));
+
+		dwFirst += sPack.dwCount;
+	}
+
+	sHeader.dwCRC32 = FastCrc32::Compute(m_pBuffer.data() + nPacksOffset, m_pBuffer.size() - nPacksOffset);
+	memcpy_s(m_pBuffer.data(), m_pBuffer.size(), &sHeader, sizeof(sHeader));
+
+	return true;
+}
+
+bool EterPackIndexCache::MakeStamp(const std::string& szFilename, EterPackCacheStamp& sStamp, bool bHashContent)
+{
+	sStamp = EterPackCacheStamp();
+
+	// A file rewritten within the same second must get another stamp, so the time keeps its full resolution
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA sData;
+	if (!GetFileAttributesExA(szFilename.c_str(), GetFileExInfoStandard, &sData))
+		return false;
+
+	sStamp.qwSize = (static_cast<uint64_t>(sData.nFileSizeHigh) << 32) | sData.nFileSizeLow;
+	sStamp.qwModifiedTime = (static_cast<uint64_t>(sData.ftLastWriteTime.dwHighDateTime) << 32) | sData.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(szFilename.c_str(), &st) != 0)
+		return false;
+
+	sStamp.qwSize = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+	sStamp.qwModifiedTime = (static_cast<uint64_t>(st.st_mtimespec.tv_sec) * 1000000000) + static_cast<uint64_t>(st.st_mtimespec.tv_nsec);
+#else
+	sStamp.qwModifiedTime = (static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000) + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+#endif
+#endif
+
+	if (bHashContent)
+	{
+		MappedFile file;
+
+		if (!file.Open(szFilename))
+			return false;
+
+		sStamp.dwHash = FastCrc32::Compute(file.GetBuffer(), file.GetSize());
+	}
+
+	return true;
+}
@@ -0,0 +1,293 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file EterPackScrubber.cpp
+	Implements a background integrity checker of EterPack content files.
+*/
+#include <LibLyketo/EterPackScrubber.hpp>
+#include <LibLyketo/ICryptedObjectAlgorithm.hpp>
+
+#include "FastCrc32.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+// Maximum size and number of adjacent files read with a single call
+#define SCRUBBER_BATCH_SIZE (1024 * 1024)
+#define SCRUBBER_BATCH_FILES 64
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	void LowerThreadPriority()
+	{
+#ifdef _WIN32
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+		// On Linux the nice value is per thread
+		setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+	}
+}
+
+EterPackScrubber::EterPackScrubber() : m_pcFS(nullptr), m_dwFourCC(0), m_nBytesPerSecond(0), m_bStop(false), m_bRunning(false), m_qwChecked(0), m_qwCorrupted(0)
+{
+}
+
+EterPackScrubber::~EterPackScrubber()
+{
+	Stop();
+}
+
+bool EterPackScrubber::Start(const EterPack& cPack, std::shared_ptr<IFileSystem> pcFS, EterPackScrubCallback fnCallback, uint32_t dwFourcc, size_t nBytesPerSecond)
+{
+	if (!pcFS)
+		return false;
+
+	Stop();
+
+	const auto& files = cPack.GetFiles();
+
+	m_vFiles.clear();
+	m_vFiles.reserve(files.size());
+
+	for (const auto& file : files)
+		m_vFiles.push_back(file.second);
+
+	// Read the content file sequentially
+	std::sort(m_vFiles.begin(), m_vFiles.end(), [](const EterPackFile& a, const EterPackFile& b) { return a.qwPosition < b.qwPosition; });
+
+	m_pcFS = pcFS;
+	m_fnCallback = fnCallback;
+	m_dwFourCC = dwFourcc;
+	m_nBytesPerSecond = nBytesPerSecond;
+	m_bStop = false;
+	m_qwChecked = 0;
+	m_qwCorrupted = 0;
+	m_bRunning = true;
+
+	m_cThread = std::thread(&EterPackScrubber::Run, this);
+	return true;
+}
+
+void EterPackScrubber::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mStop);
+		m_bStop = true;
+	}
+
+	m_cvStop.notify_all();
+	Wait();
+}
+
+bool EterPackScrubber::Wait()
+{
+	if (m_cThread.joinable())
+		m_cThread.join();
+
+	return m_qwCorrupted == 0;
+}
+
+bool EterPackScrubber::Throttle(size_t nBytes)
+{
+	std::unique_lock<std::mutex> lock(m_mStop);
+
+	if (m_nBytesPerSecond > 0 && nBytes > 0)
+	{
+		auto delay = std::chrono::microseconds((static_cast<uint64_t>(nBytes) * 1000000) / m_nBytesPerSecond);
+		m_cvStop.wait_for(lock, delay, [this]() { return m_bStop; });
+	}
+
+	return !m_bStop;
+}
+
+bool EterPackScrubber::ReadBatch(size_t nFirst, size_t nCount, std::vector<std::vector<uint8_t>>& vData)
+{
+	std::vector<FileSystemBuffer> vBuffers(nCount);
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		vData[i].resize(static_cast<size_t>(m_vFiles[nFirst + i].qwSize));
+		vBuffers[i].pbData = vData[i].data();
+		vBuffers[i].nLength = vData[i].size();
+	}
+
+	return m_pcFS->Seek(m_vFiles[nFirst].qwPosition, SeekOffset::Start) && m_pcFS->ReadV(vBuffers.data(), vBuffers.size());
+}
+
+bool EterPackScrubber::Check(const EterPackFile& sInfo, std::vector<uint8_t>& cData, EterPackScrubErrors* peError)
+{
+	if (FastCrc32::Compute(cData.data(), cData.size()) != sInfo.dwCRC32)
+	{
+		*peError = EterPackScrubErrors::InvalidCRC32;
+		return false;
+	}
+
+	if (sInfo.bType == Uncompressed)
+	{
+		if (sInfo.qwSize != sInfo.qwRealSize)
+		{
+			*peError = EterPackScrubErrors::InvalidSize;
+			return false;
+		}
+
+		return true;
+	}
+
+	if (sInfo.bType == Blocks)
+		return CheckBlocks(sInfo, cData, peError);
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = EterPack::CreateAlgorithm(static_cast<EterPackTypes>(sInfo.bType), m_dwFourCC);
+
+	// Unknown types can only be checked with the CRC32
+	if (!pAlgorithm)
+		return true;
+
+	if (CryptedObject::CheckHeader(cData.data(), cData.size(), pAlgorithm->GetFourCC()) != CryptedObjectErrors::Ok)
+	{
+		*peError = EterPackScrubErrors::InvalidHeader;
+		return false;
+	}
+
+	if (reinterpret_cast<const struct CryptedObjectHeader*>(cData.data())->dwRealLength != sInfo.qwRealSize)
+	{
+		*peError = EterPackScrubErrors::InvalidSize;
+		return false;
+	}
+
+	return true;
+}
+
+bool EterPackScrubber::CheckBlocks(const EterPackFile& sInfo, std::vector<uint8_t>& cData, EterPackScrubErrors* peError)
+{
+	struct EterPackBlockHeader sHeader;
+	const struct EterPackBlock* pTable = EterPack::ParseBlockTable(cData.data(), cData.size(), sInfo.qwRealSize, &sHeader);
+
+	if (!pTable)
+	{
+		*peError = EterPackScrubErrors::InvalidHeader;
+		return false;
+	}
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = EterPack::CreateAlgorithm(static_cast<EterPackTypes>(sHeader.bType), m_dwFourCC);
+
+	// Every block is a standalone file, all but the last one hold dwBlockSize bytes (the table has a block for every dwBlockSize bytes of qwRealSize)
+	uint64_t qwRemaining = sInfo.qwRealSize;
+
+	for (uint32_t i = 0; i < sHeader.dwBlocks; i++)
+	{
+		const uint8_t* pbBlock = cData.data() + pTable[i].dwPosition;
+		uint64_t qwExpected = std::min<uint64_t>(qwRemaining, sHeader.dwBlockSize);
+		uint64_t qwRealLength = pTable[i].dwSize;
+
+		if (pAlgorithm)
+		{
+			if (CryptedObject::CheckHeader(pbBlock, pTable[i].dwSize, pAlgorithm->GetFourCC()) != CryptedObjectErrors::Ok)
+			{
+				*peError = EterPackScrubErrors::InvalidHeader;
+				return false;
+			}
+
+			qwRealLength = reinterpret_cast<const struct CryptedObjectHeader*>(pbBlock)->dwRealLength;
+		}
+		else if (sHeader.bType != Uncompressed)
+		{
+			// Unknown types can only be checked with the CRC32
+			return true;
+		}
+
+		if (qwRealLength != qwExpected)
+		{
+			*peError = EterPackScrubErrors::InvalidSize;
+			return false;
+		}
+
+		qwRemaining -= qwExpected;
+	}
+
+	return true;
+}
+
+void EterPackScrubber::Report(const EterPackFile& sInfo, EterPackScrubErrors eError)
+{
+	m_qwCorrupted++;
+
+	if (m_fnCallback)
+		m_fnCallback(sInfo, eError);
+}
+
+void EterPackScrubber::Run()
+{
+	LowerThreadPriority();
+
+	std::vector<std::vector<uint8_t>> vData(SCRUBBER_BATCH_FILES);
+	size_t nIndex = 0;
+
+	while (nIndex < m_vFiles.size())
+	{
+		const auto& first = m_vFiles[nIndex];
+
+		if (first.qwSize > SIZE_MAX)
+		{
+			Report(first, EterPackScrubErrors::ReadFail);
+			m_qwChecked++;
+			nIndex++;
+			continue;
+		}
+
+		// Files stored one after the other are read together
+		size_t nCount = 1;
+		uint64_t qwLength = first.qwSize;
+
+		while (nIndex + nCount < m_vFiles.size() && nCount < SCRUBBER_BATCH_FILES)
+		{
+			const auto& prev = m_vFiles[nIndex + nCount - 1];
+			const auto& next = m_vFiles[nIndex + nCount];
+
+			if (next.qwPosition != prev.qwPosition + prev.qwSize || qwLength + next.qwSize > SCRUBBER_BATCH_SIZE)
+				break;
+
+			qwLength += next.qwSize;
+			nCount++;
+		}
+
+		if (ReadBatch(nIndex, nCount, vData))
+		{
+			for (size_t i = 0; i < nCount; i++)
+			{
+				EterPackScrubErrors eError = EterPackScrubErrors::ReadFail;
+
+				if (!Check(m_vFiles[nIndex + i], vData[i], &eError))
+					Report(m_vFiles[nIndex + i], eError);
+			}
+		}
+		else
+		{
+			// Finds out which files cannot be read
+			for (size_t i = 0; i < nCount; i++)
+			{
+				EterPackScrubErrors eError = EterPackScrubErrors::ReadFail;
+
+				if (!ReadBatch(nIndex + i, 1, vData) || !Check(m_vFiles[nIndex + i], vData[0], &eError))
+					Report(m_vFiles[nIndex + i], eError);
+			}
+		}
+
+		m_qwChecked += nCount;
+		nIndex += nCount;
+
+		if (!Throttle(static_cast<size_t>(qwLength)))
+			break;
+	}
+
+	m_bRunning = false;
+}
@@ -0,0 +1,268 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file FastCrc32.cpp
+	Implements an hardware accelerated IEEE CRC32.
+*/
+#include "FastCrc32.hpp"
+
+#include <crc32/Crc32.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FASTCRC32_X86
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define FASTCRC32_ARM
+#include <arm_acle.h>
+#include <string.h>
+#endif
+
+#if defined(FASTCRC32_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FASTCRC32_TARGET_PCLMUL __attribute__((target("sse4.1,pclmul")))
+#else
+#define FASTCRC32_TARGET_PCLMUL
+#endif
+
+// Buffers smaller than this are not worth the folding setup
+#define FASTCRC32_MIN_FOLD_LENGTH 64
+
+namespace
+{
+#if !defined(FASTCRC32_ARM)
+	struct Crc32Table
+	{
+		uint32_t adwTable[256];
+
+		Crc32Table()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t dwCrc = i;
+
+				for (int k = 0; k < 8; k++)
+					dwCrc = (dwCrc >> 1) ^ (0xEDB88320 & (0 - (dwCrc & 1)));
+
+				adwTable[i] = dwCrc;
+			}
+		}
+	};
+
+	const Crc32Table& GetTable()
+	{
+		static const Crc32Table sTable;
+		return sTable;
+	}
+#endif
+
+#ifdef FASTCRC32_X86
+	bool HavePclmul()
+	{
+		static const bool bHave = []()
+		{
+			unsigned int ecx = 0;
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			ecx = static_cast<unsigned int>(info[2]);
+#else
+			unsigned int eax, ebx, edx;
+			if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+				return false;
+#endif
+			// PCLMULQDQ (bit 1) and SSE4.1 (bit 19)
+			return (ecx & (1 << 1)) != 0 && (ecx & (1 << 19)) != 0;
+		}();
+
+		return bHave;
+	}
+
+	/*
+		Folds 16 bytes blocks with carry-less multiplication, then reduces the result with Barrett reduction.
+		See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel), the constants are the ones
+		of the bit-reflected IEEE polynomial.
+
+		nLength must be a multiple of 16 and at least 64, dwCrc is the inverted CRC state.
+	*/
+	FASTCRC32_TARGET_PCLMUL uint32_t FoldPclmul(const uint8_t* pbData, size_t nLength, uint32_t dwCrc)
+	{
+		alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+		alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+		alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+		alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+		__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+		x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x00));
+		x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x10));
+		x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x20));
+		x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x30));
+
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(dwCrc)));
+
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+		pbData += 64;
+		nLength -= 64;
+
+		// Fold 4 blocks in parallel
+		while (nLength >= 64)
+		{
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+			x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+			x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+			y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x00));
+			y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x10));
+			y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x20));
+			y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData + 0x30));
+
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+			pbData += 64;
+			nLength -= 64;
+		}
+
+		// Fold the 4 blocks into one
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+		// Fold the remaining blocks one by one
+		while (nLength >= 16)
+		{
+			x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pbData));
+
+			x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+			pbData += 16;
+			nLength -= 16;
+		}
+
+		// 128 bits to 64 bits
+		x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+		x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+		x1 = _mm_srli_si128(x1, 8);
+		x1 = _mm_xor_si128(x1, x2);
+
+		x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, x3);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		// Barrett reduction to 32 bits
+		x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+		x2 = _mm_and_si128(x1, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+		x2 = _mm_and_si128(x2, x3);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+	}
+#endif
+}
+
+uint32_t FastCrc32::Compute(const void* pData, size_t nLength, uint32_t dwPrevious)
+{
+	const uint8_t* pbData = reinterpret_cast<const uint8_t*>(pData);
+
+#if defined(FASTCRC32_X86)
+	if (nLength >= FASTCRC32_MIN_FOLD_LENGTH && HavePclmul())
+	{
+		size_t nFold = nLength & ~static_cast<size_t>(15);
+
+		dwPrevious = ~FoldPclmul(pbData, nFold, ~dwPrevious);
+		pbData += nFold;
+		nLength -= nFold;
+
+		if (nLength < 1)
+			return dwPrevious;
+	}
+#elif defined(FASTCRC32_ARM)
+	if (nLength >= FASTCRC32_MIN_FOLD_LENGTH)
+	{
+		uint32_t dwCrc = ~dwPrevious;
+
+		for (; nLength >= 8; nLength -= 8, pbData += 8)
+		{
+			uint64_t qwValue;
+			memcpy(&qwValue, pbData, sizeof(qwValue));
+			dwCrc = __crc32d(dwCrc, qwValue);
+		}
+
+		for (; nLength > 0; nLength--, pbData++)
+			dwCrc = __crc32b(dwCrc, *pbData);
+
+		return ~dwCrc;
+	}
+#endif
+
+	return crc32_fast(pbData, nLength, dwPrevious);
+}
+
+uint32_t FastCrc32::ComputeLowercase(const char* szData, size_t nLength)
+{
+#if !defined(FASTCRC32_ARM)
+	const uint32_t* adwTable = GetTable().adwTable;
+#endif
+	uint32_t dwCrc = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < nLength; i++)
+	{
+		uint8_t bChar = static_cast<uint8_t>(szData[i]);
+
+		if (bChar >= 'A' && bChar <= 'Z')
+			bChar += 'a' - 'A';
+
+#if defined(FASTCRC32_ARM)
+		dwCrc = __crc32b(dwCrc, bChar);
+#else
+		dwCrc = (dwCrc >> 8) ^ adwTable[(dwCrc ^ bChar) & 0xFF];
+#endif
+	}
+
+	return ~dwCrc;
+}
+
+const char* FastCrc32::GetImplementation()
+{
+#if defined(FASTCRC32_X86)
+	return HavePclmul() ? "pclmulqdq" : "table";
+#elif defined(FASTCRC32_ARM)
+	return "armv8-crc32";
+#else
+	return "table";
+#endif
+}
@@ -0,0 +1,28 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*!
+	IEEE CRC32 (the same value as crc32_fast) with hardware acceleration.
+
+	Large buffers use carry-less multiplication folding (PCLMULQDQ) on x86 or the CRC32 instructions on ARMv8,
+	selected at runtime; everything else falls back to crc32_fast.
+*/
+class FastCrc32
+{
+public:
+	static uint32_t Compute(const void* pData, size_t nLength, uint32_t dwPrevious = 0);
+
+	/*!
+		Computes the CRC32 of the ASCII lowercase version of a string without copying it.
+
+		Used to hash filenames, which are short, so it never goes through the folding kernel.
+	*/
+	static uint32_t ComputeLowercase(const char* szData, size_t nLength);
+
+	static const char* GetImplementation();
+};
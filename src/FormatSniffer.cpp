@@ -0,0 +1,200 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file FormatSniffer.cpp
+	Implements a detector of the format, algorithm and key of a file from its first bytes.
+*/
+#include <LibLyketo/FormatSniffer.hpp>
+#include <LibLyketo/DefaultAlgorithms.hpp>
+
+#include <string.h>
+
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+
+// FourCC, version, stride, elements and CryptedObject size
+#define FORMATSNIFFER_MAX_PROTO_HEADER (sizeof(uint32_t) * 5)
+
+// Size of an XTEA block
+#define FORMATSNIFFER_BLOCK 8
+
+FormatSnifferResult::FormatSnifferResult() : eFormat(SniffedFormat::Unknown), dwFourCC(0), dwVersion(0), dwStride(0), dwElements(0), bHaveObject(false), nObjectOffset(0), sObjectHeader(), dwAlgorithmFourCC(0), bEncrypted(false), nKey(-1)
+{
+}
+
+FormatSniffer::FormatSniffer() : m_dwFccItemProto(0), m_dwFccItemProtoOld(0), m_dwFccMobProto(0), m_dwFccEterPack(0)
+{
+	m_pLzo1x = std::make_shared<DefaultAlgorithmLzo1x>();
+	m_pSnappy = std::make_shared<DefaultAlgorithmSnappy>();
+
+	SetFourCCs(0, 0, 0, 0, 0, 0);
+}
+
+FormatSniffer::~FormatSniffer()
+{
+	m_pLzo1x = nullptr;
+	m_pSnappy = nullptr;
+}
+
+void FormatSniffer::SetFourCCs(uint32_t dwItem, uint32_t dwItemOld, uint32_t dwMob, uint32_t dwEterPack, uint32_t dwLzo1x, uint32_t dwSnappy)
+{
+	m_dwFccItemProto = dwItem ? dwItem : MAKEFOURCC('M', 'I', 'P', 'X');
+	m_dwFccItemProtoOld = dwItemOld ? dwItemOld : MAKEFOURCC('M', 'I', 'P', 'T');
+	m_dwFccMobProto = dwMob ? dwMob : MAKEFOURCC('M', 'M', 'P', 'T');
+	m_dwFccEterPack = dwEterPack ? dwEterPack : MAKEFOURCC('E', 'P', 'K', 'D');
+
+	m_pLzo1x->ChangeFourCC(dwLzo1x ? dwLzo1x : MAKEFOURCC('M', 'C', 'O', 'Z'));
+	m_pSnappy->ChangeFourCC(dwSnappy ? dwSnappy : MAKEFOURCC('M', 'C', 'S', 'P'));
+}
+
+int FormatSniffer::AddKey(const uint32_t* adwKeys, SniffedFormat eFormat)
+{
+	if (!adwKeys)
+		return -1;
+
+	struct FormatSnifferKey sKey;
+	memcpy_s(sKey.adwKeys, sizeof(sKey.adwKeys), adwKeys, 16);
+	sKey.eFormat = eFormat;
+
+	m_vKeys.push_back(sKey);
+	return static_cast<int>(m_vKeys.size() - 1);
+}
+
+void FormatSniffer::ClearKeys()
+{
+	m_vKeys.clear();
+}
+
+size_t FormatSniffer::GetWantedLength()
+{
+	return FORMATSNIFFER_MAX_PROTO_HEADER + sizeof(struct CryptedObjectHeader) + FORMATSNIFFER_BLOCK;
+}
+
+bool FormatSniffer::Sniff(const uint8_t* pbInput, size_t nLength, FormatSnifferResult& sResult) const
+{
+	sResult = FormatSnifferResult();
+
+	if (!pbInput || nLength < sizeof(uint32_t))
+		return false;
+
+	sResult.dwFourCC = *reinterpret_cast<const uint32_t*>(pbInput);
+
+	if (sResult.dwFourCC == m_dwFccEterPack)
+	{
+		sResult.eFormat = SniffedFormat::EterPackIndex;
+		return true;
+	}
+
+	SniffedFormat eFormat = SniffedFormat::Unknown;
+	size_t nHeaderSize = sizeof(uint32_t);
+
+	if (sResult.dwFourCC == m_dwFccItemProto)
+	{
+		eFormat = SniffedFormat::ItemProto;
+		nHeaderSize += sizeof(uint32_t) * 2;
+	}
+	else if (sResult.dwFourCC == m_dwFccItemProtoOld)
+		eFormat = SniffedFormat::ItemProto_Old;
+	else if (sResult.dwFourCC == m_dwFccMobProto)
+		eFormat = SniffedFormat::MobProto;
+
+	if (eFormat == SniffedFormat::Unknown)
+	{
+		// Not a proto, it might be a bare object
+		if (!SniffObject(pbInput, nLength, sResult))
+			return false;
+
+		sResult.eFormat = SniffedFormat::CryptedObject;
+
+		if (sResult.nKey >= 0)
+			sResult.eFormat = m_vKeys[sResult.nKey].eFormat;
+
+		return true;
+	}
+
+	if (nLength < nHeaderSize + sizeof(uint32_t) * 2)
+		return false;
+
+	if (eFormat == SniffedFormat::ItemProto)
+	{
+		sResult.dwVersion = *reinterpret_cast<const uint32_t*>(pbInput + sizeof(uint32_t));
+		sResult.dwStride = *reinterpret_cast<const uint32_t*>(pbInput + sizeof(uint32_t) * 2);
+	}
+
+	sResult.eFormat = eFormat;
+	sResult.dwElements = *reinterpret_cast<const uint32_t*>(pbInput + nHeaderSize);
+
+	uint32_t dwObjectSize = *reinterpret_cast<const uint32_t*>(pbInput + nHeaderSize + sizeof(uint32_t));
+	nHeaderSize += sizeof(uint32_t) * 2;
+
+	// The proto is identified by its FourCC, a broken object only leaves the object fields empty
+	size_t nObjectLength = nLength - nHeaderSize;
+	if (nObjectLength > dwObjectSize)
+		nObjectLength = dwObjectSize;
+
+	if (SniffObject(pbInput + nHeaderSize, nObjectLength, sResult))
+		sResult.nObjectOffset = nHeaderSize;
+
+	return true;
+}
+
+bool FormatSniffer::SniffObject(const uint8_t* pbInput, size_t nLength, FormatSnifferResult& sResult) const
+{
+	if (nLength < sizeof(struct CryptedObjectHeader) + sizeof(uint32_t))
+		return false;
+
+	struct CryptedObjectHeader sHeader = *reinterpret_cast<const struct CryptedObjectHeader*>(pbInput);
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = nullptr;
+
+	if (sHeader.dwFourCC == m_pLzo1x->GetFourCC())
+		pAlgorithm = m_pLzo1x;
+	else if (sHeader.dwFourCC == m_pSnappy->GetFourCC())
+		pAlgorithm = m_pSnappy;
+	else
+		return false;
+
+	if (sHeader.dwRealLength < 1)
+		return false;
+
+	const uint8_t* pbData = pbInput + sizeof(struct CryptedObjectHeader);
+	bool bEncrypted = sHeader.dwAfterCryptLength > 0;
+
+	if (bEncrypted)
+	{
+		// Only compressed data is encrypted, in whole blocks
+		if (sHeader.dwAfterCompressLength < 1 || (sHeader.dwAfterCryptLength % FORMATSNIFFER_BLOCK) != 0 || nLength < sizeof(struct CryptedObjectHeader) + FORMATSNIFFER_BLOCK)
+			return false;
+	}
+	else if (sHeader.dwAfterCompressLength > 0 && *reinterpret_cast<const uint32_t*>(pbData) != sHeader.dwFourCC)
+	{
+		// Compressed data is prefixed by the FourCC
+		return false;
+	}
+
+	sResult.bHaveObject = true;
+	sResult.sObjectHeader = sHeader;
+	sResult.dwAlgorithmFourCC = sHeader.dwFourCC;
+	sResult.bEncrypted = bEncrypted;
+	sResult.nKey = -1;
+
+	if (!bEncrypted)
+		return true;
+
+	uint8_t abBlock[FORMATSNIFFER_BLOCK], abPlain[FORMATSNIFFER_BLOCK];
+	memcpy_s(abBlock, sizeof(abBlock), pbData, FORMATSNIFFER_BLOCK);
+
+	for (size_t i = 0; i < m_vKeys.size(); i++)
+	{
+		pAlgorithm->Decrypt(abBlock, abPlain, FORMATSNIFFER_BLOCK, m_vKeys[i].adwKeys);
+
+		// The decrypted data starts with the FourCC, like in CryptedObject::Decrypt
+		if (*reinterpret_cast<const uint32_t*>(abPlain) == sHeader.dwFourCC)
+		{
+			sResult.nKey = static_cast<int>(i);
+			break;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,116 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file MappedFile.cpp
+	Implements a read-only memory mapped file.
+*/
+#include <LibLyketo/MappedFile.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : m_hFile(INVALID_HANDLE_VALUE), m_hMapping(nullptr), m_pbData(nullptr), m_nSize(0)
+#else
+MappedFile::MappedFile() : m_nFile(-1), m_pbData(nullptr), m_nSize(0)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(std::string szFilename)
+{
+	Close();
+
+#ifdef _WIN32
+	m_hFile = CreateFileA(szFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER liSize;
+	if (!GetFileSizeEx(m_hFile, &liSize) || liSize.QuadPart < 1)
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_hMapping)
+	{
+		Close();
+		return false;
+	}
+
+	m_pbData = reinterpret_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_pbData)
+	{
+		Close();
+		return false;
+	}
+
+	m_nSize = static_cast<size_t>(liSize.QuadPart);
+#else
+	m_nFile = open(szFilename.c_str(), O_RDONLY);
+	if (m_nFile < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(m_nFile, &st) != 0 || st.st_size < 1)
+	{
+		Close();
+		return false;
+	}
+
+	void* pData = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, m_nFile, 0);
+	if (pData == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	m_pbData = reinterpret_cast<const uint8_t*>(pData);
+	m_nSize = static_cast<size_t>(st.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_pbData)
+		UnmapViewOfFile(m_pbData);
+
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_hMapping = nullptr;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if (m_pbData)
+		munmap(const_cast<uint8_t*>(m_pbData), m_nSize);
+
+	if (m_nFile >= 0)
+		close(m_nFile);
+
+	m_nFile = -1;
+#endif
+
+	m_pbData = nullptr;
+	m_nSize = 0;
+}
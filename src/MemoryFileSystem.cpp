@@ -0,0 +1,121 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file MemoryFileSystem.cpp
+	Implements an IFileSystem stored in memory.
+*/
+#include <LibLyketo/MemoryFileSystem.hpp>
+
+#include <string.h>
+
+MemoryFileSystem::MemoryFileSystem() : m_pbView(nullptr), m_nViewSize(0), m_nPosition(0)
+{
+}
+
+MemoryFileSystem::~MemoryFileSystem()
+{
+}
+
+void MemoryFileSystem::Create(size_t nReserve)
+{
+	m_pBuffer.clear();
+	m_pBuffer.reserve(nReserve);
+	m_pbView = nullptr;
+	m_nViewSize = 0;
+	m_nPosition = 0;
+}
+
+bool MemoryFileSystem::Open(const uint8_t* pbData, size_t nLength)
+{
+	if (!pbData && nLength > 0)
+		return false;
+
+	m_pBuffer.clear();
+	m_pBuffer.shrink_to_fit();
+
+	// An empty view still has to be read-only
+	static const uint8_t bEmpty = 0;
+	m_pbView = pbData ? pbData : &bEmpty;
+	m_nViewSize = nLength;
+	m_nPosition = 0;
+	return true;
+}
+
+bool MemoryFileSystem::Seek(uint64_t nLength, SeekOffset eOffset)
+{
+	uint64_t qwPosition = nLength;
+
+	if (eOffset == SeekOffset::Current)
+		qwPosition += m_nPosition;
+	else if (eOffset == SeekOffset::End)
+		qwPosition += GetBufferSize();
+
+	// Only a growable file can be positioned past its end, the gap is filled by the next write
+	if (qwPosition > SIZE_MAX || (IsReadOnly() && qwPosition > m_nViewSize))
+		return false;
+
+	m_nPosition = static_cast<size_t>(qwPosition);
+	return true;
+}
+
+bool MemoryFileSystem::Read(uint8_t* pbOut, size_t nLength)
+{
+	size_t nSize = GetBufferSize();
+
+	if (m_nPosition > nSize || nLength > nSize - m_nPosition)
+		return false;
+
+	if (nLength > 0)
+		memcpy_s(pbOut, nLength, GetBuffer() + m_nPosition, nLength);
+
+	m_nPosition += nLength;
+	return true;
+}
+
+bool MemoryFileSystem::Write(const uint8_t* pbData, size_t nLength)
+{
+	if (IsReadOnly() || nLength > SIZE_MAX - m_nPosition)
+		return false;
+
+	if (m_nPosition + nLength > m_pBuffer.size())
+		m_pBuffer.resize(m_nPosition + nLength);
+
+	if (nLength > 0)
+		memcpy_s(m_pBuffer.data() + m_nPosition, m_pBuffer.size() - m_nPosition, pbData, nLength);
+
+	m_nPosition += nLength;
+	return true;
+}
+
+int64_t MemoryFileSystem::Tell()
+{
+	return static_cast<int64_t>(m_nPosition);
+}
+
+bool MemoryFileSystem::WriteV(const FileSystemConstBuffer* pBuffers, size_t nCount)
+{
+	if (IsReadOnly())
+		return false;
+
+	size_t nLength = 0;
+
+	for (size_t i = 0; i < nCount; i++)
+	{
+		if (pBuffers[i].nLength > SIZE_MAX - m_nPosition - nLength)
+			return false;
+
+		nLength += pBuffers[i].nLength;
+	}
+
+	// Grows the file once for the whole group
+	if (m_nPosition + nLength > m_pBuffer.size())
+		m_pBuffer.resize(m_nPosition + nLength);
+
+	return IFileSystem::WriteV(pBuffers, nCount);
+}
+
+int64_t MemoryFileSystem::Size()
+{
+	return static_cast<int64_t>(GetBufferSize());
+}
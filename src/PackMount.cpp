@@ -0,0 +1,198 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file PackMount.cpp
+	Implements a virtual filesystem that serves many EterPacks from a single index.
+*/
+#include <LibLyketo/PackMount.hpp>
+
+#include <string.h>
+
+PackMountEntry::PackMountEntry() : sInfo(), dwSource(0), nPriority(0) {}
+
+PackMountSource::PackMountSource() : pcPack(nullptr), pEntries(nullptr), dwEntries(0), nPriority(0), bHaveKeys(false), dwFourCC(0)
+{
+	memset(adwKeys, 0, sizeof(adwKeys));
+}
+
+PackMount::PackMount() : m_pcLast(nullptr)
+{
+}
+
+PackMount::~PackMount()
+{
+}
+
+bool PackMount::Mount(std::shared_ptr<EterPack> pcPack, int32_t nPriority, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	return Mount(pcPack, nullptr, 0, nPriority, adwKeys, dwFourcc);
+}
+
+bool PackMount::Mount(std::shared_ptr<EterPack> pcPack, const EterPackFile* pEntries, uint32_t dwCount, int32_t nPriority, const uint32_t* adwKeys, uint32_t dwFourcc)
+{
+	if (!pcPack || (!pEntries && dwCount > 0))
+		return false;
+
+	for (const auto& source : m_vSources)
+	{
+		if (source.pcPack == pcPack)
+			return false;
+	}
+
+	PackMountSource source;
+	source.pcPack = pcPack;
+	source.pEntries = pEntries;
+	source.dwEntries = dwCount;
+	source.nPriority = nPriority;
+	source.dwFourCC = dwFourcc;
+
+	if (adwKeys)
+	{
+		memcpy_s(source.adwKeys, sizeof(source.adwKeys), adwKeys, 16);
+		source.bHaveKeys = true;
+	}
+
+	m_vSources.push_back(source);
+	Insert(static_cast<uint32_t>(m_vSources.size() - 1));
+
+	return true;
+}
+
+bool PackMount::Unmount(std::shared_ptr<EterPack> pcPack)
+{
+	auto it = m_vSources.begin(), end = m_vSources.end();
+	for (; it != end; it++)
+	{
+		if (it->pcPack == pcPack)
+			break;
+	}
+
+	if (it == end)
+		return false;
+
+	m_vSources.erase(it);
+
+	if (m_pcLast == pcPack)
+		m_pcLast = nullptr;
+
+	// Source indices changed and overridden files must come back, rebuild the whole table
+	m_mFiles.clear();
+
+	for (uint32_t i = 0; i < m_vSources.size(); i++)
+		Insert(i);
+
+	return true;
+}
+
+void PackMount::Clear()
+{
+	m_mFiles.clear();
+	m_vSources.clear();
+	m_pcLast = nullptr;
+}
+
+void PackMount::Insert(uint32_t dwSource)
+{
+	const PackMountSource& source = m_vSources[dwSource];
+
+	if (source.pEntries)
+	{
+		m_mFiles.reserve(m_mFiles.size() + source.dwEntries);
+
+		for (uint32_t i = 0; i < source.dwEntries; i++)
+			Insert(dwSource, source.pEntries[i]);
+
+		return;
+	}
+
+	const auto& files = source.pcPack->GetFiles();
+
+	m_mFiles.reserve(m_mFiles.size() + files.size());
+
+	for (const auto& file : files)
+		Insert(dwSource, file.second);
+}
+
+void PackMount::Insert(uint32_t dwSource, const EterPackFile& sInfo)
+{
+	int32_t nPriority = m_vSources[dwSource].nPriority;
+
+	auto res = m_mFiles.emplace(sInfo.dwFilenameCRC32, PackMountEntry());
+	PackMountEntry& entry = res.first->second;
+
+	// Overlay: keep the existing file if it comes from a pack with a higher priority
+	if (!res.second && entry.nPriority > nPriority)
+		return;
+
+	entry.sInfo = sInfo;
+	entry.dwSource = dwSource;
+	entry.nPriority = nPriority;
+}
+
+const PackMountEntry* PackMount::GetEntry(uint32_t dwCRC32) const
+{
+	auto it = m_mFiles.find(dwCRC32);
+	if (it == m_mFiles.end())
+		return nullptr;
+
+	return &it->second;
+}
+
+const EterPackFile* PackMount::GetInfo(uint32_t dwCRC32) const
+{
+	const PackMountEntry* pEntry = GetEntry(dwCRC32);
+	if (!pEntry)
+		return nullptr;
+
+	return &pEntry->sInfo;
+}
+
+const EterPackFile* PackMount::GetInfo(std::string szFileName) const
+{
+	if (szFileName.length() < 1)
+		return nullptr;
+
+	return GetInfo(EterPack::HashFilename(szFileName));
+}
+
+bool PackMount::Open(std::string szFileName)
+{
+	if (szFileName.length() < 1)
+		return false;
+
+	return Open(EterPack::HashFilename(szFileName));
+}
+
+bool PackMount::Open(uint32_t dwCRC32)
+{
+	m_pcLast = nullptr;
+
+	const PackMountEntry* pEntry = GetEntry(dwCRC32);
+	if (!pEntry)
+		return false;
+
+	const PackMountSource& source = m_vSources[pEntry->dwSource];
+
+	if (!source.pcPack->Get(pEntry->sInfo, source.bHaveKeys ? source.adwKeys : nullptr, source.dwFourCC))
+		return false;
+
+	m_pcLast = source.pcPack;
+	return true;
+}
+
+const uint8_t* PackMount::GetBuffer() const
+{
+	if (!m_pcLast)
+		return nullptr;
+
+	return m_pcLast->GetBuffer();
+}
+
+size_t PackMount::GetBufferSize() const
+{
+	if (!m_pcLast)
+		return 0;
+
+	return m_pcLast->GetBufferSize();
+}
@@ -0,0 +1,73 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#pragma once
+
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+class Parallel
+{
+public:
+	/*!
+		Gets the number of workers to use.
+
+		@param nThreads Requested number of workers, 0 to use every hardware thread.
+	*/
+	inline static size_t GetThreadCount(size_t nThreads = 0)
+	{
+		if (nThreads < 1)
+			nThreads = std::thread::hardware_concurrency();
+
+		return nThreads < 1 ? 1 : nThreads;
+	}
+
+	/*!
+		Splits the range [0, nCount) in contiguous chunks and runs fn(nBegin, nEnd) on each of them.
+
+		The calling thread processes the first chunk, small ranges are processed without spawning any thread.
+
+		@param nCount Number of elements.
+		@param nThreads Number of workers, 0 to use every hardware thread.
+		@param nMinChunk Minimum number of elements of a chunk.
+		@param fn The function to execute.
+	*/
+	template <typename F>
+	inline static void For(size_t nCount, size_t nThreads, size_t nMinChunk, F fn)
+	{
+		if (nCount < 1)
+			return;
+
+		if (nMinChunk < 1)
+			nMinChunk = 1;
+
+		size_t nWorkers = GetThreadCount(nThreads);
+		size_t nMaxWorkers = (nCount + nMinChunk - 1) / nMinChunk;
+
+		if (nWorkers > nMaxWorkers)
+			nWorkers = nMaxWorkers;
+
+		if (nWorkers < 2)
+		{
+			fn(static_cast<size_t>(0), nCount);
+			return;
+		}
+
+		size_t nChunk = (nCount + nWorkers - 1) / nWorkers;
+
+		std::vector<std::thread> vThreads;
+		vThreads.reserve(nWorkers - 1);
+
+		for (size_t nBegin = nChunk; nBegin < nCount; nBegin += nChunk)
+		{
+			size_t nEnd = nBegin + nChunk < nCount ? nBegin + nChunk : nCount;
+			vThreads.emplace_back(fn, nBegin, nEnd);
+		}
+
+		fn(static_cast<size_t>(0), nChunk < nCount ? nChunk : nCount);
+
+		for (auto& thread : vThreads)
+			thread.join();
+	}
+};
@@ -11,7 +11,10 @@
 
 #define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
 
-Proto::Proto() : m_dwVersion(2), m_dwElements(0), m_dwCryptedObjectSize(0), m_dwCryptedObjectFourCC(0), m_dwStride(156), m_dwFccItemProto(MAKEFOURCC('M', 'I', 'P', 'X')), m_dwFccMobProto(MAKEFOURCC('M', 'M', 'P', 'T')), m_dwFccItemProtoOld(MAKEFOURCC('M', 'I', 'P', 'T')), m_eType(ProtoType::MobProto)
+// FourCC, version, stride, elements and CryptedObject size
+#define PROTO_MAX_HEADER (sizeof(uint32_t) * 5)
+
+Proto::Proto() : m_dwVersion(2), m_dwElements(0), m_dwCryptedObjectSize(0), m_dwCryptedObjectFourCC(0), m_dwStride(156), m_dwFccItemProto(MAKEFOURCC('M', 'I', 'P', 'X')), m_dwFccMobProto(MAKEFOURCC('M', 'M', 'P', 'T')), m_dwFccItemProtoOld(MAKEFOURCC('M', 'I', 'P', 'T')), m_eType(ProtoType::MobProto), m_pbView(nullptr)
 {
 
 }
@@ -22,21 +25,19 @@ Proto::~Proto()
 
 const uint8_t* Proto::GetBuffer() const
 {
-	return m_pBuffer.data();
+	return m_pbView ? m_pbView : m_pBuffer.data();
 }
 
 size_t Proto::GetSize() const
 {
-	return m_pBuffer.size();
+	return m_pbView ? m_dwCryptedObjectSize : m_pBuffer.size();
 }
 
-bool Proto::Unpack(const uint8_t* pbInput, size_t nLength)
+bool Proto::ParseHeader(const uint8_t* pbInput, size_t nLength, size_t* pnHeaderSize)
 {
 	if (!pbInput || nLength < sizeof(uint32_t))
 		return false;
 
-	m_pBuffer.clear();
-
 	// Get FourCC
 	const uint32_t* dwFourCC = reinterpret_cast<const uint32_t*>(pbInput);
 	uint32_t dwHeaderSize = sizeof(uint32_t);
@@ -71,18 +72,45 @@ bool Proto::Unpack(const uint8_t* pbInput, size_t nLength)
 	dwHeaderSize += sizeof(uint32_t) * 2;
 
 	// Get general proto information
-	if (nLength < (m_dwCryptedObjectSize + dwHeaderSize))
+	if (m_dwCryptedObjectSize < sizeof(uint32_t) || nLength - dwHeaderSize < m_dwCryptedObjectSize)
 		return false;
 
 	m_dwCryptedObjectFourCC = *reinterpret_cast<const uint32_t*>(pbInput + dwHeaderSize);
+	*pnHeaderSize = dwHeaderSize;
+	return true;
+}
+
+bool Proto::Unpack(const uint8_t* pbInput, size_t nLength)
+{
+	m_pBuffer.clear();
+	m_pbView = nullptr;
+
+	size_t nHeaderSize = 0;
+
+	if (!ParseHeader(pbInput, nLength, &nHeaderSize))
+		return false;
 
 	m_pBuffer.reserve(m_dwCryptedObjectSize);
 	m_pBuffer.resize(m_dwCryptedObjectSize);
-	memcpy_s(m_pBuffer.data(), m_pBuffer.size(), pbInput + dwHeaderSize, nLength - dwHeaderSize);
+	memcpy_s(m_pBuffer.data(), m_pBuffer.size(), pbInput + nHeaderSize, m_dwCryptedObjectSize);
 
 	return true;
 }
 
+bool Proto::UnpackView(const uint8_t* pbInput, size_t nLength)
+{
+	m_pBuffer.clear();
+	m_pbView = nullptr;
+
+	size_t nHeaderSize = 0;
+
+	if (!ParseHeader(pbInput, nLength, &nHeaderSize))
+		return false;
+
+	m_pbView = pbInput + nHeaderSize;
+	return true;
+}
+
 bool Proto::Create(ProtoType eType, uint32_t dwElements)
 {
 	if (dwElements < 1)
@@ -96,53 +124,86 @@ bool Proto::Create(ProtoType eType, uint32_t dwElements)
 	return true;
 }
 
-bool Proto::Pack(const uint8_t* pCryptBuffer, size_t nLength, ProtoType eType, EncryptType sType)
+size_t Proto::MakeHeader(ProtoType eType, uint8_t* pbHeader, size_t nLength) const
 {
-	if (!pCryptBuffer || nLength < 1)
-		return false;
-
-	m_eType = eType;
 	size_t nHeaderLen = (sizeof(uint32_t) * 3);
-	m_dwCryptedObjectFourCC = *reinterpret_cast<const uint32_t*>(pCryptBuffer);
 
-	if (m_eType == ProtoType::ItemProto)
+	if (eType == ProtoType::ItemProto)
 		nHeaderLen += sizeof(uint32_t) * 2;
 
-	// 1. Store Crypted Object
-	m_pBuffer.reserve(nHeaderLen + nLength);
-	m_pBuffer.resize(nHeaderLen + nLength);
-
-	memcpy_s(m_pBuffer.data() + nHeaderLen, nHeaderLen + nLength, pCryptBuffer, nLength);
-
-	// 2. Copy proto info
-	m_dwCryptedObjectSize = static_cast<uint32_t>(nLength);
+	if (nLength < nHeaderLen)
+		return 0;
 
-	switch (m_eType)
+	switch (eType)
 	{
 	case ProtoType::ItemProto:
-		memcpy_s(m_pBuffer.data(), nHeaderLen, &m_dwFccItemProto, sizeof(m_dwFccItemProto));
+		memcpy_s(pbHeader, nHeaderLen, &m_dwFccItemProto, sizeof(m_dwFccItemProto));
 		break;
 	case ProtoType::ItemProto_Old:
-		memcpy_s(m_pBuffer.data(), nHeaderLen, &m_dwFccItemProtoOld, sizeof(m_dwFccItemProtoOld));
+		memcpy_s(pbHeader, nHeaderLen, &m_dwFccItemProtoOld, sizeof(m_dwFccItemProtoOld));
 		break;
 	case ProtoType::MobProto:
-		memcpy_s(m_pBuffer.data(), nHeaderLen, &m_dwFccMobProto, sizeof(m_dwFccMobProto));
+		memcpy_s(pbHeader, nHeaderLen, &m_dwFccMobProto, sizeof(m_dwFccMobProto));
 		break;
 	default:
-		return false;
+		return 0;
 	}
 
 	size_t offs = sizeof(uint32_t);
-	if (m_eType == ProtoType::ItemProto)
+	if (eType == ProtoType::ItemProto)
 	{
-		memcpy_s(m_pBuffer.data() + sizeof(uint32_t), nHeaderLen - sizeof(uint32_t), &m_dwVersion, sizeof(m_dwVersion));
-		memcpy_s(m_pBuffer.data() + sizeof(uint32_t) + sizeof(uint32_t), nHeaderLen - sizeof(uint32_t) - sizeof(uint32_t), &m_dwStride, sizeof(m_dwStride));
+		memcpy_s(pbHeader + sizeof(uint32_t), nHeaderLen - sizeof(uint32_t), &m_dwVersion, sizeof(m_dwVersion));
+		memcpy_s(pbHeader + sizeof(uint32_t) + sizeof(uint32_t), nHeaderLen - sizeof(uint32_t) - sizeof(uint32_t), &m_dwStride, sizeof(m_dwStride));
 		offs += sizeof(uint32_t) * 2;
 	}
 
-	memcpy_s(m_pBuffer.data() + offs, nHeaderLen - offs, &m_dwElements, sizeof(m_dwElements));
+	memcpy_s(pbHeader + offs, nHeaderLen - offs, &m_dwElements, sizeof(m_dwElements));
 	offs += sizeof(uint32_t);
-	memcpy_s(m_pBuffer.data() + offs, nHeaderLen - offs, &m_dwCryptedObjectSize, sizeof(m_dwCryptedObjectSize));
+	memcpy_s(pbHeader + offs, nHeaderLen - offs, &m_dwCryptedObjectSize, sizeof(m_dwCryptedObjectSize));
+
+	return nHeaderLen;
+}
+
+bool Proto::Pack(const uint8_t* pCryptBuffer, size_t nLength, ProtoType eType, EncryptType sType)
+{
+	if (!pCryptBuffer || nLength < sizeof(uint32_t) || nLength > UINT32_MAX)
+		return false;
+
+	m_eType = eType;
+	m_pbView = nullptr;
+	m_dwCryptedObjectFourCC = *reinterpret_cast<const uint32_t*>(pCryptBuffer);
+	m_dwCryptedObjectSize = static_cast<uint32_t>(nLength);
+
+	uint8_t abHeader[PROTO_MAX_HEADER];
+	size_t nHeaderLen = MakeHeader(eType, abHeader, sizeof(abHeader));
+
+	if (nHeaderLen < 1)
+		return false;
+
+	m_pBuffer.reserve(nHeaderLen + nLength);
+	m_pBuffer.resize(nHeaderLen + nLength);
+
+	memcpy_s(m_pBuffer.data(), m_pBuffer.size(), abHeader, nHeaderLen);
+	memcpy_s(m_pBuffer.data() + nHeaderLen, m_pBuffer.size() - nHeaderLen, pCryptBuffer, nLength);
 
 	return true;
 }
+
+bool Proto::Pack(const uint8_t* pCryptBuffer, size_t nLength, ProtoType eType, std::shared_ptr<IFileSystem> pcFS)
+{
+	if (!pCryptBuffer || !pcFS || nLength < sizeof(uint32_t) || nLength > UINT32_MAX)
+		return false;
+
+	m_eType = eType;
+	m_dwCryptedObjectFourCC = *reinterpret_cast<const uint32_t*>(pCryptBuffer);
+	m_dwCryptedObjectSize = static_cast<uint32_t>(nLength);
+
+	uint8_t abHeader[PROTO_MAX_HEADER];
+	size_t nHeaderLen = MakeHeader(eType, abHeader, sizeof(abHeader));
+
+	if (nHeaderLen < 1)
+		return false;
+
+	FileSystemConstBuffer asBuffers[2] = { { abHeader, nHeaderLen }, { pCryptBuffer, nLength } };
+	return pcFS->WriteV(asBuffers, _countof(asBuffers));
+}
@@ -0,0 +1,230 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoCache.cpp
+	Implements a precompiled cache of a decoded and indexed proto.
+*/
+#include <LibLyketo/ProtoCache.hpp>
+
+#include "FastCrc32.hpp"
+
+#include <string.h>
+
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+
+#define PROTO_CACHE_VERSION 1
+
+// Every section starts on its own cache line
+#define PROTO_CACHE_ALIGNMENT 64
+
+namespace
+{
+	uint64_t Align(uint64_t qwOffset)
+	{
+		return (qwOffset + PROTO_CACHE_ALIGNMENT - 1) & ~static_cast<uint64_t>(PROTO_CACHE_ALIGNMENT - 1);
+	}
+
+	// The section must be inside the cache and not overlap the header
+	bool CheckSection(uint64_t qwOffset, uint64_t qwSize, uint64_t qwLength)
+	{
+		return qwOffset >= sizeof(struct ProtoCacheHeader) && (qwOffset % sizeof(uint32_t)) == 0 && qwOffset <= qwLength && qwSize <= qwLength - qwOffset;
+	}
+}
+
+ProtoCacheHeader::ProtoCacheHeader() : dwFourCC(MAKEFOURCC('P', 'R', 'C', 'H')), dwVersion(PROTO_CACHE_VERSION), dwType(0), dwProtoVersion(0), dwStride(0), dwElements(0), dwSlots(0), dwShift(32), dwCRC32(0), dwReserved(0), sSource(),
+	qwRecordsOffset(0), qwSlotVnumsOffset(0), qwSlotsOffset(0), qwSortedVnumsOffset(0), qwSortedIndexesOffset(0), qwVnumRangesOffset(0), qwLength(0)
+{
+}
+
+ProtoCache::ProtoCache() : m_eType(ProtoType::MobProto), m_dwVersion(0)
+{
+}
+
+ProtoCache::ProtoCache(const ProtoCache& cOther) : m_eType(ProtoType::MobProto), m_dwVersion(0)
+{
+	*this = cOther;
+}
+
+ProtoCache::~ProtoCache()
+{
+}
+
+ProtoCache& ProtoCache::operator=(const ProtoCache& cOther)
+{
+	if (this == &cOther)
+		return *this;
+
+	m_eType = cOther.m_eType;
+	m_dwVersion = cOther.m_dwVersion;
+	m_sSource = cOther.m_sSource;
+	m_cView = cOther.m_cView;
+	m_cIndex = cOther.m_cIndex;
+	m_pBuffer = cOther.m_pBuffer;
+
+	// The view and the index of a created cache must point to the copied buffer
+	if (!m_pBuffer.empty() && !Load(m_pBuffer.data(), m_pBuffer.size(), false))
+		Clear();
+
+	return *this;
+}
+
+void ProtoCache::Clear()
+{
+	m_eType = ProtoType::MobProto;
+	m_dwVersion = 0;
+	m_sSource = EterPackCacheStamp();
+	m_cView = ProtoView();
+	m_cIndex.Clear();
+	m_pBuffer.clear();
+}
+
+bool ProtoCache::Create(ProtoType eType, uint32_t dwVersion, const ProtoView& cView, const ProtoIndex& cIndex, const EterPackCacheStamp& sSource)
+{
+	Clear();
+
+	const ProtoIndexTables& sTables = cIndex.GetTables();
+
+	if (cView.GetLayout() == ProtoLayout::Unknown || cView.GetCount() > UINT32_MAX || sTables.nCount != cView.GetCount() || sTables.nSlots > UINT32_MAX)
+		return false;
+
+	ProtoCacheHeader sHeader;
+	sHeader.dwType = static_cast<uint32_t>(eType);
+	sHeader.dwProtoVersion = dwVersion;
+	sHeader.dwStride = cView.GetStride();
+	sHeader.dwElements = static_cast<uint32_t>(cView.GetCount());
+	sHeader.dwSlots = static_cast<uint32_t>(sTables.nSlots);
+	sHeader.dwShift = sTables.dwShift;
+	sHeader.sSource = sSource;
+
+	uint64_t qwRecords = static_cast<uint64_t>(sHeader.dwElements) * sHeader.dwStride;
+	uint64_t qwSlots = static_cast<uint64_t>(sHeader.dwSlots) * sizeof(uint32_t);
+	uint64_t qwSorted = static_cast<uint64_t>(sHeader.dwElements) * sizeof(uint32_t);
+
+	sHeader.qwRecordsOffset = Align(sizeof(struct ProtoCacheHeader));
+	sHeader.qwSlotVnumsOffset = Align(sHeader.qwRecordsOffset + qwRecords);
+	sHeader.qwSlotsOffset = Align(sHeader.qwSlotVnumsOffset + qwSlots);
+	sHeader.qwSortedVnumsOffset = Align(sHeader.qwSlotsOffset + qwSlots);
+	sHeader.qwSortedIndexesOffset = Align(sHeader.qwSortedVnumsOffset + qwSorted);
+	sHeader.qwLength = sHeader.qwSortedIndexesOffset + qwSorted;
+
+	if (sTables.pVnumRanges)
+	{
+		sHeader.qwVnumRangesOffset = Align(sHeader.qwLength);
+		sHeader.qwLength = sHeader.qwVnumRangesOffset + qwSorted;
+	}
+
+	if (sHeader.qwLength > SIZE_MAX)
+		return false;
+
+	// Padding between the sections stays zeroed, so the checksum does not depend on uninitialized memory
+	m_pBuffer.resize(static_cast<size_t>(sHeader.qwLength), 0);
+	uint8_t* pbBuffer = m_pBuffer.data();
+
+	if (qwRecords > 0)
+		memcpy_s(pbBuffer + sHeader.qwRecordsOffset, static_cast<size_t>(qwRecords), cView.GetRecord(0), static_cast<size_t>(qwRecords));
+
+	if (qwSlots > 0)
+	{
+		memcpy_s(pbBuffer + sHeader.qwSlotVnumsOffset, static_cast<size_t>(qwSlots), sTables.pSlotVnums, static_cast<size_t>(qwSlots));
+		memcpy_s(pbBuffer + sHeader.qwSlotsOffset, static_cast<size_t>(qwSlots), sTables.pSlots, static_cast<size_t>(qwSlots));
+	}
+
+	if (qwSorted > 0)
+	{
+		memcpy_s(pbBuffer + sHeader.qwSortedVnumsOffset, static_cast<size_t>(qwSorted), sTables.pSortedVnums, static_cast<size_t>(qwSorted));
+		memcpy_s(pbBuffer + sHeader.qwSortedIndexesOffset, static_cast<size_t>(qwSorted), sTables.pSortedIndexes, static_cast<size_t>(qwSorted));
+
+		if (sTables.pVnumRanges)
+			memcpy_s(pbBuffer + sHeader.qwVnumRangesOffset, static_cast<size_t>(qwSorted), sTables.pVnumRanges, static_cast<size_t>(qwSorted));
+	}
+
+	sHeader.dwCRC32 = FastCrc32::Compute(pbBuffer + sizeof(struct ProtoCacheHeader), m_pBuffer.size() - sizeof(struct ProtoCacheHeader));
+	memcpy_s(pbBuffer, m_pBuffer.size(), &sHeader, sizeof(sHeader));
+
+	// The created cache can be used right away
+	if (!Load(pbBuffer, m_pBuffer.size(), false))
+	{
+		Clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool ProtoCache::Save(std::shared_ptr<IFileSystem> pcFS) const
+{
+	if (!pcFS || m_pBuffer.empty())
+		return false;
+
+	return pcFS->Write(m_pBuffer.data(), m_pBuffer.size());
+}
+
+bool ProtoCache::Load(const uint8_t* pbInput, size_t nLength, bool bVerify)
+{
+	m_cView = ProtoView();
+	m_cIndex.Clear();
+
+	// Create loads its own buffer, any other input replaces it
+	if (pbInput != m_pBuffer.data())
+		std::vector<uint8_t>().swap(m_pBuffer);
+
+	if (!pbInput || nLength < sizeof(struct ProtoCacheHeader))
+		return false;
+
+	// Only the header is copied, the sections are used in place
+	ProtoCacheHeader sHeader;
+	memcpy_s(&sHeader, sizeof(sHeader), pbInput, sizeof(sHeader));
+
+	ProtoCacheHeader sExpected;
+
+	if (sHeader.dwFourCC != sExpected.dwFourCC || sHeader.dwVersion != sExpected.dwVersion || sHeader.qwLength != nLength)
+		return false;
+
+	if (sHeader.dwType > static_cast<uint32_t>(ProtoType::ItemProto_Old) || sHeader.dwStride < 1)
+		return false;
+
+	uint64_t qwSlots = static_cast<uint64_t>(sHeader.dwSlots) * sizeof(uint32_t);
+	uint64_t qwSorted = static_cast<uint64_t>(sHeader.dwElements) * sizeof(uint32_t);
+
+	if (!CheckSection(sHeader.qwRecordsOffset, static_cast<uint64_t>(sHeader.dwElements) * sHeader.dwStride, nLength) ||
+		!CheckSection(sHeader.qwSlotVnumsOffset, qwSlots, nLength) || !CheckSection(sHeader.qwSlotsOffset, qwSlots, nLength) ||
+		!CheckSection(sHeader.qwSortedVnumsOffset, qwSorted, nLength) || !CheckSection(sHeader.qwSortedIndexesOffset, qwSorted, nLength) ||
+		(sHeader.qwVnumRangesOffset != 0 && !CheckSection(sHeader.qwVnumRangesOffset, qwSorted, nLength)))
+		return false;
+
+	if (bVerify && FastCrc32::Compute(pbInput + sizeof(struct ProtoCacheHeader), nLength - sizeof(struct ProtoCacheHeader)) != sHeader.dwCRC32)
+		return false;
+
+	const uint8_t* pbRecords = pbInput + sHeader.qwRecordsOffset;
+
+	if (!m_cView.Open(static_cast<ProtoType>(sHeader.dwType), sHeader.dwProtoVersion, sHeader.dwStride, sHeader.dwElements, pbRecords, static_cast<size_t>(static_cast<uint64_t>(sHeader.dwElements) * sHeader.dwStride)))
+		return false;
+
+	if (m_cView.GetLayout() == ProtoLayout::Unknown || (sHeader.qwVnumRangesOffset != 0) != (m_cView.GetLayout() == ProtoLayout::ItemR156))
+	{
+		m_cView = ProtoView();
+		return false;
+	}
+
+	ProtoIndexTables sTables;
+	sTables.pSlotVnums = reinterpret_cast<const uint32_t*>(pbInput + sHeader.qwSlotVnumsOffset);
+	sTables.pSlots = reinterpret_cast<const uint32_t*>(pbInput + sHeader.qwSlotsOffset);
+	sTables.nSlots = sHeader.dwSlots;
+	sTables.dwShift = sHeader.dwShift;
+	sTables.pSortedVnums = reinterpret_cast<const uint32_t*>(pbInput + sHeader.qwSortedVnumsOffset);
+	sTables.pSortedIndexes = reinterpret_cast<const uint32_t*>(pbInput + sHeader.qwSortedIndexesOffset);
+	sTables.pVnumRanges = sHeader.qwVnumRangesOffset != 0 ? reinterpret_cast<const uint32_t*>(pbInput + sHeader.qwVnumRangesOffset) : nullptr;
+	sTables.nCount = sHeader.dwElements;
+
+	if (!m_cIndex.Attach(sTables))
+	{
+		m_cView = ProtoView();
+		return false;
+	}
+
+	m_eType = static_cast<ProtoType>(sHeader.dwType);
+	m_dwVersion = sHeader.dwProtoVersion;
+	m_sSource = sHeader.sSource;
+	return true;
+}
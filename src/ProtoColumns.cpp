@@ -0,0 +1,319 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoColumns.cpp
+	Implements a columnar projection of the records of a decoded proto.
+*/
+#include <LibLyketo/ProtoColumns.hpp>
+
+#include "Parallel.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PROTOCOLUMNS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Minimum number of columns projected by a worker
+#define PROTOCOLUMNS_CHUNK 4
+
+// Flips the sign bit, so unsigned values can be ordered with signed comparisons
+#define PROTOCOLUMNS_BIAS 0x80000000U
+
+namespace
+{
+	bool CompareScalar(uint32_t dwField, ProtoCompare eCompare, uint32_t dwValue)
+	{
+		switch (eCompare)
+		{
+		case ProtoCompare::Equal:
+			return dwField == dwValue;
+		case ProtoCompare::NotEqual:
+			return dwField != dwValue;
+		case ProtoCompare::Less:
+			return static_cast<int32_t>(dwField) < static_cast<int32_t>(dwValue);
+		case ProtoCompare::LessEqual:
+			return static_cast<int32_t>(dwField) <= static_cast<int32_t>(dwValue);
+		case ProtoCompare::Greater:
+			return static_cast<int32_t>(dwField) > static_cast<int32_t>(dwValue);
+		case ProtoCompare::GreaterEqual:
+			return static_cast<int32_t>(dwField) >= static_cast<int32_t>(dwValue);
+		case ProtoCompare::HasAllBits:
+			return (dwField & dwValue) == dwValue;
+		case ProtoCompare::HasAnyBits:
+			return (dwField & dwValue) != 0;
+		default:
+			break;
+		}
+
+		return false;
+	}
+
+#ifdef PROTOCOLUMNS_SSE2
+	/*
+		Compares 4 values, the result lanes are all ones when the comparison holds.
+		Ordered comparisons expect biased values for unsigned columns.
+	*/
+	inline __m128i CompareSimd(__m128i xField, ProtoCompare eCompare, __m128i xValue)
+	{
+		const __m128i xOnes = _mm_set1_epi32(-1);
+
+		switch (eCompare)
+		{
+		case ProtoCompare::Equal:
+			return _mm_cmpeq_epi32(xField, xValue);
+		case ProtoCompare::NotEqual:
+			return _mm_xor_si128(_mm_cmpeq_epi32(xField, xValue), xOnes);
+		case ProtoCompare::Less:
+			return _mm_cmplt_epi32(xField, xValue);
+		case ProtoCompare::LessEqual:
+			return _mm_xor_si128(_mm_cmpgt_epi32(xField, xValue), xOnes);
+		case ProtoCompare::Greater:
+			return _mm_cmpgt_epi32(xField, xValue);
+		case ProtoCompare::GreaterEqual:
+			return _mm_xor_si128(_mm_cmplt_epi32(xField, xValue), xOnes);
+		case ProtoCompare::HasAllBits:
+			return _mm_cmpeq_epi32(_mm_and_si128(xField, xValue), xValue);
+		case ProtoCompare::HasAnyBits:
+			return _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(xField, xValue), _mm_setzero_si128()), xOnes);
+		default:
+			break;
+		}
+
+		return _mm_setzero_si128();
+	}
+#endif
+}
+
+ProtoColumns::ProtoColumns() : m_nCount(0)
+{
+}
+
+ProtoColumns::~ProtoColumns()
+{
+}
+
+void ProtoColumns::Clear()
+{
+	m_vFields.clear();
+	m_vData.clear();
+	m_nCount = 0;
+}
+
+bool ProtoColumns::Build(const ProtoView& cView, size_t nThreads)
+{
+	Clear();
+
+	size_t nFields = 0;
+	const ProtoFieldInfo* pFields = ProtoView::GetFields(cView.GetLayout(), &nFields);
+
+	if (!pFields)
+		return false;
+
+	for (size_t i = 0; i < nFields; i++)
+	{
+		if (pFields[i].eType == ProtoFieldType::Unsigned || pFields[i].eType == ProtoFieldType::Signed)
+			m_vFields.push_back(pFields[i]);
+	}
+
+	m_nCount = cView.GetCount();
+	m_vData.resize(m_vFields.size() * m_nCount);
+
+	// Every worker fills whole columns, reading the records with a stride and writing sequentially
+	Parallel::For(m_vFields.size(), nThreads, PROTOCOLUMNS_CHUNK, [&](size_t nBegin, size_t nEnd)
+	{
+		for (size_t c = nBegin; c < nEnd; c++)
+		{
+			const ProtoFieldInfo& field = m_vFields[c];
+			bool bSigned = field.eType == ProtoFieldType::Signed;
+			uint32_t* pdwColumn = m_vData.data() + (c * m_nCount);
+
+			for (size_t i = 0; i < m_nCount; i++)
+			{
+				const uint8_t* pbField = cView.GetRecord(i) + field.dwOffset;
+
+				switch (field.dwSize)
+				{
+				case 1:
+					pdwColumn[i] = bSigned ? static_cast<uint32_t>(static_cast<int32_t>(static_cast<int8_t>(*pbField))) : *pbField;
+					break;
+				case 2:
+				{
+					uint16_t wValue;
+					memcpy_s(&wValue, sizeof(wValue), pbField, sizeof(wValue));
+					pdwColumn[i] = bSigned ? static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(wValue))) : wValue;
+					break;
+				}
+				default:
+					memcpy_s(&pdwColumn[i], sizeof(uint32_t), pbField, sizeof(uint32_t));
+					break;
+				}
+			}
+		}
+	});
+
+	return true;
+}
+
+int ProtoColumns::FindColumn(const char* szName) const
+{
+	if (!szName)
+		return -1;
+
+	for (size_t i = 0; i < m_vFields.size(); i++)
+	{
+		if (strcmp(m_vFields[i].szName, szName) == 0)
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+const uint32_t* ProtoColumns::GetColumn(size_t nColumn) const
+{
+	if (nColumn >= m_vFields.size())
+		return nullptr;
+
+	return m_vData.data() + (nColumn * m_nCount);
+}
+
+bool ProtoColumns::Filter(size_t nColumn, ProtoCompare eCompare, uint32_t dwValue, std::vector<uint8_t>& vSelection) const
+{
+	const uint32_t* pdwColumn = GetColumn(nColumn);
+
+	if (!pdwColumn)
+		return false;
+
+	if (vSelection.size() != m_nCount)
+		vSelection.assign(m_nCount, 0xFF);
+
+	bool bOrdered = eCompare == ProtoCompare::Less || eCompare == ProtoCompare::LessEqual || eCompare == ProtoCompare::Greater || eCompare == ProtoCompare::GreaterEqual;
+	uint32_t dwBias = (bOrdered && m_vFields[nColumn].eType == ProtoFieldType::Unsigned) ? PROTOCOLUMNS_BIAS : 0;
+	uint8_t* pbSelection = vSelection.data();
+	size_t i = 0;
+
+#ifdef PROTOCOLUMNS_SSE2
+	const __m128i xBias = _mm_set1_epi32(static_cast<int32_t>(dwBias));
+	const __m128i xValue = _mm_set1_epi32(static_cast<int32_t>(dwValue ^ dwBias));
+
+	// 16 records for each step, the 4 comparison masks are narrowed to 16 bytes
+	for (; i + 16 <= m_nCount; i += 16)
+	{
+		__m128i x0 = CompareSimd(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pdwColumn + i)), xBias), eCompare, xValue);
+		__m128i x1 = CompareSimd(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pdwColumn + i + 4)), xBias), eCompare, xValue);
+		__m128i x2 = CompareSimd(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pdwColumn + i + 8)), xBias), eCompare, xValue);
+		__m128i x3 = CompareSimd(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pdwColumn + i + 12)), xBias), eCompare, xValue);
+
+		__m128i xMask = _mm_packs_epi16(_mm_packs_epi32(x0, x1), _mm_packs_epi32(x2, x3));
+		__m128i* pxSelection = reinterpret_cast<__m128i*>(pbSelection + i);
+
+		_mm_storeu_si128(pxSelection, _mm_and_si128(_mm_loadu_si128(pxSelection), xMask));
+	}
+#endif
+
+	for (; i < m_nCount; i++)
+	{
+		if (!CompareScalar(pdwColumn[i] ^ dwBias, eCompare, dwValue ^ dwBias))
+			pbSelection[i] = 0;
+	}
+
+	return true;
+}
+
+size_t ProtoColumns::Count(const std::vector<uint8_t>& vSelection) const
+{
+	const uint8_t* pbSelection = vSelection.data();
+	size_t nLength = vSelection.size();
+	size_t nCount = 0;
+	size_t i = 0;
+
+#ifdef PROTOCOLUMNS_SSE2
+	const __m128i xOne = _mm_set1_epi8(1);
+	__m128i xTotal = _mm_setzero_si128();
+
+	// Sums the low bit of every byte, 16 records for each step
+	for (; i + 16 <= nLength; i += 16)
+	{
+		__m128i xBits = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pbSelection + i)), xOne);
+		xTotal = _mm_add_epi64(xTotal, _mm_sad_epu8(xBits, _mm_setzero_si128()));
+	}
+
+	nCount += static_cast<size_t>(_mm_cvtsi128_si32(xTotal)) + static_cast<size_t>(_mm_cvtsi128_si32(_mm_srli_si128(xTotal, 8)));
+#endif
+
+	for (; i < nLength; i++)
+		nCount += pbSelection[i] & 1;
+
+	return nCount;
+}
+
+bool ProtoColumns::IsSelected(const std::vector<uint8_t>* pvSelection, size_t nIndex) const
+{
+	return !pvSelection || pvSelection->size() != m_nCount || (*pvSelection)[nIndex] != 0;
+}
+
+int64_t ProtoColumns::GetValue(size_t nColumn, size_t nIndex) const
+{
+	uint32_t dwValue = m_vData[(nColumn * m_nCount) + nIndex];
+
+	if (m_vFields[nColumn].eType == ProtoFieldType::Signed)
+		return static_cast<int32_t>(dwValue);
+
+	return dwValue;
+}
+
+int64_t ProtoColumns::Sum(size_t nColumn, const std::vector<uint8_t>* pvSelection) const
+{
+	if (nColumn >= m_vFields.size())
+		return 0;
+
+	int64_t nSum = 0;
+
+	for (size_t i = 0; i < m_nCount; i++)
+	{
+		// Branchless, so the compiler can vectorize the loop
+		int64_t nMask = IsSelected(pvSelection, i) ? -1 : 0;
+		nSum += GetValue(nColumn, i) & nMask;
+	}
+
+	return nSum;
+}
+
+bool ProtoColumns::MinMax(size_t nColumn, int64_t* pnMin, int64_t* pnMax, const std::vector<uint8_t>* pvSelection) const
+{
+	if (nColumn >= m_vFields.size() || !pnMin || !pnMax)
+		return false;
+
+	bool bFound = false;
+
+	for (size_t i = 0; i < m_nCount; i++)
+	{
+		if (!IsSelected(pvSelection, i))
+			continue;
+
+		int64_t nValue = GetValue(nColumn, i);
+
+		if (!bFound || nValue < *pnMin)
+			*pnMin = nValue;
+
+		if (!bFound || nValue > *pnMax)
+			*pnMax = nValue;
+
+		bFound = true;
+	}
+
+	return bFound;
+}
+
+void ProtoColumns::GetIndexes(const std::vector<uint8_t>& vSelection, std::vector<uint32_t>& vIndexes) const
+{
+	vIndexes.clear();
+
+	for (size_t i = 0; i < vSelection.size() && i < m_nCount; i++)
+	{
+		if (vSelection[i])
+			vIndexes.push_back(static_cast<uint32_t>(i));
+	}
+}
@@ -0,0 +1,443 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoCompiler.cpp
+	Implements a compiler of tab separated tables to Item and Mob Protos.
+*/
+#include <LibLyketo/ProtoCompiler.hpp>
+
+#include "Parallel.hpp"
+
+#include <mutex>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Minimum number of lines parsed by a worker
+#define PROTOCOMPILER_MIN_CHUNK 1024
+
+// Longest text accepted as a floating point number
+#define PROTOCOMPILER_MAX_FLOAT 64
+
+namespace
+{
+	struct TableLine
+	{
+		const char* pBegin;
+		const char* pEnd;
+		size_t nLine;
+	};
+
+	bool ParseUnsigned(const char* pBegin, const char* pEnd, uint64_t& qwValue)
+	{
+		qwValue = 0;
+
+		if (pEnd - pBegin > 2 && pBegin[0] == '0' && (pBegin[1] == 'x' || pBegin[1] == 'X'))
+		{
+			for (const char* p = pBegin + 2; p < pEnd; p++)
+			{
+				uint64_t qwDigit;
+
+				if (*p >= '0' && *p <= '9')
+					qwDigit = static_cast<uint64_t>(*p - '0');
+				else if (*p >= 'a' && *p <= 'f')
+					qwDigit = static_cast<uint64_t>(*p - 'a' + 10);
+				else if (*p >= 'A' && *p <= 'F')
+					qwDigit = static_cast<uint64_t>(*p - 'A' + 10);
+				else
+					return false;
+
+				if (qwValue > (UINT64_MAX >> 4))
+					return false;
+
+				qwValue = (qwValue << 4) | qwDigit;
+			}
+
+			return true;
+		}
+
+		if (pBegin == pEnd)
+			return false;
+
+		for (const char* p = pBegin; p < pEnd; p++)
+		{
+			if (*p < '0' || *p > '9')
+				return false;
+
+			uint64_t qwDigit = static_cast<uint64_t>(*p - '0');
+
+			if (qwValue > (UINT64_MAX - qwDigit) / 10)
+				return false;
+
+			qwValue = (qwValue * 10) + qwDigit;
+		}
+
+		return true;
+	}
+
+	bool ParseSigned(const char* pBegin, const char* pEnd, int64_t& llValue)
+	{
+		bool bNegative = pBegin < pEnd && *pBegin == '-';
+
+		if (pBegin < pEnd && (*pBegin == '-' || *pBegin == '+'))
+			pBegin++;
+
+		uint64_t qwValue;
+
+		if (!ParseUnsigned(pBegin, pEnd, qwValue))
+			return false;
+
+		if (bNegative)
+		{
+			if (qwValue > static_cast<uint64_t>(INT64_MAX) + 1)
+				return false;
+
+			llValue = qwValue == static_cast<uint64_t>(INT64_MAX) + 1 ? INT64_MIN : -static_cast<int64_t>(qwValue);
+			return true;
+		}
+
+		if (qwValue > static_cast<uint64_t>(INT64_MAX))
+			return false;
+
+		llValue = static_cast<int64_t>(qwValue);
+		return true;
+	}
+
+	bool ParseFloat(const char* pBegin, const char* pEnd, double& dValue)
+	{
+		size_t nLength = static_cast<size_t>(pEnd - pBegin);
+
+		if (nLength < 1 || nLength >= PROTOCOMPILER_MAX_FLOAT)
+			return false;
+
+		// strtod needs a terminated string
+		char szValue[PROTOCOMPILER_MAX_FLOAT];
+		memcpy_s(szValue, sizeof(szValue), pBegin, nLength);
+		szValue[nLength] = '\0';
+
+		char* pszEnd = nullptr;
+		dValue = strtod(szValue, &pszEnd);
+
+		return pszEnd == szValue + nLength;
+	}
+
+	ProtoCompileErrors WriteValue(const ProtoFieldInfo& sField, const char* pBegin, const char* pEnd, uint8_t* pbRecord)
+	{
+		// Records are zeroed, so empty cells are already done
+		if (pBegin == pEnd)
+			return ProtoCompileErrors::Ok;
+
+		uint8_t* pbField = pbRecord + sField.dwOffset;
+
+		switch (sField.eType)
+		{
+		case ProtoFieldType::Unsigned:
+		{
+			uint64_t qwValue;
+
+			if (!ParseUnsigned(pBegin, pEnd, qwValue))
+				return ProtoCompileErrors::InvalidValue;
+
+			if (sField.dwSize < sizeof(uint64_t) && qwValue >> (sField.dwSize * 8) != 0)
+				return ProtoCompileErrors::ValueOutOfRange;
+
+			// Records are little endian, like the hosts the protos are made for
+			memcpy_s(pbField, sField.dwSize, &qwValue, sField.dwSize);
+			return ProtoCompileErrors::Ok;
+		}
+		case ProtoFieldType::Signed:
+		{
+			int64_t llValue;
+
+			if (!ParseSigned(pBegin, pEnd, llValue))
+				return ProtoCompileErrors::InvalidValue;
+
+			if (sField.dwSize < sizeof(int64_t))
+			{
+				int64_t llLimit = static_cast<int64_t>(1) << ((sField.dwSize * 8) - 1);
+
+				if (llValue < -llLimit || llValue >= llLimit)
+					return ProtoCompileErrors::ValueOutOfRange;
+			}
+
+			memcpy_s(pbField, sField.dwSize, &llValue, sField.dwSize);
+			return ProtoCompileErrors::Ok;
+		}
+		case ProtoFieldType::Float:
+		{
+			double dValue;
+
+			if (!ParseFloat(pBegin, pEnd, dValue))
+				return ProtoCompileErrors::InvalidValue;
+
+			if (sField.dwSize == sizeof(float))
+			{
+				float fValue = static_cast<float>(dValue);
+				memcpy_s(pbField, sField.dwSize, &fValue, sizeof(fValue));
+			}
+			else if (sField.dwSize == sizeof(double))
+				memcpy_s(pbField, sField.dwSize, &dValue, sizeof(dValue));
+			else
+				return ProtoCompileErrors::InvalidValue;
+
+			return ProtoCompileErrors::Ok;
+		}
+		case ProtoFieldType::String:
+		{
+			size_t nLength = static_cast<size_t>(pEnd - pBegin);
+
+			if (nLength > sField.dwSize)
+				return ProtoCompileErrors::StringTooLong;
+
+			memcpy_s(pbField, sField.dwSize, pBegin, nLength);
+			return ProtoCompileErrors::Ok;
+		}
+		default:
+			break;
+		}
+
+		return ProtoCompileErrors::InvalidValue;
+	}
+
+	ProtoCompileErrors ParseRow(const TableLine& sLine, const std::vector<const ProtoFieldInfo*>& vColumns, uint8_t* pbRecord, size_t* pnColumn)
+	{
+		const char* pCell = sLine.pBegin;
+
+		for (size_t i = 0; i < vColumns.size(); i++)
+		{
+			*pnColumn = i + 1;
+
+			const char* pTab = static_cast<const char*>(memchr(pCell, '\t', static_cast<size_t>(sLine.pEnd - pCell)));
+			bool bLast = i + 1 == vColumns.size();
+
+			if (bLast != (pTab == nullptr))
+				return ProtoCompileErrors::InvalidColumnCount;
+
+			const char* pCellEnd = bLast ? sLine.pEnd : pTab;
+			ProtoCompileErrors eError = WriteValue(*vColumns[i], pCell, pCellEnd, pbRecord);
+
+			if (eError != ProtoCompileErrors::Ok)
+				return eError;
+
+			pCell = pCellEnd + 1;
+		}
+
+		return ProtoCompileErrors::Ok;
+	}
+}
+
+ProtoCompiler::ProtoCompiler() : m_eLayout(ProtoLayout::Unknown), m_nCount(0), m_eError(ProtoCompileErrors::Ok), m_nErrorLine(0), m_nErrorColumn(0)
+{
+}
+
+ProtoCompiler::~ProtoCompiler()
+{
+}
+
+void ProtoCompiler::SetError(ProtoCompileErrors eError, size_t nLine, size_t nColumn)
+{
+	m_eError = eError;
+	m_nErrorLine = nLine;
+	m_nErrorColumn = nColumn;
+}
+
+bool ProtoCompiler::GetProtoType(ProtoLayout eLayout, ProtoType* peType)
+{
+	switch (eLayout)
+	{
+	case ProtoLayout::ItemR152:
+		*peType = ProtoType::ItemProto_Old;
+		return true;
+	case ProtoLayout::ItemR156:
+		*peType = ProtoType::ItemProto;
+		return true;
+	case ProtoLayout::Mob:
+		*peType = ProtoType::MobProto;
+		return true;
+	default:
+		break;
+	}
+
+	return false;
+}
+
+bool ProtoCompiler::Parse(ProtoLayout eLayout, const char* pszInput, size_t nLength, size_t nThreads)
+{
+	m_eLayout = ProtoLayout::Unknown;
+	m_vRecords.clear();
+	m_nCount = 0;
+	SetError(ProtoCompileErrors::Ok, 0, 0);
+
+	size_t nFields = 0;
+	const ProtoFieldInfo* pFields = ProtoView::GetFields(eLayout, &nFields);
+	uint32_t dwStride = ProtoView::GetLayoutStride(eLayout);
+
+	if (!pFields || dwStride < 1)
+	{
+		SetError(ProtoCompileErrors::InvalidLayout, 0, 0);
+		return false;
+	}
+
+	// Splitting the lines is bound by memory bandwidth, the parsing is not
+	std::vector<TableLine> vLines;
+	const char* pEnd = pszInput + nLength;
+	size_t nLine = 0;
+
+	for (const char* p = pszInput; pszInput && p < pEnd; )
+	{
+		const char* pNewLine = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(pEnd - p)));
+		const char* pLineEnd = pNewLine ? pNewLine : pEnd;
+
+		TableLine sLine;
+		sLine.pBegin = p;
+		sLine.pEnd = pLineEnd > p && pLineEnd[-1] == '\r' ? pLineEnd - 1 : pLineEnd;
+		sLine.nLine = ++nLine;
+
+		if (sLine.pEnd > sLine.pBegin)
+			vLines.push_back(sLine);
+
+		p = pLineEnd + 1;
+	}
+
+	if (vLines.empty() || vLines[0].nLine != 1)
+	{
+		SetError(ProtoCompileErrors::EmptyHeader, 1, 0);
+		return false;
+	}
+
+	std::vector<const ProtoFieldInfo*> vColumns;
+
+	for (const char* pName = vLines[0].pBegin; ; )
+	{
+		const char* pTab = static_cast<const char*>(memchr(pName, '\t', static_cast<size_t>(vLines[0].pEnd - pName)));
+		const char* pNameEnd = pTab ? pTab : vLines[0].pEnd;
+		size_t nNameLength = static_cast<size_t>(pNameEnd - pName);
+		const ProtoFieldInfo* pField = nullptr;
+
+		for (size_t i = 0; i < nFields; i++)
+		{
+			if (strlen(pFields[i].szName) == nNameLength && memcmp(pFields[i].szName, pName, nNameLength) == 0)
+			{
+				pField = &pFields[i];
+				break;
+			}
+		}
+
+		if (!pField)
+		{
+			SetError(ProtoCompileErrors::UnknownColumn, 1, vColumns.size() + 1);
+			return false;
+		}
+
+		for (const auto* column : vColumns)
+		{
+			if (column == pField)
+			{
+				SetError(ProtoCompileErrors::DuplicatedColumn, 1, vColumns.size() + 1);
+				return false;
+			}
+		}
+
+		vColumns.push_back(pField);
+
+		if (!pTab)
+			break;
+
+		pName = pTab + 1;
+	}
+
+	size_t nRows = vLines.size() - 1;
+
+	if (nRows > UINT32_MAX || nRows > SIZE_MAX / dwStride)
+	{
+		SetError(ProtoCompileErrors::TooManyRows, 0, 0);
+		return false;
+	}
+
+	m_vRecords.assign(nRows * dwStride, 0);
+
+	// Every worker keeps its first error, the one in the earliest line is reported
+	std::mutex mError;
+	ProtoCompileErrors eError = ProtoCompileErrors::Ok;
+	size_t nErrorLine = 0, nErrorColumn = 0;
+
+	Parallel::For(nRows, nThreads, PROTOCOMPILER_MIN_CHUNK, [&](size_t nBegin, size_t nEnd)
+	{
+		for (size_t i = nBegin; i < nEnd; i++)
+		{
+			const TableLine& sLine = vLines[i + 1];
+			size_t nColumn = 0;
+			ProtoCompileErrors eRowError = ParseRow(sLine, vColumns, m_vRecords.data() + (i * dwStride), &nColumn);
+
+			if (eRowError == ProtoCompileErrors::Ok)
+				continue;
+
+			std::lock_guard<std::mutex> lock(mError);
+
+			if (eError == ProtoCompileErrors::Ok || sLine.nLine < nErrorLine)
+			{
+				eError = eRowError;
+				nErrorLine = sLine.nLine;
+				nErrorColumn = nColumn;
+			}
+
+			break;
+		}
+	});
+
+	if (eError != ProtoCompileErrors::Ok)
+	{
+		m_vRecords.clear();
+		SetError(eError, nErrorLine, nErrorColumn);
+		return false;
+	}
+
+	m_eLayout = eLayout;
+	m_nCount = nRows;
+	return true;
+}
+
+ProtoCompileErrors ProtoCompiler::PackRecords(ProtoType eType, uint32_t dwStride, const uint8_t* pbRecords, size_t nCount, CryptedObject& cObject, Proto& cProto, std::shared_ptr<IFileSystem> pcFS)
+{
+	if (nCount < 1 || !pbRecords)
+		return ProtoCompileErrors::NoRecords;
+
+	if (nCount > UINT32_MAX || dwStride < 1 || nCount > SIZE_MAX / dwStride)
+		return ProtoCompileErrors::TooManyRows;
+
+	if (cObject.Encrypt(pbRecords, nCount * dwStride) != CryptedObjectErrors::Ok)
+		return ProtoCompileErrors::CryptFail;
+
+	if (eType == ProtoType::ItemProto)
+	{
+		cProto.SetVersion(PROTO_ITEM_VERSION);
+		cProto.SetStride(dwStride);
+	}
+
+	if (!cProto.Create(eType, static_cast<uint32_t>(nCount)) || !cProto.Pack(cObject.GetBuffer(), cObject.GetSize(), eType, pcFS))
+		return ProtoCompileErrors::WriteFail;
+
+	return ProtoCompileErrors::Ok;
+}
+
+bool ProtoCompiler::Pack(CryptedObject& cObject, Proto& cProto, std::shared_ptr<IFileSystem> pcFS)
+{
+	ProtoType eType;
+
+	if (!GetProtoType(m_eLayout, &eType))
+	{
+		SetError(ProtoCompileErrors::InvalidLayout, 0, 0);
+		return false;
+	}
+
+	ProtoCompileErrors eError = PackRecords(eType, ProtoView::GetLayoutStride(m_eLayout), m_vRecords.data(), m_nCount, cObject, cProto, pcFS);
+
+	if (eError != ProtoCompileErrors::Ok)
+	{
+		SetError(eError, 0, 0);
+		return false;
+	}
+
+	return true;
+}
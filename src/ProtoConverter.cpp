@@ -0,0 +1,134 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoConverter.cpp
+	Implements a converter of proto records between layouts.
+*/
+#include <LibLyketo/ProtoConverter.hpp>
+
+#include "Parallel.hpp"
+
+#include <algorithm>
+
+#include <string.h>
+
+// Minimum number of records converted by a worker
+#define PROTOCONVERTER_MIN_CHUNK 4096
+
+ProtoConverter::ProtoConverter() : m_eFrom(ProtoLayout::Unknown), m_eTo(ProtoLayout::Unknown), m_nDropped(0), m_bIdentity(false)
+{
+}
+
+ProtoConverter::~ProtoConverter()
+{
+}
+
+bool ProtoConverter::Prepare(ProtoLayout eFrom, ProtoLayout eTo)
+{
+	m_eFrom = ProtoLayout::Unknown;
+	m_eTo = ProtoLayout::Unknown;
+	m_vMoves.clear();
+	m_nDropped = 0;
+	m_bIdentity = false;
+
+	size_t nFromFields = 0, nToFields = 0;
+	const ProtoFieldInfo* pFromFields = ProtoView::GetFields(eFrom, &nFromFields);
+	const ProtoFieldInfo* pToFields = ProtoView::GetFields(eTo, &nToFields);
+
+	// Item and mob fields with the same name do not hold the same thing
+	if (!pFromFields || !pToFields || (eFrom == ProtoLayout::Mob) != (eTo == ProtoLayout::Mob))
+		return false;
+
+	for (size_t i = 0; i < nFromFields; i++)
+	{
+		const ProtoFieldInfo* pTarget = nullptr;
+
+		for (size_t j = 0; j < nToFields; j++)
+		{
+			if (strcmp(pFromFields[i].szName, pToFields[j].szName) == 0)
+			{
+				pTarget = &pToFields[j];
+				break;
+			}
+		}
+
+		if (!pTarget)
+		{
+			m_nDropped++;
+			continue;
+		}
+
+		if (pTarget->dwSize != pFromFields[i].dwSize || pTarget->eType != pFromFields[i].eType)
+		{
+			m_vMoves.clear();
+			m_nDropped = 0;
+			return false;
+		}
+
+		ProtoFieldMove sMove;
+		sMove.dwFrom = pFromFields[i].dwOffset;
+		sMove.dwTo = pTarget->dwOffset;
+		sMove.dwSize = pTarget->dwSize;
+		m_vMoves.push_back(sMove);
+	}
+
+	// Fields contiguous in both records are copied together
+	std::sort(m_vMoves.begin(), m_vMoves.end(), [](const ProtoFieldMove& a, const ProtoFieldMove& b) { return a.dwTo < b.dwTo; });
+
+	std::vector<ProtoFieldMove> vMerged;
+
+	for (const auto& move : m_vMoves)
+	{
+		if (!vMerged.empty() && vMerged.back().dwFrom + vMerged.back().dwSize == move.dwFrom && vMerged.back().dwTo + vMerged.back().dwSize == move.dwTo)
+			vMerged.back().dwSize += move.dwSize;
+		else
+			vMerged.push_back(move);
+	}
+
+	m_vMoves.swap(vMerged);
+	m_bIdentity = m_vMoves.size() == 1 && m_vMoves[0].dwFrom == 0 && m_vMoves[0].dwTo == 0 && m_vMoves[0].dwSize == ProtoView::GetLayoutStride(eFrom) && m_vMoves[0].dwSize == ProtoView::GetLayoutStride(eTo);
+
+	m_eFrom = eFrom;
+	m_eTo = eTo;
+	return true;
+}
+
+bool ProtoConverter::Convert(const ProtoView& cInput, std::vector<uint8_t>& vOutput, size_t nThreads) const
+{
+	if (m_eFrom == ProtoLayout::Unknown || cInput.GetLayout() != m_eFrom)
+		return false;
+
+	uint32_t dwStride = ProtoView::GetLayoutStride(m_eTo);
+	size_t nCount = cInput.GetCount();
+
+	if (nCount > SIZE_MAX / dwStride)
+		return false;
+
+	if (m_bIdentity)
+	{
+		vOutput.assign(cInput.GetRecord(0), cInput.GetRecord(0) + (nCount * dwStride));
+		return true;
+	}
+
+	// Bytes not written by any move stay zeroed
+	vOutput.assign(nCount * dwStride, 0);
+
+	const ProtoFieldMove* pMoves = m_vMoves.data();
+	size_t nMoves = m_vMoves.size();
+	uint8_t* pbOutput = vOutput.data();
+
+	Parallel::For(nCount, nThreads, PROTOCONVERTER_MIN_CHUNK, [&](size_t nBegin, size_t nEnd)
+	{
+		for (size_t i = nBegin; i < nEnd; i++)
+		{
+			const uint8_t* pbFrom = cInput.GetRecord(i);
+			uint8_t* pbTo = pbOutput + (i * dwStride);
+
+			for (size_t m = 0; m < nMoves; m++)
+				memcpy(pbTo + pMoves[m].dwTo, pbFrom + pMoves[m].dwFrom, pMoves[m].dwSize);
+		}
+	});
+
+	return true;
+}
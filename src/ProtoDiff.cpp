@@ -0,0 +1,363 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoDiff.cpp
+	Implements a record level changeset between two decoded protos.
+*/
+#include <LibLyketo/ProtoDiff.hpp>
+
+#include "FastCrc32.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+
+#define PROTODIFF_VERSION 1
+
+namespace
+{
+	template <typename T>
+	void Append(std::vector<uint8_t>& vOutput, const T& tValue)
+	{
+		const uint8_t* pbValue = reinterpret_cast<const uint8_t*>(&tValue);
+		vOutput.insert(vOutput.end(), pbValue, pbValue + sizeof(tValue));
+	}
+
+	template <typename T>
+	bool Fetch(const uint8_t*& pbInput, const uint8_t* pbEnd, T& tValue)
+	{
+		if (static_cast<size_t>(pbEnd - pbInput) < sizeof(tValue))
+			return false;
+
+		memcpy_s(&tValue, sizeof(tValue), pbInput, sizeof(tValue));
+		pbInput += sizeof(tValue);
+		return true;
+	}
+
+	// Views of raw records are opened from the layout alone
+	bool OpenView(ProtoView& cView, ProtoLayout eLayout, const std::vector<uint8_t>& vRecords, uint32_t dwStride)
+	{
+		if (dwStride < 1 || vRecords.size() % dwStride != 0 || vRecords.size() / dwStride > UINT32_MAX)
+			return false;
+
+		uint32_t dwElements = static_cast<uint32_t>(vRecords.size() / dwStride);
+
+		switch (eLayout)
+		{
+		case ProtoLayout::ItemR152:
+			return cView.Open(ProtoType::ItemProto_Old, 0, dwStride, dwElements, vRecords.data(), vRecords.size());
+		case ProtoLayout::ItemR156:
+			return cView.Open(ProtoType::ItemProto, 1, dwStride, dwElements, vRecords.data(), vRecords.size());
+		case ProtoLayout::Mob:
+			return cView.Open(ProtoType::MobProto, 0, dwStride, dwElements, vRecords.data(), vRecords.size());
+		default:
+			break;
+		}
+
+		return false;
+	}
+
+	// Vnums must be unique, otherwise records cannot be matched
+	bool HasDuplicates(const ProtoView& cView, const ProtoIndex& cIndex)
+	{
+		for (size_t i = 0; i < cView.GetCount(); i++)
+		{
+			uint32_t dwIndex = 0;
+
+			if (!cIndex.Find(cView.GetVnum(i), &dwIndex) || dwIndex != i)
+				return true;
+		}
+
+		return false;
+	}
+}
+
+ProtoDiffHeader::ProtoDiffHeader() : dwFourCC(MAKEFOURCC('P', 'D', 'I', 'F')), dwVersion(PROTODIFF_VERSION), dwLayout(0), dwStride(0), dwAdded(0), dwRemoved(0), dwChanged(0), dwCRC32(0)
+{
+}
+
+ProtoDiff::ProtoDiff()
+{
+}
+
+ProtoDiff::~ProtoDiff()
+{
+}
+
+bool ProtoDiff::Compute(const ProtoView& cOld, const ProtoView& cNew)
+{
+	m_sHeader = ProtoDiffHeader();
+	m_pBuffer.clear();
+
+	if (cOld.GetLayout() == ProtoLayout::Unknown || cOld.GetLayout() != cNew.GetLayout() || cOld.GetStride() != cNew.GetStride())
+		return false;
+
+	ProtoIndex cOldIndex, cNewIndex;
+
+	if (!cOldIndex.Build(cOld) || !cNewIndex.Build(cNew) || HasDuplicates(cOld, cOldIndex) || HasDuplicates(cNew, cNewIndex))
+		return false;
+
+	size_t nFields = 0;
+	const ProtoFieldInfo* pFields = ProtoView::GetFields(cNew.GetLayout(), &nFields);
+
+	m_sHeader.dwLayout = static_cast<uint32_t>(cNew.GetLayout());
+	m_sHeader.dwStride = cNew.GetStride();
+
+	std::vector<uint8_t> vRemoved, vAdded, vChanged;
+
+	for (size_t i = 0; i < cOld.GetCount(); i++)
+	{
+		uint32_t dwVnum = cOld.GetVnum(i);
+		uint32_t dwIndex = 0;
+
+		if (cNewIndex.Find(dwVnum, &dwIndex))
+			continue;
+
+		Append(vRemoved, dwVnum);
+		m_sHeader.dwRemoved++;
+	}
+
+	for (size_t i = 0; i < cNew.GetCount(); i++)
+	{
+		const uint8_t* pbNew = cNew.GetRecord(i);
+		uint32_t dwIndex = 0;
+
+		if (!cOldIndex.Find(cNew.GetVnum(i), &dwIndex))
+		{
+			vAdded.insert(vAdded.end(), pbNew, pbNew + cNew.GetStride());
+			m_sHeader.dwAdded++;
+			continue;
+		}
+
+		const uint8_t* pbOld = cOld.GetRecord(dwIndex);
+
+		if (memcmp(pbOld, pbNew, cNew.GetStride()) == 0)
+			continue;
+
+		// Changed fields, adjacent ones are merged in a single run
+		std::vector<std::pair<uint32_t, uint32_t>> vRuns;
+
+		for (size_t f = 0; f < nFields; f++)
+		{
+			if (memcmp(pbOld + pFields[f].dwOffset, pbNew + pFields[f].dwOffset, pFields[f].dwSize) == 0)
+				continue;
+
+			if (!vRuns.empty() && vRuns.back().first + vRuns.back().second == pFields[f].dwOffset)
+				vRuns.back().second += pFields[f].dwSize;
+			else
+				vRuns.emplace_back(pFields[f].dwOffset, pFields[f].dwSize);
+		}
+
+		Append(vChanged, cNew.GetVnum(i));
+		Append(vChanged, static_cast<uint32_t>(vRuns.size()));
+
+		for (const auto& run : vRuns)
+		{
+			Append(vChanged, static_cast<uint16_t>(run.first));
+			Append(vChanged, static_cast<uint16_t>(run.second));
+			vChanged.insert(vChanged.end(), pbNew + run.first, pbNew + run.first + run.second);
+		}
+
+		m_sHeader.dwChanged++;
+	}
+
+	m_pBuffer.reserve(sizeof(m_sHeader) + vRemoved.size() + vAdded.size() + vChanged.size());
+	Append(m_pBuffer, m_sHeader);
+	m_pBuffer.insert(m_pBuffer.end(), vRemoved.begin(), vRemoved.end());
+	m_pBuffer.insert(m_pBuffer.end(), vAdded.begin(), vAdded.end());
+	m_pBuffer.insert(m_pBuffer.end(), vChanged.begin(), vChanged.end());
+
+	m_sHeader.dwCRC32 = FastCrc32::Compute(m_pBuffer.data() + sizeof(m_sHeader), m_pBuffer.size() - sizeof(m_sHeader));
+	memcpy_s(m_pBuffer.data(), m_pBuffer.size(), &m_sHeader, sizeof(m_sHeader));
+
+	return true;
+}
+
+bool ProtoDiff::Load(const uint8_t* pbInput, size_t nLength)
+{
+	m_sHeader = ProtoDiffHeader();
+	m_pBuffer.clear();
+
+	struct ProtoDiffHeader sHeader;
+	const uint8_t* pbEnd = pbInput + nLength;
+
+	if (!pbInput || !Fetch(pbInput, pbEnd, sHeader))
+		return false;
+
+	if (sHeader.dwFourCC != m_sHeader.dwFourCC || sHeader.dwVersion != PROTODIFF_VERSION || sHeader.dwStride < 1 || sHeader.dwStride > UINT16_MAX)
+		return false;
+
+	if (sHeader.dwLayout != static_cast<uint32_t>(ProtoLayout::ItemR152) && sHeader.dwLayout != static_cast<uint32_t>(ProtoLayout::ItemR156) && sHeader.dwLayout != static_cast<uint32_t>(ProtoLayout::Mob))
+		return false;
+
+	if (FastCrc32::Compute(pbInput, static_cast<size_t>(pbEnd - pbInput)) != sHeader.dwCRC32)
+		return false;
+
+	// Walks the whole changeset, so Apply never reads out of bounds
+	const uint8_t* pbData = pbInput;
+	uint64_t qwFixed = (static_cast<uint64_t>(sHeader.dwRemoved) * sizeof(uint32_t)) + (static_cast<uint64_t>(sHeader.dwAdded) * sHeader.dwStride);
+
+	if (qwFixed > static_cast<uint64_t>(pbEnd - pbData))
+		return false;
+
+	pbData += qwFixed;
+
+	for (uint32_t i = 0; i < sHeader.dwChanged; i++)
+	{
+		uint32_t dwVnum = 0, dwRuns = 0;
+
+		if (!Fetch(pbData, pbEnd, dwVnum) || !Fetch(pbData, pbEnd, dwRuns))
+			return false;
+
+		for (uint32_t r = 0; r < dwRuns; r++)
+		{
+			uint16_t wOffset = 0, wLength = 0;
+
+			if (!Fetch(pbData, pbEnd, wOffset) || !Fetch(pbData, pbEnd, wLength))
+				return false;
+
+			if (static_cast<uint32_t>(wOffset) + wLength > sHeader.dwStride || wLength > static_cast<size_t>(pbEnd - pbData))
+				return false;
+
+			pbData += wLength;
+		}
+	}
+
+	if (pbData != pbEnd)
+		return false;
+
+	m_sHeader = sHeader;
+	m_pBuffer.assign(pbInput - sizeof(sHeader), pbEnd);
+	return true;
+}
+
+bool ProtoDiff::Apply(std::vector<uint8_t>& vRecords, ProtoLayout eLayout) const
+{
+	if (m_pBuffer.empty() || static_cast<uint32_t>(eLayout) != m_sHeader.dwLayout)
+		return false;
+
+	ProtoView cView;
+	ProtoIndex cIndex;
+
+	if (!OpenView(cView, eLayout, vRecords, m_sHeader.dwStride) || cView.GetLayout() != eLayout || !cIndex.Build(cView))
+		return false;
+
+	return Apply(vRecords, eLayout, cIndex);
+}
+
+bool ProtoDiff::Apply(std::vector<uint8_t>& vRecords, ProtoLayout eLayout, const ProtoIndex& cIndex) const
+{
+	if (m_pBuffer.empty() || static_cast<uint32_t>(eLayout) != m_sHeader.dwLayout)
+		return false;
+
+	uint32_t dwStride = m_sHeader.dwStride;
+	ProtoView cView;
+
+	// The index must cover exactly these records
+	if (!OpenView(cView, eLayout, vRecords, dwStride) || cView.GetLayout() != eLayout || cIndex.GetCount() != cView.GetCount())
+		return false;
+
+	const uint8_t* pbRemoved = m_pBuffer.data() + sizeof(m_sHeader);
+	const uint8_t* pbAdded = pbRemoved + (static_cast<size_t>(m_sHeader.dwRemoved) * sizeof(uint32_t));
+	const uint8_t* pbChanged = pbAdded + (static_cast<size_t>(m_sHeader.dwAdded) * dwStride);
+	const uint8_t* pbEnd = m_pBuffer.data() + m_pBuffer.size();
+
+	// Checks every vnum first, so a changeset for another version of the table does nothing
+	std::vector<bool> vDrop(cView.GetCount(), false);
+	uint32_t dwIndex = 0;
+
+	for (uint32_t i = 0; i < m_sHeader.dwRemoved; i++)
+	{
+		uint32_t dwVnum;
+		memcpy_s(&dwVnum, sizeof(dwVnum), pbRemoved + (i * sizeof(uint32_t)), sizeof(dwVnum));
+
+		if (!cIndex.Find(dwVnum, &dwIndex) || dwIndex >= vDrop.size())
+			return false;
+
+		vDrop[dwIndex] = true;
+	}
+
+	for (uint32_t i = 0; i < m_sHeader.dwAdded; i++)
+	{
+		uint32_t dwVnum;
+		memcpy_s(&dwVnum, sizeof(dwVnum), pbAdded + (static_cast<size_t>(i) * dwStride), sizeof(dwVnum));
+
+		if (cIndex.Find(dwVnum, &dwIndex) && (dwIndex >= vDrop.size() || !vDrop[dwIndex]))
+			return false;
+	}
+
+	std::vector<uint32_t> vTargets;
+	vTargets.reserve(m_sHeader.dwChanged);
+
+	for (const uint8_t* pbData = pbChanged; pbData < pbEnd; )
+	{
+		uint32_t dwVnum = 0, dwRuns = 0;
+		Fetch(pbData, pbEnd, dwVnum);
+		Fetch(pbData, pbEnd, dwRuns);
+
+		if (!cIndex.Find(dwVnum, &dwIndex) || dwIndex >= vDrop.size() || vDrop[dwIndex])
+			return false;
+
+		vTargets.push_back(dwIndex);
+
+		const uint8_t* pbRecord = vRecords.data() + (static_cast<size_t>(dwIndex) * dwStride);
+
+		for (uint32_t r = 0; r < dwRuns; r++)
+		{
+			uint16_t wOffset = 0, wLength = 0;
+			Fetch(pbData, pbEnd, wOffset);
+			Fetch(pbData, pbEnd, wLength);
+
+			// Records are matched by vnum, a run cannot change it (every layout starts with the vnum)
+			if (wOffset < sizeof(uint32_t) && memcmp(pbRecord + wOffset, pbData, std::min<size_t>(wLength, sizeof(uint32_t) - wOffset)) != 0)
+				return false;
+
+			pbData += wLength;
+		}
+	}
+
+	// Patches the changed records in place
+	size_t nTarget = 0;
+
+	for (const uint8_t* pbData = pbChanged; pbData < pbEnd; nTarget++)
+	{
+		uint32_t dwVnum = 0, dwRuns = 0;
+		Fetch(pbData, pbEnd, dwVnum);
+		Fetch(pbData, pbEnd, dwRuns);
+
+		uint8_t* pbRecord = vRecords.data() + (static_cast<size_t>(vTargets[nTarget]) * dwStride);
+
+		for (uint32_t r = 0; r < dwRuns; r++)
+		{
+			uint16_t wOffset = 0, wLength = 0;
+			Fetch(pbData, pbEnd, wOffset);
+			Fetch(pbData, pbEnd, wLength);
+
+			memcpy_s(pbRecord + wOffset, dwStride - wOffset, pbData, wLength);
+			pbData += wLength;
+		}
+	}
+
+	if (m_sHeader.dwRemoved > 0)
+	{
+		size_t nKept = 0;
+
+		for (size_t i = 0; i < vDrop.size(); i++)
+		{
+			if (vDrop[i])
+				continue;
+
+			if (nKept != i)
+				memmove(vRecords.data() + (nKept * dwStride), vRecords.data() + (i * dwStride), dwStride);
+
+			nKept++;
+		}
+
+		vRecords.resize(nKept * dwStride);
+	}
+
+	vRecords.insert(vRecords.end(), pbAdded, pbChanged);
+	return true;
+}
@@ -0,0 +1,285 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoExporter.cpp
+	Implements an exporter of proto records to text tables.
+*/
+#include <LibLyketo/ProtoExporter.hpp>
+
+#include "Parallel.hpp"
+
+#include <cmath>
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+
+// Records formatted by a worker at once, and blocks written with a single call
+#define PROTOEXPORTER_BLOCK_ROWS 2048
+#define PROTOEXPORTER_ROUND_BLOCKS 64
+
+namespace
+{
+	const char g_szDigits[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	void Append(std::vector<uint8_t>& vOutput, const char* pszText, size_t nLength)
+	{
+		vOutput.insert(vOutput.end(), reinterpret_cast<const uint8_t*>(pszText), reinterpret_cast<const uint8_t*>(pszText) + nLength);
+	}
+
+	// Formats two digits at a time, from the end of the buffer
+	void AppendUnsigned(std::vector<uint8_t>& vOutput, uint64_t qwValue)
+	{
+		char szBuffer[20];
+		char* p = szBuffer + sizeof(szBuffer);
+
+		while (qwValue >= 100)
+		{
+			size_t nIndex = static_cast<size_t>(qwValue % 100) * 2;
+			qwValue /= 100;
+			*--p = g_szDigits[nIndex + 1];
+			*--p = g_szDigits[nIndex];
+		}
+
+		if (qwValue >= 10)
+		{
+			size_t nIndex = static_cast<size_t>(qwValue) * 2;
+			*--p = g_szDigits[nIndex + 1];
+			*--p = g_szDigits[nIndex];
+		}
+		else
+			*--p = static_cast<char>('0' + qwValue);
+
+		Append(vOutput, p, static_cast<size_t>(szBuffer + sizeof(szBuffer) - p));
+	}
+
+	void AppendSigned(std::vector<uint8_t>& vOutput, int64_t llValue)
+	{
+		if (llValue < 0)
+		{
+			vOutput.push_back('-');
+			AppendUnsigned(vOutput, static_cast<uint64_t>(0) - static_cast<uint64_t>(llValue));
+		}
+		else
+			AppendUnsigned(vOutput, static_cast<uint64_t>(llValue));
+	}
+
+	void AppendFloat(std::vector<uint8_t>& vOutput, double dValue, bool bJson)
+	{
+		// JSON has no representation of them
+		if (bJson && !std::isfinite(dValue))
+		{
+			Append(vOutput, "null", 4);
+			return;
+		}
+
+		// Enough digits to read the same float back
+		char szBuffer[32];
+		int nLength = snprintf(szBuffer, sizeof(szBuffer), "%.9g", dValue);
+
+		if (nLength > 0)
+			Append(vOutput, szBuffer, static_cast<size_t>(nLength));
+	}
+
+	void AppendString(std::vector<uint8_t>& vOutput, const uint8_t* pbText, size_t nSize, bool bJson)
+	{
+		const uint8_t* pbEnd = static_cast<const uint8_t*>(memchr(pbText, 0, nSize));
+		size_t nLength = pbEnd ? static_cast<size_t>(pbEnd - pbText) : nSize;
+
+		if (!bJson)
+		{
+			for (size_t i = 0; i < nLength; i++)
+				vOutput.push_back((pbText[i] == '\t' || pbText[i] == '\r' || pbText[i] == '\n') ? ' ' : pbText[i]);
+
+			return;
+		}
+
+		static const char szHex[] = "0123456789abcdef";
+
+		vOutput.push_back('"');
+
+		for (size_t i = 0; i < nLength; i++)
+		{
+			uint8_t bChar = pbText[i];
+
+			if (bChar == '"' || bChar == '\\')
+			{
+				vOutput.push_back('\\');
+				vOutput.push_back(bChar);
+			}
+			else if (bChar < 0x20 || bChar > 0x7F)
+			{
+				char szEscape[6] = { '\\', 'u', '0', '0', szHex[bChar >> 4], szHex[bChar & 0xF] };
+				Append(vOutput, szEscape, sizeof(szEscape));
+			}
+			else
+				vOutput.push_back(bChar);
+		}
+
+		vOutput.push_back('"');
+	}
+
+	void AppendField(std::vector<uint8_t>& vOutput, const ProtoFieldInfo& sField, const uint8_t* pbRecord, bool bJson)
+	{
+		const uint8_t* pbField = pbRecord + sField.dwOffset;
+
+		switch (sField.eType)
+		{
+		case ProtoFieldType::Unsigned:
+		{
+			// Records are little endian
+			uint64_t qwValue = 0;
+			memcpy_s(&qwValue, sizeof(qwValue), pbField, sField.dwSize);
+			AppendUnsigned(vOutput, qwValue);
+			break;
+		}
+		case ProtoFieldType::Signed:
+		{
+			uint64_t qwValue = 0;
+			memcpy_s(&qwValue, sizeof(qwValue), pbField, sField.dwSize);
+
+			// Sign extends the value
+			uint32_t dwShift = static_cast<uint32_t>((sizeof(qwValue) - sField.dwSize) * 8);
+			AppendSigned(vOutput, static_cast<int64_t>(qwValue << dwShift) >> dwShift);
+			break;
+		}
+		case ProtoFieldType::Float:
+		{
+			if (sField.dwSize == sizeof(float))
+			{
+				float fValue;
+				memcpy_s(&fValue, sizeof(fValue), pbField, sizeof(fValue));
+				AppendFloat(vOutput, fValue, bJson);
+			}
+			else
+			{
+				double dValue;
+				memcpy_s(&dValue, sizeof(dValue), pbField, sizeof(dValue));
+				AppendFloat(vOutput, dValue, bJson);
+			}
+			break;
+		}
+		case ProtoFieldType::String:
+			AppendString(vOutput, pbField, sField.dwSize, bJson);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+ProtoExporter::ProtoExporter() : m_qwWritten(0)
+{
+}
+
+ProtoExporter::~ProtoExporter()
+{
+}
+
+bool ProtoExporter::Export(const ProtoView& cView, ProtoExportFormat eFormat, std::shared_ptr<IFileSystem> pcFS, size_t nThreads)
+{
+	m_qwWritten = 0;
+
+	size_t nFields = 0;
+	const ProtoFieldInfo* pFields = ProtoView::GetFields(cView.GetLayout(), &nFields);
+
+	if (!pFields || !pcFS)
+		return false;
+
+	bool bJson = eFormat == ProtoExportFormat::JsonLines;
+
+	// JSON keys are the same for every record
+	std::vector<std::string> vKeys;
+
+	if (bJson)
+	{
+		vKeys.reserve(nFields);
+
+		for (size_t i = 0; i < nFields; i++)
+			vKeys.push_back(std::string(i == 0 ? "{\"" : ",\"") + pFields[i].szName + "\":");
+	}
+	else
+	{
+		std::vector<uint8_t> vHeader;
+
+		for (size_t i = 0; i < nFields; i++)
+		{
+			if (i > 0)
+				vHeader.push_back('\t');
+
+			Append(vHeader, pFields[i].szName, strlen(pFields[i].szName));
+		}
+
+		vHeader.push_back('\n');
+
+		if (!pcFS->Write(vHeader.data(), vHeader.size()))
+			return false;
+
+		m_qwWritten += vHeader.size();
+	}
+
+	std::vector<std::vector<uint8_t>> vBlocks(PROTOEXPORTER_ROUND_BLOCKS);
+	std::vector<FileSystemConstBuffer> vBuffers(PROTOEXPORTER_ROUND_BLOCKS);
+	size_t nCount = cView.GetCount();
+
+	for (size_t nFirst = 0; nFirst < nCount; nFirst += PROTOEXPORTER_BLOCK_ROWS * PROTOEXPORTER_ROUND_BLOCKS)
+	{
+		size_t nRows = nCount - nFirst < PROTOEXPORTER_BLOCK_ROWS * PROTOEXPORTER_ROUND_BLOCKS ? nCount - nFirst : PROTOEXPORTER_BLOCK_ROWS * PROTOEXPORTER_ROUND_BLOCKS;
+		size_t nBlocks = (nRows + PROTOEXPORTER_BLOCK_ROWS - 1) / PROTOEXPORTER_BLOCK_ROWS;
+
+		Parallel::For(nBlocks, nThreads, 1, [&](size_t nBegin, size_t nEnd)
+		{
+			for (size_t b = nBegin; b < nEnd; b++)
+			{
+				std::vector<uint8_t>& vBlock = vBlocks[b];
+				vBlock.clear();
+
+				size_t nRow = nFirst + (b * PROTOEXPORTER_BLOCK_ROWS);
+				size_t nLast = nRow + PROTOEXPORTER_BLOCK_ROWS < nFirst + nRows ? nRow + PROTOEXPORTER_BLOCK_ROWS : nFirst + nRows;
+
+				for (; nRow < nLast; nRow++)
+				{
+					const uint8_t* pbRecord = cView.GetRecord(nRow);
+
+					for (size_t i = 0; i < nFields; i++)
+					{
+						if (bJson)
+							Append(vBlock, vKeys[i].data(), vKeys[i].size());
+						else if (i > 0)
+							vBlock.push_back('\t');
+
+						AppendField(vBlock, pFields[i], pbRecord, bJson);
+					}
+
+					if (bJson)
+						vBlock.push_back('}');
+
+					vBlock.push_back('\n');
+				}
+			}
+		});
+
+		for (size_t b = 0; b < nBlocks; b++)
+		{
+			vBuffers[b].pbData = vBlocks[b].data();
+			vBuffers[b].nLength = vBlocks[b].size();
+			m_qwWritten += vBlocks[b].size();
+		}
+
+		if (!pcFS->WriteV(vBuffers.data(), nBlocks))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,258 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoIndex.cpp
+	Implements a vnum index over the records of a decoded proto.
+*/
+#include <LibLyketo/ProtoIndex.hpp>
+
+#include <algorithm>
+
+// Fibonacci hashing, the table size is a power of two
+#define PROTOINDEX_HASH(vnum, shift) static_cast<uint32_t>((static_cast<uint32_t>(vnum) * 0x9E3779B1U) >> (shift))
+
+ProtoIndexTables::ProtoIndexTables() : pSlotVnums(nullptr), pSlots(nullptr), nSlots(0), dwShift(32), pSortedVnums(nullptr), pSortedIndexes(nullptr), pVnumRanges(nullptr), nCount(0)
+{
+}
+
+ProtoIndex::ProtoIndex() : m_bAttached(false)
+{
+}
+
+ProtoIndex::ProtoIndex(const ProtoIndex& cOther) : m_bAttached(false)
+{
+	*this = cOther;
+}
+
+ProtoIndex::~ProtoIndex()
+{
+}
+
+ProtoIndex& ProtoIndex::operator=(const ProtoIndex& cOther)
+{
+	if (this == &cOther)
+		return *this;
+
+	m_vSlotVnums = cOther.m_vSlotVnums;
+	m_vSlots = cOther.m_vSlots;
+	m_vSortedVnums = cOther.m_vSortedVnums;
+	m_vSortedIndexes = cOther.m_vSortedIndexes;
+	m_vVnumRanges = cOther.m_vVnumRanges;
+	m_sTables = cOther.m_sTables;
+	m_bAttached = cOther.m_bAttached;
+
+	// Owned tables must point to the copy
+	if (!m_bAttached)
+		Bind();
+
+	return *this;
+}
+
+void ProtoIndex::Bind()
+{
+	m_sTables.pSlotVnums = m_vSlotVnums.data();
+	m_sTables.pSlots = m_vSlots.data();
+	m_sTables.nSlots = m_vSlots.size();
+	m_sTables.pSortedVnums = m_vSortedVnums.data();
+	m_sTables.pSortedIndexes = m_vSortedIndexes.data();
+	m_sTables.pVnumRanges = m_vVnumRanges.empty() ? nullptr : m_vVnumRanges.data();
+	m_sTables.nCount = m_vSortedIndexes.size();
+}
+
+void ProtoIndex::Clear()
+{
+	m_vSlotVnums.clear();
+	m_vSlots.clear();
+	m_vSortedVnums.clear();
+	m_vSortedIndexes.clear();
+	m_vVnumRanges.clear();
+	m_sTables = ProtoIndexTables();
+	m_bAttached = false;
+}
+
+bool ProtoIndex::Attach(const ProtoIndexTables& sTables)
+{
+	Clear();
+
+	if (sTables.nCount > (1U << 30) || (sTables.nCount > 0 && (!sTables.pSortedVnums || !sTables.pSortedIndexes)))
+		return false;
+
+	// Lookups need at least one empty slot
+	if (sTables.nSlots > 0 && (sTables.dwShift > 32 || !sTables.pSlotVnums || !sTables.pSlots || (sTables.nSlots & (sTables.nSlots - 1)) != 0 || sTables.nSlots <= sTables.nCount || (static_cast<uint64_t>(1) << (32 - sTables.dwShift)) != sTables.nSlots))
+		return false;
+
+	// The tables may come from a file, lookups must stay within the records and find an empty slot
+	size_t nEmpty = 0;
+
+	for (size_t i = 0; i < sTables.nSlots; i++)
+	{
+		if (sTables.pSlots[i] > sTables.nCount)
+			return false;
+
+		if (sTables.pSlots[i] == 0)
+			nEmpty++;
+	}
+
+	if (sTables.nSlots > 0 && nEmpty == 0)
+		return false;
+
+	for (size_t i = 0; i < sTables.nCount; i++)
+	{
+		if (sTables.pSortedIndexes[i] >= sTables.nCount || (i > 0 && sTables.pSortedVnums[i] < sTables.pSortedVnums[i - 1]))
+			return false;
+	}
+
+	m_sTables = sTables;
+	m_bAttached = true;
+	return true;
+}
+
+bool ProtoIndex::Build(const ProtoView& cView)
+{
+	Clear();
+
+	if (cView.GetLayout() == ProtoLayout::Unknown || cView.GetCount() > (1U << 30))
+		return false;
+
+	uint32_t dwCount = static_cast<uint32_t>(cView.GetCount());
+	bool bRanges = cView.GetLayout() == ProtoLayout::ItemR156;
+
+	// Keeps the load factor at 50% or lower
+	uint32_t dwBits = 1;
+	while ((1U << dwBits) < dwCount * 2)
+		dwBits++;
+
+	uint32_t dwShift = 32 - dwBits;
+	m_vSlotVnums.resize(static_cast<size_t>(1) << dwBits);
+	m_vSlots.resize(static_cast<size_t>(1) << dwBits);
+
+	m_vSortedVnums.resize(dwCount);
+	m_vSortedIndexes.resize(dwCount);
+
+	if (bRanges)
+		m_vVnumRanges.resize(dwCount);
+
+	uint32_t dwMask = (1U << dwBits) - 1;
+	bool bSorted = true;
+
+	for (uint32_t i = 0; i < dwCount; i++)
+	{
+		uint32_t dwVnum = cView.GetVnum(i);
+
+		for (uint32_t dwSlot = PROTOINDEX_HASH(dwVnum, dwShift); ; dwSlot = (dwSlot + 1) & dwMask)
+		{
+			if (m_vSlots[dwSlot] == 0)
+			{
+				m_vSlotVnums[dwSlot] = dwVnum;
+				m_vSlots[dwSlot] = i + 1;
+				break;
+			}
+
+			if (m_vSlotVnums[dwSlot] == dwVnum)
+				break;
+		}
+
+		m_vSortedVnums[i] = dwVnum;
+		m_vSortedIndexes[i] = i;
+
+		if (bRanges)
+			m_vVnumRanges[i] = cView.Get<ProtoItemTableR156>(i)->dwVnumRange;
+
+		if (i > 0 && dwVnum < m_vSortedVnums[i - 1])
+			bSorted = false;
+	}
+
+	// Protos are usually stored sorted, so the sort is skipped most of the time
+	if (!bSorted)
+	{
+		std::stable_sort(m_vSortedIndexes.begin(), m_vSortedIndexes.end(), [&cView](uint32_t a, uint32_t b) { return cView.GetVnum(a) < cView.GetVnum(b); });
+
+		for (uint32_t i = 0; i < dwCount; i++)
+		{
+			m_vSortedVnums[i] = cView.GetVnum(m_vSortedIndexes[i]);
+
+			if (bRanges)
+				m_vVnumRanges[i] = cView.Get<ProtoItemTableR156>(m_vSortedIndexes[i])->dwVnumRange;
+		}
+	}
+
+	Bind();
+	m_sTables.dwShift = dwShift;
+	return true;
+}
+
+bool ProtoIndex::UpdateRanges(const ProtoView& cView)
+{
+	if (m_bAttached || cView.GetCount() != m_sTables.nCount || (cView.GetLayout() == ProtoLayout::ItemR156) != !m_vVnumRanges.empty())
+		return false;
+
+	for (size_t i = 0; i < m_vVnumRanges.size(); i++)
+		m_vVnumRanges[i] = cView.Get<ProtoItemTableR156>(m_vSortedIndexes[i])->dwVnumRange;
+
+	return true;
+}
+
+bool ProtoIndex::Find(uint32_t dwVnum, uint32_t* pdwIndex) const
+{
+	if (m_sTables.nSlots == 0 || !pdwIndex)
+		return false;
+
+	const uint32_t* pSlots = m_sTables.pSlots;
+	uint32_t dwMask = static_cast<uint32_t>(m_sTables.nSlots - 1);
+	uint32_t dwSlot = PROTOINDEX_HASH(dwVnum, m_sTables.dwShift);
+
+	// Never probes a slot twice, even if the tables have no empty slot
+	for (size_t nProbes = 0; nProbes < m_sTables.nSlots && pSlots[dwSlot] != 0; nProbes++, dwSlot = (dwSlot + 1) & dwMask)
+	{
+		if (m_sTables.pSlotVnums[dwSlot] == dwVnum)
+		{
+			*pdwIndex = pSlots[dwSlot] - 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ProtoIndex::FindCovering(uint32_t dwVnum, uint32_t* pdwIndex) const
+{
+	if (Find(dwVnum, pdwIndex))
+		return true;
+
+	if (!m_sTables.pVnumRanges || !pdwIndex)
+		return false;
+
+	const uint32_t* pBegin = m_sTables.pSortedVnums;
+	const uint32_t* pEnd = pBegin + m_sTables.nCount;
+
+	// The closest record below the vnum
+	const uint32_t* it = std::upper_bound(pBegin, pEnd, dwVnum);
+
+	if (it == pBegin)
+		return false;
+
+	size_t nPosition = static_cast<size_t>(it - pBegin) - 1;
+
+	// Like the game, the range excludes dwVnum + dwVnumRange
+	if (static_cast<uint64_t>(pBegin[nPosition]) + m_sTables.pVnumRanges[nPosition] <= dwVnum)
+		return false;
+
+	*pdwIndex = m_sTables.pSortedIndexes[nPosition];
+	return true;
+}
+
+size_t ProtoIndex::FindRange(uint32_t dwFirst, uint32_t dwLast, const uint32_t** ppIndexes) const
+{
+	if (!ppIndexes || dwFirst > dwLast || m_sTables.nCount == 0)
+		return 0;
+
+	const uint32_t* pBegin = m_sTables.pSortedVnums;
+	const uint32_t* pEnd = pBegin + m_sTables.nCount;
+
+	const uint32_t* first = std::lower_bound(pBegin, pEnd, dwFirst);
+	const uint32_t* last = std::upper_bound(first, pEnd, dwLast);
+
+	*ppIndexes = m_sTables.pSortedIndexes + (first - pBegin);
+	return static_cast<size_t>(last - first);
+}
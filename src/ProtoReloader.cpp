@@ -0,0 +1,424 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoReloader.cpp
+	Implements a background reloader of Item and Mob Protos.
+*/
+#include <LibLyketo/ProtoReloader.hpp>
+#include <LibLyketo/DefaultAlgorithms.hpp>
+#include <LibLyketo/MappedFile.hpp>
+
+#include <chrono>
+
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define MAKEFOURCC(ch0, ch1, ch2, ch3) ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) | ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24))
+
+// Interval between two checks of the files when inotify is not available
+#define PROTORELOADER_POLL_MS 1000
+
+ProtoTable::ProtoTable() : eType(ProtoType::MobProto), dwVersion(0), dwStride(0), dwElements(0), qwGeneration(1)
+{
+}
+
+ProtoReloadOptions::ProtoReloadOptions() : bHaveKeys(false), dwLzo1xFourcc(0), dwSnappyFourcc(0), dwItemFourcc(0), dwItemOldFourcc(0), dwMobFourcc(0)
+{
+	memset(adwKeys, 0, sizeof(adwKeys));
+}
+
+ProtoReloader::ProtoReloader() : m_nSettleMs(0), m_bStop(false)
+{
+#ifdef __linux__
+	m_anStopPipe[0] = -1;
+	m_anStopPipe[1] = -1;
+	m_nNotify = -1;
+#endif
+}
+
+ProtoReloader::~ProtoReloader()
+{
+	Stop();
+}
+
+std::shared_ptr<ProtoTable> ProtoReloader::Decode(const std::string& szFilename, const ProtoReloadOptions& sOptions)
+{
+	MappedFile file;
+
+	if (!file.Open(szFilename))
+		return nullptr;
+
+	Proto cProto;
+
+	if (sOptions.dwItemFourcc != 0)
+		cProto.SetItemFourCC(sOptions.dwItemFourcc);
+
+	if (sOptions.dwItemOldFourcc != 0)
+		cProto.SetItemOldFourCC(sOptions.dwItemOldFourcc);
+
+	if (sOptions.dwMobFourcc != 0)
+		cProto.SetMobFourCC(sOptions.dwMobFourcc);
+
+	// The payload is decoded straight from the mapped file
+	if (!cProto.UnpackView(file.GetBuffer(), file.GetSize()))
+		return nullptr;
+
+	uint32_t dwLzo1xFourcc = sOptions.dwLzo1xFourcc != 0 ? sOptions.dwLzo1xFourcc : MAKEFOURCC('M', 'C', 'O', 'Z');
+	uint32_t dwSnappyFourcc = sOptions.dwSnappyFourcc != 0 ? sOptions.dwSnappyFourcc : MAKEFOURCC('M', 'C', 'S', 'P');
+
+	std::shared_ptr<CryptedObjectAlgorithm> pAlgorithm = nullptr;
+
+	if (cProto.GetCryptedObjectFourCC() == dwLzo1xFourcc)
+		pAlgorithm = std::make_shared<DefaultAlgorithmLzo1x>();
+	else if (cProto.GetCryptedObjectFourCC() == dwSnappyFourcc)
+		pAlgorithm = std::make_shared<DefaultAlgorithmSnappy>();
+	else
+		return nullptr;
+
+	pAlgorithm->ChangeFourCC(cProto.GetCryptedObjectFourCC());
+
+	CryptedObject obj;
+	obj.SetAlgorithm(pAlgorithm);
+
+	if (sOptions.bHaveKeys)
+		obj.SetKeys(sOptions.adwKeys);
+
+	std::shared_ptr<ProtoTable> pTable = std::make_shared<ProtoTable>();
+
+	if (obj.Decrypt(cProto.GetBuffer(), cProto.GetSize(), pTable->vRecords) != CryptedObjectErrors::Ok)
+		return nullptr;
+
+	pTable->eType = cProto.GetType();
+	pTable->dwVersion = cProto.GetVersion();
+	pTable->dwStride = cProto.GetStride();
+	pTable->dwElements = cProto.GetElements();
+
+	if (!pTable->cView.Open(cProto, pTable->vRecords.data(), pTable->vRecords.size()))
+		return nullptr;
+
+	if (pTable->cView.GetLayout() != ProtoLayout::Unknown && !pTable->cIndex.Build(pTable->cView))
+		return nullptr;
+
+	return pTable;
+}
+
+int ProtoReloader::Watch(const std::string& szFilename, const ProtoReloadOptions& sOptions)
+{
+	if (IsRunning())
+		return -1;
+
+	std::unique_ptr<WatchedFile> pFile(new WatchedFile());
+	pFile->szFilename = szFilename;
+	pFile->sOptions = sOptions;
+
+	EterPackIndexCache::MakeStamp(szFilename, pFile->sStamp, false);
+	pFile->pTable = Decode(szFilename, sOptions);
+
+	if (!pFile->pTable)
+		return -1;
+
+	m_vFiles.push_back(std::move(pFile));
+	return static_cast<int>(m_vFiles.size() - 1);
+}
+
+std::shared_ptr<const ProtoTable> ProtoReloader::Get(int nId) const
+{
+	if (nId < 0 || static_cast<size_t>(nId) >= m_vFiles.size())
+		return nullptr;
+
+	return std::atomic_load(&m_vFiles[nId]->pTable);
+}
+
+bool ProtoReloader::Reload(int nId)
+{
+	if (nId < 0 || static_cast<size_t>(nId) >= m_vFiles.size())
+		return false;
+
+	return ReloadFile(*m_vFiles[nId]);
+}
+
+bool ProtoReloader::Patch(int nId, const ProtoDiff& cDiff)
+{
+	if (nId < 0 || static_cast<size_t>(nId) >= m_vFiles.size())
+		return false;
+
+	WatchedFile& sFile = *m_vFiles[nId];
+	std::lock_guard<std::mutex> lock(sFile.mReload);
+
+	std::shared_ptr<const ProtoTable> pCurrent = std::atomic_load(&sFile.pTable);
+
+	// The current version may be in use, so the changes go to a copy
+	std::shared_ptr<ProtoTable> pTable = std::make_shared<ProtoTable>();
+	pTable->vRecords = pCurrent->vRecords;
+
+	if (!cDiff.Apply(pTable->vRecords, pCurrent->cView.GetLayout(), pCurrent->cIndex))
+		return false;
+
+	pTable->eType = pCurrent->eType;
+	pTable->dwVersion = pCurrent->dwVersion;
+	pTable->dwStride = pCurrent->dwStride;
+	pTable->dwElements = static_cast<uint32_t>(pTable->vRecords.size() / pCurrent->cView.GetStride());
+	pTable->qwGeneration = pCurrent->qwGeneration + 1;
+
+	if (!pTable->cView.Open(pTable->eType, pTable->dwVersion, pCurrent->cView.GetStride(), pTable->dwElements, pTable->vRecords.data(), pTable->vRecords.size()))
+		return false;
+
+	// Changed records keep their vnums and positions, so only the vnum ranges can be stale
+	if (cDiff.GetAdded() == 0 && cDiff.GetRemoved() == 0)
+	{
+		pTable->cIndex = pCurrent->cIndex;
+
+		if (!pTable->cIndex.UpdateRanges(pTable->cView))
+			return false;
+	}
+	else if (!pTable->cIndex.Build(pTable->cView))
+		return false;
+
+	std::atomic_store(&sFile.pTable, std::shared_ptr<const ProtoTable>(pTable));
+
+	if (m_fnCallback)
+		m_fnCallback(sFile.szFilename, true);
+
+	return true;
+}
+
+bool ProtoReloader::ReloadFile(WatchedFile& sFile)
+{
+	// A manual reload can race with the reloader thread
+	std::lock_guard<std::mutex> lock(sFile.mReload);
+
+	EterPackCacheStamp sStamp;
+	EterPackIndexCache::MakeStamp(sFile.szFilename, sStamp, false);
+
+	std::shared_ptr<ProtoTable> pTable = Decode(sFile.szFilename, sFile.sOptions);
+
+	if (pTable)
+	{
+		pTable->qwGeneration = std::atomic_load(&sFile.pTable)->qwGeneration + 1;
+		sFile.sStamp = sStamp;
+
+		// Readers keep the previous version until they release it
+		std::atomic_store(&sFile.pTable, std::shared_ptr<const ProtoTable>(pTable));
+	}
+
+	if (m_fnCallback)
+		m_fnCallback(sFile.szFilename, pTable != nullptr);
+
+	return pTable != nullptr;
+}
+
+bool ProtoReloader::Start(ProtoReloadCallback fnCallback, size_t nSettleMs)
+{
+	if (IsRunning() || m_vFiles.empty())
+		return false;
+
+#ifdef __linux__
+	// Watches are created here, so a reloader that cannot see the changes does not start
+	m_nNotify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+
+	if (m_nNotify < 0)
+		return false;
+
+	// Directories are watched instead of files, deploy tools usually replace a file with a rename
+	m_vWatches.assign(m_vFiles.size(), -1);
+
+	for (size_t i = 0; i < m_vFiles.size(); i++)
+	{
+		const std::string& szFilename = m_vFiles[i]->szFilename;
+		size_t nSlash = szFilename.find_last_of('/');
+
+		std::string szDirectory = nSlash == std::string::npos ? "." : (nSlash == 0 ? "/" : szFilename.substr(0, nSlash));
+		m_vWatches[i] = inotify_add_watch(m_nNotify, szDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+		if (m_vWatches[i] < 0)
+		{
+			close(m_nNotify);
+			m_nNotify = -1;
+			return false;
+		}
+	}
+
+	if (pipe2(m_anStopPipe, O_CLOEXEC) != 0)
+	{
+		close(m_nNotify);
+		m_nNotify = -1;
+		return false;
+	}
+#endif
+
+	m_fnCallback = fnCallback;
+	m_nSettleMs = nSettleMs;
+	m_bStop = false;
+	m_cThread = std::thread(&ProtoReloader::Run, this);
+	return true;
+}
+
+void ProtoReloader::Stop()
+{
+	if (!IsRunning())
+		return;
+
+#ifdef __linux__
+	m_bStop = true;
+
+	uint8_t bWake = 0;
+	if (write(m_anStopPipe[1], &bWake, sizeof(bWake)) < 0)
+	{
+		// The thread still sees m_bStop on its next wake up
+	}
+
+	m_cThread.join();
+
+	close(m_anStopPipe[0]);
+	close(m_anStopPipe[1]);
+	m_anStopPipe[0] = -1;
+	m_anStopPipe[1] = -1;
+
+	close(m_nNotify);
+	m_nNotify = -1;
+#else
+	{
+		std::lock_guard<std::mutex> lock(m_mStop);
+		m_bStop = true;
+	}
+
+	m_cvStop.notify_all();
+	m_cThread.join();
+#endif
+}
+
+#ifdef __linux__
+void ProtoReloader::Run()
+{
+	// The watches are created by Start
+	int nNotify = m_nNotify;
+	const std::vector<int>& vWatches = m_vWatches;
+	std::vector<std::string> vNames(m_vFiles.size());
+
+	for (size_t i = 0; i < m_vFiles.size(); i++)
+	{
+		const std::string& szFilename = m_vFiles[i]->szFilename;
+		size_t nSlash = szFilename.find_last_of('/');
+
+		vNames[i] = nSlash == std::string::npos ? szFilename : szFilename.substr(nSlash + 1);
+	}
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Every file waits for its own settle time, events of the other files in the directory do not delay it
+	std::vector<bool> vPending(m_vFiles.size(), false);
+	std::vector<Clock::time_point> vDeadlines(m_vFiles.size());
+
+	alignas(struct inotify_event) char acEvents[4096];
+
+	while (!m_bStop)
+	{
+		struct pollfd asPoll[2] = { { nNotify, POLLIN, 0 }, { m_anStopPipe[0], POLLIN, 0 } };
+
+		for (size_t i = 0; i < m_vFiles.size(); i++)
+		{
+			if (vPending[i] && vDeadlines[i] <= Clock::now())
+			{
+				ReloadFile(*m_vFiles[i]);
+				vPending[i] = false;
+			}
+		}
+
+		// Waits until the earliest deadline, rounded up so it has passed when poll returns
+		Clock::time_point tNow = Clock::now();
+		int nTimeout = -1;
+
+		for (size_t i = 0; i < m_vFiles.size(); i++)
+		{
+			if (!vPending[i])
+				continue;
+
+			int nLeft = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(vDeadlines[i] - tNow + std::chrono::microseconds(999)).count());
+
+			if (nLeft < 0)
+				nLeft = 0;
+
+			if (nTimeout < 0 || nLeft < nTimeout)
+				nTimeout = nLeft;
+		}
+
+		int nResult = poll(asPoll, 2, nTimeout);
+
+		if (m_bStop || (asPoll[1].revents & POLLIN))
+			break;
+
+		if (nResult <= 0 || !(asPoll[0].revents & POLLIN))
+			continue;
+
+		ssize_t nLength;
+
+		while ((nLength = read(nNotify, acEvents, sizeof(acEvents))) > 0)
+		{
+			for (ssize_t nOffset = 0; nOffset < nLength; )
+			{
+				const struct inotify_event* pEvent = reinterpret_cast<const struct inotify_event*>(acEvents + nOffset);
+
+				for (size_t i = 0; i < m_vFiles.size(); i++)
+				{
+					// Every new event of the file restarts its settle time
+					if (pEvent->wd == vWatches[i] && pEvent->len > 0 && vNames[i] == pEvent->name)
+					{
+						vPending[i] = true;
+						vDeadlines[i] = Clock::now() + std::chrono::milliseconds(m_nSettleMs);
+					}
+				}
+
+				nOffset += sizeof(struct inotify_event) + pEvent->len;
+			}
+		}
+	}
+}
+#else
+void ProtoReloader::Run()
+{
+	std::vector<EterPackCacheStamp> vCandidates(m_vFiles.size());
+	std::vector<bool> vChanged(m_vFiles.size(), false);
+
+	std::unique_lock<std::mutex> lock(m_mStop);
+
+	while (!m_bStop)
+	{
+		m_cvStop.wait_for(lock, std::chrono::milliseconds(PROTORELOADER_POLL_MS > m_nSettleMs ? PROTORELOADER_POLL_MS : m_nSettleMs), [this]() { return m_bStop.load(); });
+
+		if (m_bStop)
+			break;
+
+		for (size_t i = 0; i < m_vFiles.size(); i++)
+		{
+			EterPackCacheStamp sStamp;
+
+			if (!EterPackIndexCache::MakeStamp(m_vFiles[i]->szFilename, sStamp, false) || sStamp == m_vFiles[i]->sStamp)
+			{
+				vChanged[i] = false;
+				continue;
+			}
+
+			// A file is reloaded once it stops changing between two checks
+			if (vChanged[i] && sStamp == vCandidates[i])
+			{
+				lock.unlock();
+				ReloadFile(*m_vFiles[i]);
+				lock.lock();
+
+				vChanged[i] = false;
+				continue;
+			}
+
+			vCandidates[i] = sStamp;
+			vChanged[i] = true;
+		}
+	}
+}
+#endif
@@ -0,0 +1,315 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+   License, v. 2.0. If a copy of the MPL was not distributed with this
+   file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+/*!
+	@file ProtoView.cpp
+	Implements typed views over the records of a decoded Item or Mob Proto.
+*/
+#include <LibLyketo/ProtoView.hpp>
+
+#include <stddef.h>
+
+static_assert(sizeof(struct ProtoItemTableR152) == 152, "Invalid item record size");
+static_assert(sizeof(struct ProtoItemTableR156) == 156, "Invalid item record size");
+static_assert(sizeof(struct ProtoMobTable) == 255, "Invalid mob record size");
+
+#define PROTO_FIELD(table, name, member, type) { name, static_cast<uint32_t>(offsetof(struct table, member)), static_cast<uint32_t>(sizeof(((struct table*)nullptr)->member)), ProtoFieldType::type }
+
+// Fields shared by both item layouts, after the vnum range
+#define PROTO_ITEM_FIELDS(table) \
+	PROTO_FIELD(table, "name", szName, String), \
+	PROTO_FIELD(table, "locale_name", szLocaleName, String), \
+	PROTO_FIELD(table, "type", bType, Unsigned), \
+	PROTO_FIELD(table, "sub_type", bSubType, Unsigned), \
+	PROTO_FIELD(table, "weight", bWeight, Unsigned), \
+	PROTO_FIELD(table, "size", bSize, Unsigned), \
+	PROTO_FIELD(table, "anti_flags", dwAntiFlags, Unsigned), \
+	PROTO_FIELD(table, "flags", dwFlags, Unsigned), \
+	PROTO_FIELD(table, "wear_flags", dwWearFlags, Unsigned), \
+	PROTO_FIELD(table, "immune_flag", dwImmuneFlag, Unsigned), \
+	PROTO_FIELD(table, "buy_price", dwBuyPrice, Unsigned), \
+	PROTO_FIELD(table, "sell_price", dwSellPrice, Unsigned), \
+	PROTO_FIELD(table, "limit_type0", aLimits[0].bType, Unsigned), \
+	PROTO_FIELD(table, "limit_value0", aLimits[0].lValue, Signed), \
+	PROTO_FIELD(table, "limit_type1", aLimits[1].bType, Unsigned), \
+	PROTO_FIELD(table, "limit_value1", aLimits[1].lValue, Signed), \
+	PROTO_FIELD(table, "apply_type0", aApplies[0].bType, Unsigned), \
+	PROTO_FIELD(table, "apply_value0", aApplies[0].lValue, Signed), \
+	PROTO_FIELD(table, "apply_type1", aApplies[1].bType, Unsigned), \
+	PROTO_FIELD(table, "apply_value1", aApplies[1].lValue, Signed), \
+	PROTO_FIELD(table, "apply_type2", aApplies[2].bType, Unsigned), \
+	PROTO_FIELD(table, "apply_value2", aApplies[2].lValue, Signed), \
+	PROTO_FIELD(table, "value0", alValues[0], Signed), \
+	PROTO_FIELD(table, "value1", alValues[1], Signed), \
+	PROTO_FIELD(table, "value2", alValues[2], Signed), \
+	PROTO_FIELD(table, "value3", alValues[3], Signed), \
+	PROTO_FIELD(table, "value4", alValues[4], Signed), \
+	PROTO_FIELD(table, "value5", alValues[5], Signed), \
+	PROTO_FIELD(table, "socket0", alSockets[0], Signed), \
+	PROTO_FIELD(table, "socket1", alSockets[1], Signed), \
+	PROTO_FIELD(table, "socket2", alSockets[2], Signed), \
+	PROTO_FIELD(table, "refined_vnum", dwRefinedVnum, Unsigned), \
+	PROTO_FIELD(table, "refine_set", wRefineSet, Unsigned), \
+	PROTO_FIELD(table, "alter_to_magic_item_percent", bAlterToMagicItemPercent, Unsigned), \
+	PROTO_FIELD(table, "specular", bSpecular, Unsigned), \
+	PROTO_FIELD(table, "gain_socket_percent", bGainSocketPercent, Unsigned)
+
+namespace
+{
+	const ProtoFieldInfo g_asItemR152Fields[] =
+	{
+		PROTO_FIELD(ProtoItemTableR152, "vnum", dwVnum, Unsigned),
+		PROTO_ITEM_FIELDS(ProtoItemTableR152),
+	};
+
+	const ProtoFieldInfo g_asItemR156Fields[] =
+	{
+		PROTO_FIELD(ProtoItemTableR156, "vnum", dwVnum, Unsigned),
+		PROTO_FIELD(ProtoItemTableR156, "vnum_range", dwVnumRange, Unsigned),
+		PROTO_ITEM_FIELDS(ProtoItemTableR156),
+	};
+
+	const ProtoFieldInfo g_asMobFields[] =
+	{
+		PROTO_FIELD(ProtoMobTable, "vnum", dwVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "name", szName, String),
+		PROTO_FIELD(ProtoMobTable, "locale_name", szLocaleName, String),
+		PROTO_FIELD(ProtoMobTable, "type", bType, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "rank", bRank, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "battle_type", bBattleType, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "level", bLevel, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "size", bSize, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "gold_min", dwGoldMin, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "gold_max", dwGoldMax, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "exp", dwExp, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "max_hp", dwMaxHP, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "regen_cycle", bRegenCycle, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "regen_percent", bRegenPercent, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "def", wDef, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "ai_flag", dwAIFlag, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "race_flag", dwRaceFlag, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "immune_flag", dwImmuneFlag, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "str", bStr, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "dex", bDex, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "con", bCon, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "int", bInt, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "damage_min", adwDamageRange[0], Unsigned),
+		PROTO_FIELD(ProtoMobTable, "damage_max", adwDamageRange[1], Unsigned),
+		PROTO_FIELD(ProtoMobTable, "attack_speed", sAttackSpeed, Signed),
+		PROTO_FIELD(ProtoMobTable, "moving_speed", sMovingSpeed, Signed),
+		PROTO_FIELD(ProtoMobTable, "aggressive_hp_pct", bAggressiveHPPct, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "aggressive_sight", wAggressiveSight, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "attack_range", wAttackRange, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "enchant_curse", acEnchants[0], Signed),
+		PROTO_FIELD(ProtoMobTable, "enchant_slow", acEnchants[1], Signed),
+		PROTO_FIELD(ProtoMobTable, "enchant_poison", acEnchants[2], Signed),
+		PROTO_FIELD(ProtoMobTable, "enchant_stun", acEnchants[3], Signed),
+		PROTO_FIELD(ProtoMobTable, "enchant_critical", acEnchants[4], Signed),
+		PROTO_FIELD(ProtoMobTable, "enchant_penetrate", acEnchants[5], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_sword", acResists[0], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_twohand", acResists[1], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_dagger", acResists[2], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_bell", acResists[3], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_fan", acResists[4], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_bow", acResists[5], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_fire", acResists[6], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_elect", acResists[7], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_magic", acResists[8], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_wind", acResists[9], Signed),
+		PROTO_FIELD(ProtoMobTable, "resist_poison", acResists[10], Signed),
+		PROTO_FIELD(ProtoMobTable, "resurrection_vnum", dwResurrectionVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "drop_item_vnum", dwDropItemVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "mount_capacity", bMountCapacity, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "on_click_type", bOnClickType, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "empire", bEmpire, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "folder", szFolder, String),
+		PROTO_FIELD(ProtoMobTable, "dam_multiply", fDamMultiply, Float),
+		PROTO_FIELD(ProtoMobTable, "summon_vnum", dwSummonVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "drain_sp", dwDrainSP, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "monster_color", dwMonsterColor, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "polymorph_item_vnum", dwPolymorphItemVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_vnum0", aSkills[0].dwVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_level0", aSkills[0].bLevel, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_vnum1", aSkills[1].dwVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_level1", aSkills[1].bLevel, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_vnum2", aSkills[2].dwVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_level2", aSkills[2].bLevel, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_vnum3", aSkills[3].dwVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_level3", aSkills[3].bLevel, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_vnum4", aSkills[4].dwVnum, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "skill_level4", aSkills[4].bLevel, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "berserk_point", bBerserkPoint, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "stone_skin_point", bStoneSkinPoint, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "god_speed_point", bGodSpeedPoint, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "death_blow_point", bDeathBlowPoint, Unsigned),
+		PROTO_FIELD(ProtoMobTable, "revive_point", bRevivePoint, Unsigned),
+	};
+}
+
+ProtoView::ProtoView() : m_pbData(nullptr), m_nCount(0), m_dwStride(0), m_eLayout(ProtoLayout::Unknown)
+{
+}
+
+ProtoView::~ProtoView()
+{
+}
+
+ProtoLayout ProtoView::DetectLayout(ProtoType eType, uint32_t dwVersion, uint32_t dwStride)
+{
+	switch (eType)
+	{
+	case ProtoType::ItemProto:
+		if (dwVersion != PROTO_ITEM_VERSION)
+			break;
+
+		if (dwStride == sizeof(struct ProtoItemTableR156))
+			return ProtoLayout::ItemR156;
+		else if (dwStride == sizeof(struct ProtoItemTableR152))
+			return ProtoLayout::ItemR152;
+
+		break;
+	case ProtoType::ItemProto_Old:
+		if (dwStride == sizeof(struct ProtoItemTableR152))
+			return ProtoLayout::ItemR152;
+
+		break;
+	case ProtoType::MobProto:
+		if (dwStride == sizeof(struct ProtoMobTable))
+			return ProtoLayout::Mob;
+
+		break;
+	default:
+		break;
+	}
+
+	return ProtoLayout::Unknown;
+}
+
+uint32_t ProtoView::GetLayoutStride(ProtoLayout eLayout)
+{
+	switch (eLayout)
+	{
+	case ProtoLayout::ItemR152:
+		return sizeof(struct ProtoItemTableR152);
+	case ProtoLayout::ItemR156:
+		return sizeof(struct ProtoItemTableR156);
+	case ProtoLayout::Mob:
+		return sizeof(struct ProtoMobTable);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+const ProtoFieldInfo* ProtoView::GetFields(ProtoLayout eLayout, size_t* pnCount)
+{
+	if (!pnCount)
+		return nullptr;
+
+	switch (eLayout)
+	{
+	case ProtoLayout::ItemR152:
+		*pnCount = _countof(g_asItemR152Fields);
+		return g_asItemR152Fields;
+	case ProtoLayout::ItemR156:
+		*pnCount = _countof(g_asItemR156Fields);
+		return g_asItemR156Fields;
+	case ProtoLayout::Mob:
+		*pnCount = _countof(g_asMobFields);
+		return g_asMobFields;
+	default:
+		break;
+	}
+
+	*pnCount = 0;
+	return nullptr;
+}
+
+bool ProtoView::Open(ProtoType eType, uint32_t dwVersion, uint32_t dwStride, uint32_t dwElements, const uint8_t* pbData, size_t nLength)
+{
+	m_pbData = nullptr;
+	m_nCount = 0;
+	m_dwStride = 0;
+	m_eLayout = ProtoLayout::Unknown;
+
+	if (!pbData && dwElements > 0)
+		return false;
+
+	// The old item and mob formats store records back to back without a stride
+	if (dwStride < 1)
+	{
+		if (dwElements < 1 || nLength % dwElements != 0 || nLength / dwElements > UINT32_MAX)
+			return false;
+
+		dwStride = static_cast<uint32_t>(nLength / dwElements);
+	}
+
+	if (static_cast<uint64_t>(dwStride) * dwElements > nLength)
+		return false;
+
+	m_pbData = pbData;
+	m_nCount = dwElements;
+	m_dwStride = dwStride;
+	m_eLayout = DetectLayout(eType, dwVersion, dwStride);
+	return true;
+}
+
+bool ProtoView::Open(const Proto& cProto, const uint8_t* pbData, size_t nLength)
+{
+	uint32_t dwStride = cProto.GetType() == ProtoType::ItemProto ? cProto.GetStride() : 0;
+	return Open(cProto.GetType(), cProto.GetVersion(), dwStride, cProto.GetElements(), pbData, nLength);
+}
+
+const uint8_t* ProtoView::GetRecord(size_t nIndex) const
+{
+	if (nIndex >= m_nCount)
+		return nullptr;
+
+	return m_pbData + (nIndex * m_dwStride);
+}
+
+uint32_t ProtoView::GetVnum(size_t nIndex) const
+{
+	const uint8_t* pbRecord = GetRecord(nIndex);
+
+	// Every known layout starts with the vnum
+	if (!pbRecord || m_eLayout == ProtoLayout::Unknown)
+		return 0;
+
+	return reinterpret_cast<const struct ProtoMobTable*>(pbRecord)->dwVnum;
+}
+
+const char* ProtoView::GetName(size_t nIndex) const
+{
+	switch (m_eLayout)
+	{
+	case ProtoLayout::ItemR152:
+		return nIndex < m_nCount ? Get<ProtoItemTableR152>(nIndex)->szName : nullptr;
+	case ProtoLayout::ItemR156:
+		return nIndex < m_nCount ? Get<ProtoItemTableR156>(nIndex)->szName : nullptr;
+	case ProtoLayout::Mob:
+		return nIndex < m_nCount ? Get<ProtoMobTable>(nIndex)->szName : nullptr;
+	default:
+		break;
+	}
+
+	return nullptr;
+}
+
+const char* ProtoView::GetLocaleName(size_t nIndex) const
+{
+	switch (m_eLayout)
+	{
+	case ProtoLayout::ItemR152:
+		return nIndex < m_nCount ? Get<ProtoItemTableR152>(nIndex)->szLocaleName : nullptr;
+	case ProtoLayout::ItemR156:
+		return nIndex < m_nCount ? Get<ProtoItemTableR156>(nIndex)->szLocaleName : nullptr;
+	case ProtoLayout::Mob:
+		return nIndex < m_nCount ? Get<ProtoMobTable>(nIndex)->szLocaleName : nullptr;
+	default:
+		break;
+	}
+
+	return nullptr;
+}
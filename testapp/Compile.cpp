@@ -0,0 +1,90 @@
+#include "Compile.hpp"
+#include "Config.hpp"
+#include "Log.hpp"
+#include "Utility.hpp"
+
+#include <LibLyketo/BufferedFileSystem.hpp>
+#include <LibLyketo/DefaultAlgorithms.hpp>
+#include <LibLyketo/MappedFile.hpp>
+#include <LibLyketo/ProtoCompiler.hpp>
+
+#include <memory>
+
+#include <string.h>
+
+namespace Compile
+{
+	static void Table(const std::string& in, const std::string& out, bool item)
+	{
+		MappedFile i;
+
+		if (!i.Open(in))
+		{
+			SPDLOG_CRITICAL("Cannot open file to read {0}", in);
+			return;
+		}
+
+		auto cfg = Config::instance();
+		const char* table = reinterpret_cast<const char*>(i.GetBuffer());
+
+		ProtoLayout layout = ProtoLayout::Mob;
+
+		if (item)
+		{
+			// Only the new item format has the vnum range
+			const char* end = static_cast<const char*>(memchr(table, '\n', i.GetSize()));
+			std::string header(table, end ? static_cast<size_t>(end - table) : i.GetSize());
+			layout = (header.find("vnum_range") != std::string::npos) ? ProtoLayout::ItemR156 : ProtoLayout::ItemR152;
+		}
+
+		SPDLOG_DEBUG("Parsing table {0} with size {1}", in, i.GetSize());
+
+		ProtoCompiler compiler;
+
+		if (!compiler.Parse(layout, table, i.GetSize()))
+		{
+			SPDLOG_CRITICAL("Cannot parse {0} at line {1} column {2}. Error: {3}", in, compiler.GetErrorLine(), compiler.GetErrorColumn(), Utility::TextFromCompileError(compiler.GetError()));
+			return;
+		}
+
+		SPDLOG_INFO("Parsed {0} records", compiler.GetCount());
+
+		std::shared_ptr<CryptedObjectAlgorithm> algorithm = std::make_shared<DefaultAlgorithmLzo1x>();
+		algorithm->ChangeFourCC(cfg->m_dwLzo1xFcc);
+
+		::CryptedObject obj;
+		obj.SetAlgorithm(algorithm);
+		obj.SetKeys(reinterpret_cast<uint32_t*>(item ? cfg->m_ipKeys : cfg->m_mpKeys));
+
+		::Proto p;
+		p.SetItemFourCC(cfg->m_ipNFcc);
+		p.SetItemOldFourCC(cfg->m_ipOFcc);
+		p.SetMobFourCC(cfg->m_mpFcc);
+
+		auto o = std::make_shared<BufferedFileSystem>();
+
+		if (!o->Open(out))
+		{
+			SPDLOG_CRITICAL("Cannot open file to write {0}", out);
+			return;
+		}
+
+		if (!compiler.Pack(obj, p, o) || !o->Close())
+		{
+			SPDLOG_CRITICAL("Cannot write {0}. Error: {1}", out, Utility::TextFromCompileError(compiler.GetError()));
+			return;
+		}
+
+		SPDLOG_INFO("Completed!");
+	}
+
+	void ItemProto(const std::string& in, const std::string& out)
+	{
+		Table(in, out, true);
+	}
+
+	void MobProto(const std::string& in, const std::string& out)
+	{
+		Table(in, out, false);
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+namespace Compile
+{
+	void ItemProto(const std::string& in, const std::string& out);
+	void MobProto(const std::string& in, const std::string& out);
+}
@@ -0,0 +1,87 @@
+#include "Convert.hpp"
+#include "Config.hpp"
+#include "Log.hpp"
+#include "Utility.hpp"
+
+#include <LibLyketo/BufferedFileSystem.hpp>
+#include <LibLyketo/DefaultAlgorithms.hpp>
+#include <LibLyketo/ProtoConverter.hpp>
+
+#include <memory>
+
+namespace Convert
+{
+	void ItemProto(const std::string& in, const std::string& out)
+	{
+		auto cfg = Config::instance();
+
+		// The target layout comes from ItemProto.Version and ItemProto.Stride
+		ProtoLayout to = ProtoView::DetectLayout(ProtoType::ItemProto, cfg->m_ipVersion, cfg->m_ipStride);
+
+		if (to == ProtoLayout::Unknown)
+		{
+			SPDLOG_CRITICAL("No known item layout for version {0} and stride {1}", cfg->m_ipVersion, cfg->m_ipStride);
+			return;
+		}
+
+		auto table = ProtoReloader::Decode(in, Utility::ProtoOptionsFromConfig(true));
+
+		if (!table)
+		{
+			SPDLOG_CRITICAL("Cannot decode {0}", in);
+			return;
+		}
+
+		ProtoConverter converter;
+
+		if (!converter.Prepare(table->cView.GetLayout(), to))
+		{
+			SPDLOG_CRITICAL("Cannot convert {0} (stride {1}) to stride {2}", in, table->cView.GetStride(), cfg->m_ipStride);
+			return;
+		}
+
+		if (converter.GetDroppedCount() > 0)
+		{
+			SPDLOG_WARN("{0} fields are not in the new layout and will be lost", converter.GetDroppedCount());
+		}
+
+		std::vector<uint8_t> records;
+
+		if (!converter.Convert(table->cView, records))
+		{
+			SPDLOG_CRITICAL("Cannot convert the records of {0}", in);
+			return;
+		}
+
+		SPDLOG_INFO("Converted {0} records", table->cView.GetCount());
+
+		std::shared_ptr<CryptedObjectAlgorithm> algorithm = std::make_shared<DefaultAlgorithmLzo1x>();
+		algorithm->ChangeFourCC(cfg->m_dwLzo1xFcc);
+
+		::CryptedObject obj;
+		obj.SetAlgorithm(algorithm);
+		obj.SetKeys(reinterpret_cast<uint32_t*>(cfg->m_ipKeys));
+
+		Proto p;
+		p.SetItemFourCC(cfg->m_ipNFcc);
+		p.SetItemOldFourCC(cfg->m_ipOFcc);
+
+		auto o = std::make_shared<BufferedFileSystem>();
+
+		if (!o->Open(out))
+		{
+			SPDLOG_CRITICAL("Cannot open file to write {0}", out);
+			return;
+		}
+
+		ProtoCompileErrors err = ProtoCompiler::PackRecords(ProtoType::ItemProto, cfg->m_ipStride, records.data(), table->cView.GetCount(), obj, p, o);
+
+		if (err != ProtoCompileErrors::Ok || !o->Close())
+		{
+			SPDLOG_CRITICAL("Cannot write {0}. Error: {1}", out, Utility::TextFromCompileError(err));
+			return;
+		}
+
+		SPDLOG_INFO("Completed!");
+	}
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+namespace Convert
+{
+	void ItemProto(const std::string& in, const std::string& out);
+}
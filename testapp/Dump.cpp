@@ -7,6 +7,9 @@
 #include <LibLyketo/DefaultAlgorithms.hpp>
 #include <LibLyketo/EterPack.hpp>
 #include <LibLyketo/Proto.hpp>
+#include <LibLyketo/ProtoExporter.hpp>
+#include <LibLyketo/ProtoReloader.hpp>
+#include <LibLyketo/BufferedFileSystem.hpp>
 
 #include <fstream>
 #include <memory>
@@ -104,73 +107,35 @@ namespace Dump
 
 		auto cfg = Config::instance();
 
-		uint32_t* magic = reinterpret_cast<uint32_t*>(data.data());
-
-		SPDLOG_DEBUG("Magic is {0}", *magic);
-
-		if (*magic == cfg->m_dwLzo1xFcc || *magic == cfg->m_dwSnappyFcc)
-		{
-			SPDLOG_DEBUG("EterPack is encrypted, decrypting...");
-
-			::CryptedObject obj;
-
-			obj.SetKeys(reinterpret_cast<const uint32_t*>(Config::instance()->m_eixKeys));
-			
-			std::shared_ptr<CryptedObjectAlgorithm> algorithm;
-
-			if (*magic == cfg->m_dwLzo1xFcc)
-			{
-				algorithm = std::make_shared<DefaultAlgorithmLzo1x>();
-				algorithm->ChangeFourCC(cfg->m_dwLzo1xFcc);
-			}
-			else
-			{
-				algorithm = std::make_shared<DefaultAlgorithmSnappy>();
-				algorithm->ChangeFourCC(cfg->m_dwSnappyFcc);
-			}
+		::EterPack epk;
 
-			obj.SetAlgorithm(algorithm);
+		epk.SetFourCC(cfg->m_dwEixFcc);
+		epk.SetVersion(cfg->m_epkVersion);
 
-			auto err = obj.Decrypt(data.data(), pos);
+		bool bLoaded = epk.LoadIndex(data.data(), data.size(), std::make_shared<Utility::DefaultFileSystem>(), reinterpret_cast<const uint32_t*>(cfg->m_eixKeys), cfg->m_dwLzo1xFcc, cfg->m_dwSnappyFcc);
 
-			if (err != CryptedObjectErrors::Ok)
+		if (epk.IsIndexCrypted())
+		{
+			if (epk.GetIndexError() != CryptedObjectErrors::Ok)
 			{
-				SPDLOG_CRITICAL("Cannot decrypt EIX. Error: {0}", Utility::TextFromCOError(err));
+				SPDLOG_CRITICAL("Cannot decrypt EIX. Error: {0}", Utility::TextFromCOError(epk.GetIndexError()));
 				return;
 			}
 
-			auto h = obj.GetHeader();
+			auto h = epk.GetIndexObjectHeader();
 
 			o << "Dump of CryptedObject:";
 			o << "\n\tFourCC: " << h.dwFourCC << " (" << FOURCC1(h.dwFourCC) << FOURCC2(h.dwFourCC) << FOURCC3(h.dwFourCC) << FOURCC4(h.dwFourCC) << ")";
-			o << "\n\tKeys: " << obj.GetKeys();
-			o << "\n\tDecrypted size (buffer): " << obj.GetSize();
+			o << "\n\tKeys: " << Utility::KeyToString(cfg->m_eixKeys);
+			o << "\n\tDecrypted size (buffer): " << epk.GetBufferSize();
 			o << "\n\tAfter compression size: " << h.dwAfterCompressLength;
 			o << "\n\tAfter cryptation size: " << h.dwAfterCryptLength;
 			o << "\n\tReal size: " << h.dwRealLength << "\n";
-
-			data.clear();
-			data.resize(obj.GetSize());
-			data.reserve(obj.GetSize());
-			memcpy_s(data.data(), data.size(), obj.GetBuffer(), obj.GetSize());
-
-			magic = reinterpret_cast<uint32_t*>(data.data());
 		}
 
-		SPDLOG_DEBUG("Magic (2) is {0}", *magic);
-
-		if (*magic != cfg->m_dwEixFcc)
-		{
-			SPDLOG_CRITICAL("Invalid FourCC in EIX");
-			return;
-		}
-
-		::EterPack epk;
-
-		epk.SetFourCC(cfg->m_dwEixFcc);
-		epk.SetVersion(cfg->m_epkVersion);
+		data.clear();
 
-		if (!epk.Load(data.data(), data.size(), std::make_shared<Utility::DefaultFileSystem>()))
+		if (!bLoaded)
 		{
 			SPDLOG_CRITICAL("Cannot load EIX");
 			return;
@@ -200,10 +165,10 @@ namespace Dump
 			o << "\n\tFilename: " << e.szFilename;
 			o << "\n\tPadding: " << static_cast<uint16_t>(e.bPadding1[0]) << " " << static_cast<uint16_t>(e.bPadding1[1]) << " " << static_cast<uint16_t>(e.bPadding1[2]);
 			o << "\n\tFilename CRC32: " << e.dwFilenameCRC32;
-			o << "\n\tReal size: " << e.dwRealSize;
-			o << "\n\tSize: " << e.dwSize;
+			o << "\n\tReal size: " << e.qwRealSize;
+			o << "\n\tSize: " << e.qwSize;
 			o << "\n\tCRC32: " << e.dwCRC32;
-			o << "\n\tPosition: " << e.dwPosition;
+			o << "\n\tPosition: " << e.qwPosition;
 			o << "\n\tType: " << static_cast<uint16_t>(e.bType);
 			o << "\n\tPadding: " << static_cast<uint16_t>(e.bPadding2[0]) << " " << static_cast<uint16_t>(e.bPadding2[1]) << " " << static_cast<uint16_t>(e.bPadding2[2]);
 			o << "\n";
@@ -258,7 +223,7 @@ namespace Dump
 		p.SetItemOldFourCC(cfg->m_ipOFcc);
 		p.SetVersion(cfg->m_ipVersion);
 
-		if (!p.Unpack(data.data(), data.size()))
+		if (!p.UnpackView(data.data(), data.size()))
 		{
 			SPDLOG_CRITICAL("Cannot unpack itemproto");
 			return;
@@ -371,7 +336,7 @@ namespace Dump
 		Proto p;
 		p.SetMobFourCC(cfg->m_mpFcc);
 
-		if (!p.Unpack(data.data(), data.size()))
+		if (!p.UnpackView(data.data(), data.size()))
 		{
 			SPDLOG_CRITICAL("Cannot unpack itemproto");
 			return;
@@ -433,4 +398,41 @@ namespace Dump
 
 		SPDLOG_INFO("Completed!");
 	}
+
+	void ProtoRecords(const std::string& in, const std::string& out, bool item, const std::string& format)
+	{
+		auto table = ProtoReloader::Decode(in, Utility::ProtoOptionsFromConfig(item));
+
+		if (!table)
+		{
+			SPDLOG_CRITICAL("Cannot decode {0}", in);
+			return;
+		}
+
+		if (table->cView.GetLayout() == ProtoLayout::Unknown)
+		{
+			SPDLOG_CRITICAL("Unknown record layout (stride {0}) in {1}", table->cView.GetStride(), in);
+			return;
+		}
+
+		auto o = std::make_shared<BufferedFileSystem>();
+
+		if (!o->Open(out))
+		{
+			SPDLOG_CRITICAL("Cannot open file to write {0}", out);
+			return;
+		}
+
+		SPDLOG_INFO("Exporting {0} records", table->cView.GetCount());
+
+		ProtoExporter exporter;
+
+		if (!exporter.Export(table->cView, format == "jsonl" ? ProtoExportFormat::JsonLines : ProtoExportFormat::Tsv, o) || !o->Close())
+		{
+			SPDLOG_CRITICAL("Cannot write {0}", out);
+			return;
+		}
+
+		SPDLOG_INFO("Completed!");
+	}
 }
@@ -8,4 +8,5 @@ namespace Dump
 	void CryptedObject(const std::string& in, const std::string& out);
 	void ItemProto(const std::string& in, const std::string& out);
 	void MobProto(const std::string& in, const std::string& out);
+	void ProtoRecords(const std::string& in, const std::string& out, bool item, const std::string& format);
 }
@@ -4,9 +4,12 @@
 /*
 	LibLyketo Test Application
 */
+#include "Compile.hpp"
 #include "Config.hpp"
+#include "Convert.hpp"
 #include "Dump.hpp"
 #include "Log.hpp"
+#include "Sniff.hpp"
 
 #include <cxxopts.hpp>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -24,8 +27,9 @@ int main(int argc, char* argv[])
 		("i,input", "Specify the input file or directory", cxxopts::value<std::string>())
 		("o,output", "Specify the output file or directory", cxxopts::value<std::string>())
 		("h,help", "Shows the help screen")
-		("a,action", "Specify the action to perform", cxxopts::value<std::string>(), "pack,unpack,encrypt,decrypt,dump")
-		("t,type", "Specify the input type", cxxopts::value<std::string>(), "item_proto,mob_proto,eterpack")
+		("a,action", "Specify the action to perform", cxxopts::value<std::string>(), "pack,unpack,encrypt,decrypt,dump,convert")
+		("t,type", "Specify the input type, detected from the input when missing", cxxopts::value<std::string>(), "auto,item_proto,mob_proto,eterpack,cryptobject")
+		("f,format", "Specify the output format of the dump (default: text)", cxxopts::value<std::string>(), "text,tsv,jsonl")
 		("configfile", "Specify a custom config file (default: lyketocli.json)", cxxopts::value<std::string>())
 		;
 
@@ -111,7 +115,7 @@ int main(int argc, char* argv[])
 		SPDLOG_WARN("Cannot parse the config file, default values will be used");
 	}
 
-	std::string action, input, output, type;
+	std::string action, input, output, type, format = "text";
 
 	if (result.count("action"))
 	{
@@ -133,24 +137,51 @@ int main(int argc, char* argv[])
 		type = result["type"].as<std::string>();
 	}
 
+	if (result.count("format"))
+	{
+		format = result["format"].as<std::string>();
+	}
+
 	SPDLOG_DEBUG("Action {0}", action.empty() ? "is empty!" : action);
 	SPDLOG_DEBUG("Input {0}", input.empty() ? "is empty!" : input);
 	SPDLOG_DEBUG("Output {0}", output.empty() ? "is empty!" : output);
 	SPDLOG_DEBUG("Type {0}", type.empty() ? "is empty!" : type);
 
+	if (action != "dump" && action != "encrypt" && action != "decrypt" && action != "unpack" && action != "pack" && action != "convert")
+	{
+		SPDLOG_CRITICAL("Invalid action {0}", action);
+		return EXIT_FAILURE;
+	}
+
+	// Pack reads a table, there is nothing to detect
+	if ((type.empty() || type == "auto") && action != "pack")
+	{
+		type = Sniff::Type(input);
+
+		if (type.empty())
+			return EXIT_FAILURE;
+	}
+
 	if (type != "item_proto" && type != "mob_proto" && type != "eterpack" && type != "cryptobject")
 	{
 		SPDLOG_CRITICAL("Invalid type argument {0}", type);
 		return EXIT_FAILURE;
 	}
 
-	if (action != "dump" && action != "encrypt" && action != "decrypt" && action != "unpack" && action != "pack")
+	if (format != "text" && format != "tsv" && format != "jsonl")
 	{
-		SPDLOG_CRITICAL("Invalid action {0}", action);
+		SPDLOG_CRITICAL("Invalid format {0}", format);
 		return EXIT_FAILURE;
 	}
 
-	if (action == "dump")
+	if (action == "dump" && format != "text")
+	{
+		if (type == "item_proto" || type == "mob_proto")
+			Dump::ProtoRecords(input, output, type == "item_proto", format);
+		else
+			SPDLOG_CRITICAL("Format {0} is only supported for item_proto and mob_proto", format);
+	}
+	else if (action == "dump")
 	{
 		if (type == "eterpack")
 			Dump::EterPack(input, output);
@@ -161,6 +192,22 @@ int main(int argc, char* argv[])
 		else if (type == "mob_proto")
 			Dump::MobProto(input, output);
 	}
+	else if (action == "pack")
+	{
+		if (type == "item_proto")
+			Compile::ItemProto(input, output);
+		else if (type == "mob_proto")
+			Compile::MobProto(input, output);
+		else
+			SPDLOG_CRITICAL("Pack is only supported for item_proto and mob_proto");
+	}
+	else if (action == "convert")
+	{
+		if (type == "item_proto")
+			Convert::ItemProto(input, output);
+		else
+			SPDLOG_CRITICAL("Convert is only supported for item_proto");
+	}
 
 	return EXIT_SUCCESS;
 }
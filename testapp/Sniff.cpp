@@ -0,0 +1,103 @@
+#include "Sniff.hpp"
+#include "Config.hpp"
+#include "Log.hpp"
+#include "Utility.hpp"
+
+#include <LibLyketo/FormatSniffer.hpp>
+
+#include <fstream>
+#include <vector>
+
+namespace Sniff
+{
+	std::string Type(const std::string& in)
+	{
+		// EterPacks are given without the extension
+		std::string path = in;
+		std::ifstream i(path, std::ifstream::binary);
+
+		if (!i.is_open())
+		{
+			path = in + ".eix";
+			i.open(path, std::ifstream::binary);
+		}
+
+		if (!i.is_open())
+		{
+			SPDLOG_CRITICAL("Cannot open file to read {0}", in);
+			return "";
+		}
+
+		std::vector<uint8_t> data(FormatSniffer::GetWantedLength());
+
+		i.read(reinterpret_cast<char*>(data.data()), data.size());
+		data.resize(static_cast<size_t>(i.gcount()));
+		i.close();
+
+		auto cfg = Config::instance();
+
+		FormatSniffer sniffer;
+		sniffer.SetFourCCs(cfg->m_ipNFcc, cfg->m_ipOFcc, cfg->m_mpFcc, cfg->m_dwEixFcc, cfg->m_dwLzo1xFcc, cfg->m_dwSnappyFcc);
+
+		// Same order as the key names below
+		sniffer.AddKey(reinterpret_cast<const uint32_t*>(cfg->m_ipKeys));
+		sniffer.AddKey(reinterpret_cast<const uint32_t*>(cfg->m_mpKeys));
+		sniffer.AddKey(reinterpret_cast<const uint32_t*>(cfg->m_eixKeys), SniffedFormat::EterPackIndex);
+		sniffer.AddKey(reinterpret_cast<const uint32_t*>(cfg->m_epkKeys));
+
+		const char* keys[] = { "ItemProto", "MobProto", "EterPack index", "EterPack" };
+
+		FormatSnifferResult result;
+
+		if (!sniffer.Sniff(data.data(), data.size(), result))
+		{
+			SPDLOG_CRITICAL("Cannot detect the type of {0}", path);
+			return "";
+		}
+
+		if (result.bHaveObject)
+		{
+			uint32_t fcc = result.dwAlgorithmFourCC;
+			SPDLOG_INFO("Algorithm of {0}: {1}{2}{3}{4}", path, FOURCC1(fcc), FOURCC2(fcc), FOURCC3(fcc), FOURCC4(fcc));
+
+			if (!result.bEncrypted)
+				SPDLOG_INFO("{0} is not encrypted", path);
+			else if (result.nKey < 0)
+				SPDLOG_WARN("None of the configured keys decrypts {0}", path);
+			else
+				SPDLOG_INFO("Key of {0}: {1}", path, keys[result.nKey]);
+		}
+
+		switch (result.eFormat)
+		{
+		case SniffedFormat::ItemProto:
+		case SniffedFormat::ItemProto_Old:
+			if (result.nKey > 0)
+				SPDLOG_WARN("{0} is an item proto encrypted with the {1} key", path, keys[result.nKey]);
+
+			if (result.eFormat == SniffedFormat::ItemProto)
+				SPDLOG_INFO("Detected type of {0}: item_proto (version {1}, stride {2}, {3} records)", path, result.dwVersion, result.dwStride, result.dwElements);
+			else
+				SPDLOG_INFO("Detected type of {0}: item_proto ({1} records)", path, result.dwElements);
+
+			return "item_proto";
+		case SniffedFormat::MobProto:
+			if (result.nKey >= 0 && result.nKey != 1)
+				SPDLOG_WARN("{0} is a mob proto encrypted with the {1} key", path, keys[result.nKey]);
+
+			SPDLOG_INFO("Detected type of {0}: mob_proto ({1} records)", path, result.dwElements);
+			return "mob_proto";
+		case SniffedFormat::EterPackIndex:
+			SPDLOG_INFO("Detected type of {0}: eterpack", path);
+			return "eterpack";
+		case SniffedFormat::CryptedObject:
+			SPDLOG_INFO("Detected type of {0}: cryptobject", path);
+			return "cryptobject";
+		default:
+			break;
+		}
+
+		SPDLOG_CRITICAL("Cannot detect the type of {0}", path);
+		return "";
+	}
+}
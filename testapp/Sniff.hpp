@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+namespace Sniff
+{
+	std::string Type(const std::string& in);
+}
@@ -1,9 +1,16 @@
 #pragma once
 
+#include "Config.hpp"
+
 #include <LibLyketo/CryptedObject.hpp>
 #include <LibLyketo/IFileSystem.hpp>
+#include <LibLyketo/ProtoCompiler.hpp>
+#include <LibLyketo/ProtoReloader.hpp>
 
 #include <fstream>
+#include <string>
+
+#include <string.h>
 
 #define FOURCC1(x) static_cast<char>(x & 0xFF)
 #define FOURCC2(x) static_cast<char>((x >> 8) & 0xFF)
@@ -12,6 +19,21 @@
 
 namespace Utility
 {
+	// Same format as the keys in the config file
+	inline std::string KeyToString(const uint8_t* key)
+	{
+		const char* digits = "0123456789ABCDEF";
+		std::string s;
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			s += digits[key[i] >> 4];
+			s += digits[key[i] & 0xF];
+		}
+
+		return s;
+	}
+
 	inline const char* TextFromCOError(CryptedObjectErrors err)
 	{
 		switch (err)
@@ -43,6 +65,58 @@ namespace Utility
 		return "Unknown";
 	}
 
+	inline const char* TextFromCompileError(ProtoCompileErrors err)
+	{
+		switch (err)
+		{
+		case ProtoCompileErrors::Ok:
+			return "No error";
+		case ProtoCompileErrors::InvalidLayout:
+			return "Unknown record layout";
+		case ProtoCompileErrors::EmptyHeader:
+			return "The first line must name the columns";
+		case ProtoCompileErrors::UnknownColumn:
+			return "Unknown column";
+		case ProtoCompileErrors::DuplicatedColumn:
+			return "Duplicated column";
+		case ProtoCompileErrors::InvalidColumnCount:
+			return "The line does not have a value for every column";
+		case ProtoCompileErrors::InvalidValue:
+			return "Invalid value";
+		case ProtoCompileErrors::ValueOutOfRange:
+			return "Value out of range";
+		case ProtoCompileErrors::StringTooLong:
+			return "Text too long";
+		case ProtoCompileErrors::TooManyRows:
+			return "Too many lines";
+		case ProtoCompileErrors::NoRecords:
+			return "The table has no records";
+		case ProtoCompileErrors::CryptFail:
+			return "Cannot compress or crypt the records";
+		case ProtoCompileErrors::WriteFail:
+			return "Cannot write the proto";
+		default:
+			break;
+		}
+
+		return "Unknown";
+	}
+
+	inline ProtoReloadOptions ProtoOptionsFromConfig(bool item)
+	{
+		auto cfg = Config::instance();
+
+		ProtoReloadOptions opts;
+		opts.bHaveKeys = true;
+		memcpy_s(opts.adwKeys, sizeof(opts.adwKeys), item ? cfg->m_ipKeys : cfg->m_mpKeys, sizeof(opts.adwKeys));
+		opts.dwLzo1xFourcc = cfg->m_dwLzo1xFcc;
+		opts.dwSnappyFourcc = cfg->m_dwSnappyFcc;
+		opts.dwItemFourcc = cfg->m_ipNFcc;
+		opts.dwItemOldFourcc = cfg->m_ipOFcc;
+		opts.dwMobFourcc = cfg->m_mpFcc;
+		return opts;
+	}
+
 	class DefaultFileSystem : public IFileSystem
 	{
 	public:
@@ -63,7 +137,7 @@ namespace Utility
 			return m_fs.is_open();
 		}
 
-		bool Seek(size_t nLength, SeekOffset eOffset) override
+		bool Seek(uint64_t nLength, SeekOffset eOffset) override
 		{
 			if (m_write)
 				m_fs.seekp(nLength, ToStlOffset(eOffset));
@@ -85,12 +159,18 @@ namespace Utility
 			return true;
 		}
 
-		long Tell() override
+		int64_t Tell() override
 		{
 			if (m_write)
-				return static_cast<long>(m_fs.tellp());
+				return static_cast<int64_t>(m_fs.tellp());
 
-			return  static_cast<long>(m_fs.tellg());
+			return  static_cast<int64_t>(m_fs.tellg());
+		}
+
+		bool Flush() override
+		{
+			m_fs.flush();
+			return !m_fs.fail();
 		}
 
 	private: